@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adv_matrix.h"
+
+#define ADV_INITIAL_ROWS 64
+#define ADV_INITIAL_PORTS 1024
+
+_Static_assert(ADV_LANES == 8, "adv_matrix_best assumes 8 lanes");
+
+static void *adv_alloc(size_t size) {
+    // Every row starts on a vector boundary
+    void *p = aligned_alloc(sizeof(adv_vector), size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void adv_fill(uint32_t *costs, size_t count) {
+    size_t i;
+    for (i=0; i<count; i++) {
+        costs[i] = ADV_INFINITY;
+    }
+}
+
+void adv_matrix_init(struct adv_matrix *m, int neighbor_count) {
+    m->neighbor_count = neighbor_count;
+    m->stride = (neighbor_count + ADV_LANES-1) / ADV_LANES * ADV_LANES;
+    if (m->stride == 0) {
+        m->stride = ADV_LANES;
+    }
+    m->link_cost = adv_alloc(m->stride * sizeof(uint32_t));
+    adv_fill(m->link_cost, m->stride);
+    m->row_count = 0;
+    m->row_capacity = ADV_INITIAL_ROWS;
+    m->costs = adv_alloc((size_t) m->row_capacity * m->stride
+            * sizeof(uint32_t));
+    m->row_of = NULL;
+    m->row_of_limit = 0;
+}
+
+void adv_matrix_free(struct adv_matrix *m) {
+    free(m->link_cost);
+    free(m->costs);
+    free(m->row_of);
+    m->link_cost = NULL;
+    m->costs = NULL;
+    m->row_of = NULL;
+    m->row_of_limit = 0;
+    m->row_count = 0;
+    m->row_capacity = 0;
+}
+
+void adv_matrix_set_link_cost(struct adv_matrix *m, int column,
+        uint32_t cost) {
+    m->link_cost[column] = cost < ADV_INFINITY ? cost : ADV_INFINITY;
+}
+
+// Makes row_of cover dest_port, so it only grows as large as the ports seen
+static void adv_matrix_cover(struct adv_matrix *m, uint16_t dest_port) {
+    if (dest_port < m->row_of_limit) {
+        return;
+    }
+    int limit = m->row_of_limit == 0 ? ADV_INITIAL_PORTS : m->row_of_limit;
+    while (limit <= dest_port) {
+        limit *= 2;
+    }
+    int32_t *row_of = realloc(m->row_of, limit * sizeof(int32_t));
+    if (row_of == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int i;
+    for (i=m->row_of_limit; i<limit; i++) {
+        row_of[i] = ADV_NO_ROW;
+    }
+    m->row_of = row_of;
+    m->row_of_limit = limit;
+}
+
+static int adv_matrix_add_row(struct adv_matrix *m, uint16_t dest_port) {
+    if (m->row_count == m->row_capacity) {
+        size_t row_size = m->stride * sizeof(uint32_t);
+        uint32_t *costs = adv_alloc(2 * m->row_capacity * row_size);
+        memcpy(costs, m->costs, m->row_count * row_size);
+        free(m->costs);
+        m->costs = costs;
+        m->row_capacity *= 2;
+    }
+    int row = m->row_count++;
+    adv_fill(&(m->costs[(size_t) row * m->stride]), m->stride);
+    m->row_of[dest_port] = row;
+    return row;
+}
+
+void adv_matrix_set(struct adv_matrix *m, int column, uint16_t dest_port,
+        uint32_t cost) {
+    int row = dest_port < m->row_of_limit ? m->row_of[dest_port] : ADV_NO_ROW;
+    if (row == ADV_NO_ROW) {
+        if (cost >= ADV_INFINITY) {
+            return;
+        }
+        adv_matrix_cover(m, dest_port);
+        row = adv_matrix_add_row(m, dest_port);
+    }
+    m->costs[(size_t) row * m->stride + column] =
+            cost < ADV_INFINITY ? cost : ADV_INFINITY;
+}
+
+void adv_matrix_clear_column(struct adv_matrix *m, int column) {
+    int row;
+    for (row=0; row<m->row_count; row++) {
+        m->costs[(size_t) row * m->stride + column] = ADV_INFINITY;
+    }
+}
+
+// With limited set, columns advertising limit or more are passed over.
+//  limited is always a constant, so the unlimited search has no masking.
+static inline uint32_t best_below(const struct adv_matrix *m,
+        uint16_t dest_port, int limited, uint32_t limit, int *best_column) {
+    int row = dest_port < m->row_of_limit ? m->row_of[dest_port] : ADV_NO_ROW;
+    if (row == ADV_NO_ROW) {
+        return ADV_INFINITY;
+    }
+    const adv_vector *costs =
+            (const adv_vector *) &(m->costs[(size_t) row * m->stride]);
+    const adv_vector *link_cost = (const adv_vector *) m->link_cost;
+    const adv_vector infinity = (adv_vector) {} + ADV_INFINITY;
+
+    // Each lane keeps the lowest total among its columns and the first
+    //  column with it
+    adv_vector best = costs[0] + link_cost[0];
+    if (limited) {
+        adv_vector allowed = (adv_vector) (costs[0] < limit);
+        best = (best & allowed) | (infinity & ~allowed);
+    }
+    adv_vector index = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    adv_vector best_index = index;
+    int lane;
+    int v;
+    for (v=1; v<m->stride / ADV_LANES; v++) {
+        index += ADV_LANES;
+        adv_vector total = costs[v] + link_cost[v];
+        if (limited) {
+            adv_vector allowed = (adv_vector) (costs[v] < limit);
+            total = (total & allowed) | (infinity & ~allowed);
+        }
+        adv_vector lower = (adv_vector) (total < best);
+        best = (total & lower) | (best & ~lower);
+        best_index = (index & lower) | (best_index & ~lower);
+    }
+
+    uint32_t min_cost = best[0];
+    uint32_t min_column = best_index[0];
+    for (lane=1; lane<ADV_LANES; lane++) {
+        if (best[lane] < min_cost || (best[lane] == min_cost &&
+                best_index[lane] < min_column)) {
+            min_cost = best[lane];
+            min_column = best_index[lane];
+        }
+    }
+    if (min_cost < ADV_INFINITY) {
+        *best_column = (int) min_column;
+    }
+    return min_cost;
+}
+
+uint32_t adv_matrix_best(const struct adv_matrix *m, uint16_t dest_port,
+        int *best_column) {
+    return best_below(m, dest_port, 0, 0, best_column);
+}
+
+uint32_t adv_matrix_best_below(const struct adv_matrix *m,
+        uint16_t dest_port, uint32_t limit, int *best_column) {
+    return best_below(m, dest_port, 1, limit, best_column);
+}
+
+int adv_matrix_columns_at(const struct adv_matrix *m, uint16_t dest_port,
+        uint32_t cost, uint32_t limit, int *columns, int max_columns) {
+    int row = dest_port < m->row_of_limit ? m->row_of[dest_port] : ADV_NO_ROW;
+    if (row == ADV_NO_ROW) {
+        return 0;
+    }
+    const uint32_t *costs = &(m->costs[(size_t) row * m->stride]);
+    int count = 0;
+    int column;
+    for (column=0; column<m->neighbor_count && count<max_columns; column++) {
+        if (costs[column] < limit
+                && costs[column] + m->link_cost[column] == cost) {
+            columns[count++] = column;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,72 @@
+#ifndef ADV_MATRIX_H
+#define ADV_MATRIX_H
+
+#include <stdint.h>
+
+// What every neighbor last advertised, as one dense cost matrix: a row per
+//  destination and a column per neighbor, plus the link cost to each
+//  neighbor. Finding the best route to a destination is then a vectorized
+//  min over one contiguous row instead of a hash lookup per neighbor.
+// Rows are handed out to destinations as they are first advertised and are
+//  kept for good; there are at most UINT16_MAX of them.
+
+// Cost of a cell with no advertisement. Small enough that adding a link cost
+//  to it can't overflow.
+#define ADV_INFINITY 0x3FFFFFFFu
+
+#define ADV_LANES 8 // Costs compared per vector operation
+#define ADV_NO_ROW (-1)
+
+typedef uint32_t adv_vector
+        __attribute__((vector_size(ADV_LANES * sizeof(uint32_t))));
+
+struct adv_matrix {
+    int neighbor_count;
+    int stride; // Columns per row: neighbor_count rounded up to ADV_LANES
+    uint32_t *link_cost; // stride entries; padding is ADV_INFINITY
+    uint32_t *costs; // row_capacity rows of stride entries
+    int row_count;
+    int row_capacity;
+    int32_t *row_of; // Row of each destination port, or ADV_NO_ROW
+    int row_of_limit; // Ports row_of covers; it grows as needed
+};
+
+void adv_matrix_init(struct adv_matrix *m, int neighbor_count);
+void adv_matrix_free(struct adv_matrix *m);
+
+void adv_matrix_set_link_cost(struct adv_matrix *m, int column,
+        uint32_t cost);
+
+// Records that the neighbor in column advertises cost to dest_port;
+//  ADV_INFINITY (or more) withdraws the advertisement
+void adv_matrix_set(struct adv_matrix *m, int column, uint16_t dest_port,
+        uint32_t cost);
+
+// What the neighbor in column advertises for dest_port
+static inline uint32_t adv_matrix_get(const struct adv_matrix *m, int column,
+        uint16_t dest_port) {
+    int row = dest_port < m->row_of_limit ? m->row_of[dest_port] : ADV_NO_ROW;
+    return row == ADV_NO_ROW ?
+            ADV_INFINITY : m->costs[(size_t) row * m->stride + column];
+}
+
+// Withdraws everything the neighbor in column advertised
+void adv_matrix_clear_column(struct adv_matrix *m, int column);
+
+// Lowest link cost plus advertised cost to dest_port over all neighbors,
+//  and the first column that offers it. Returns ADV_INFINITY (or more), with
+//  *best_column left alone, if no neighbor has a route.
+uint32_t adv_matrix_best(const struct adv_matrix *m, uint16_t dest_port,
+        int *best_column);
+
+// The same, but only over neighbors that advertise less than limit
+uint32_t adv_matrix_best_below(const struct adv_matrix *m,
+        uint16_t dest_port, uint32_t limit, int *best_column);
+
+// Fills columns with the neighbors that offer exactly cost to dest_port
+//  while advertising less than limit, up to max_columns of them, in column
+//  order. Returns how many there are.
+int adv_matrix_columns_at(const struct adv_matrix *m, uint16_t dest_port,
+        uint32_t cost, uint32_t limit, int *columns, int max_columns);
+
+#endif
@@ -0,0 +1,120 @@
+// Compares finding the best route to every destination by looking each one
+//  up in every neighbor's DV hash table (the way best_route used to work)
+//  with a vectorized scan of the adv_matrix row.
+//
+// Usage: bench_adv_matrix [destinations] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "dv_table.h"
+#include "adv_matrix.h"
+
+struct neighbor {
+    uint16_t port;
+    uint32_t cost;
+    struct dv_table dv;
+    struct neighbor *next;
+};
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static uint32_t best_route_list(struct neighbor *head, uint16_t dest_port,
+        uint16_t *best_first_hop_port) {
+    uint32_t min_cost = UINT32_MAX;
+    struct neighbor *neighbor;
+    for (neighbor = head; neighbor != NULL; neighbor = neighbor->next) {
+        struct dv_entry *neighbors_entry = dv_find(&neighbor->dv, dest_port);
+        if (neighbors_entry!=NULL &&
+                neighbors_entry->cost + neighbor->cost < min_cost) {
+            min_cost = neighbors_entry->cost + neighbor->cost;
+            *best_first_hop_port = neighbor->port;
+        }
+    }
+    return min_cost;
+}
+
+static void run(int degree, int dest_count, int rounds) {
+    struct neighbor *neighbors = calloc(degree, sizeof(struct neighbor));
+    struct neighbor *head = NULL;
+    struct adv_matrix m;
+    adv_matrix_init(&m, degree);
+    srand(degree);
+    int i, d, r;
+    for (i=degree-1; i>=0; i--) {
+        struct neighbor *n = &neighbors[i];
+        n->port = 20000 + i;
+        n->cost = 1 + rand() % 10;
+        dv_init(&n->dv);
+        n->next = head;
+        head = n;
+        adv_matrix_set_link_cost(&m, i, n->cost);
+        for (d=0; d<dest_count; d++) {
+            // Each neighbor knows most, but not all, destinations
+            if (rand() % 8 == 0) {
+                continue;
+            }
+            uint16_t dest_port = 1 + d;
+            struct dv_entry *e = dv_insert(&n->dv, dest_port);
+            e->cost = 1 + rand() % 60;
+            adv_matrix_set(&m, i, dest_port, e->cost);
+        }
+    }
+
+    uint64_t check_list = 0, check_matrix = 0;
+    double start = now_seconds();
+    for (r=0; r<rounds; r++) {
+        for (d=0; d<dest_count; d++) {
+            uint16_t hop = 0;
+            check_list += best_route_list(head, 1 + d, &hop) + hop;
+        }
+    }
+    double list_time = now_seconds() - start;
+
+    start = now_seconds();
+    for (r=0; r<rounds; r++) {
+        for (d=0; d<dest_count; d++) {
+            int column = 0;
+            uint32_t cost = adv_matrix_best(&m, 1 + d, &column);
+            check_matrix += cost >= ADV_INFINITY ?
+                    UINT32_MAX : cost + neighbors[column].port;
+        }
+    }
+    double matrix_time = now_seconds() - start;
+
+    double lookups = (double) rounds * dest_count;
+    printf("%6d %12.1f %12.1f %8.2fx %s\n", degree,
+            list_time / lookups * 1e9, matrix_time / lookups * 1e9,
+            list_time / matrix_time,
+            check_list == check_matrix ? "" : "(results differ!)");
+
+    for (i=0; i<degree; i++) {
+        dv_free(&neighbors[i].dv);
+    }
+    free(neighbors);
+    adv_matrix_free(&m);
+}
+
+int main(int argc, char **argv) {
+    int dest_count = argc > 1 ? atoi(argv[1]) : 4096;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (dest_count < 1 || dest_count > UINT16_MAX || rounds < 1) {
+        fprintf(stderr, "Usage: %s [destinations] [rounds]\n", argv[0]);
+        exit(1);
+    }
+    printf("best route to each of %d destinations, %d rounds\n",
+            dest_count, rounds);
+    printf("%6s %12s %12s %9s\n", "degree", "list ns/dest", "matrix ns/dest",
+            "speedup");
+    int degrees[] = { 2, 4, 8, 16, 32, 64, 128, 256 };
+    size_t k;
+    for (k=0; k<sizeof degrees / sizeof degrees[0]; k++) {
+        run(degrees[k], dest_count, rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,674 @@
+// Microbenchmarks of the hot paths of the router, at several DV sizes and
+//  neighbor counts. Each reports the time and the number of allocations
+//  (malloc, calloc, realloc, aligned_alloc) per operation.
+//
+// The router's internals are called through router_internal.h, and data
+//  packets go through forward.c with a FIB it compiled, so what is timed
+//  is the code the routers run.
+//
+// Usage: bench_router [-b benchmark] [-n sizes] [-k neighbors] [-m min_ms]
+//   sizes and neighbors are comma separated lists
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "router.h"
+#include "router_internal.h"
+#include "forward.h"
+#include "fib.h"
+#include "qsbr.h"
+#include "metrics.h"
+#include "netio.h"
+#include "logger.h"
+#include "data_packet.h"
+
+#define MAX_PARAMETERS 16
+
+//-----------------------------------------------------------------------------
+// Allocation counting: the bench is linked with --wrap for each of these
+
+unsigned long my_allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    my_allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    my_allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    my_allocations++;
+    return __real_realloc(p, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+    my_allocations++;
+    return __real_aligned_alloc(alignment, size);
+}
+
+//-----------------------------------------------------------------------------
+// Global variables
+int my_min_ms = 200; // Each benchmark runs at least this long
+uint64_t my_rng_state = 1;
+char *my_arena; // Message bodies reserved by the router under test
+size_t my_arena_used = 0;
+size_t my_arena_capacity = 0;
+unsigned long my_flush_count = 0;
+//-----------------------------------------------------------------------------
+
+// xorshift64*
+static uint64_t bench_random() {
+    my_rng_state ^= my_rng_state >> 12;
+    my_rng_state ^= my_rng_state << 25;
+    my_rng_state ^= my_rng_state >> 27;
+    return my_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// A transport that goes nowhere: sends are dropped, time stands still and
+//  the update timer never fires
+static void bench_flush() {
+    my_arena_used = 0;
+    my_flush_count++;
+}
+
+static char *bench_reserve(void *ctx, size_t size) {
+    (void) ctx;
+    if (my_arena_used + size > my_arena_capacity) {
+        bench_flush();
+        if (size > my_arena_capacity) {
+            free(my_arena);
+            my_arena_capacity = size > 65536 ? size : 65536;
+            my_arena = router_alloc(NULL, my_arena_capacity);
+        }
+    }
+    char *p = my_arena + my_arena_used;
+    my_arena_used += size;
+    return p;
+}
+
+static unsigned long bench_flush_count(void *ctx) {
+    (void) ctx;
+    return my_flush_count;
+}
+
+static void bench_send(void *ctx, const char *head, size_t head_length,
+        const char *body, size_t body_length, uint16_t dest_port) {
+    (void) ctx;
+    (void) head;
+    (void) head_length;
+    (void) body;
+    (void) body_length;
+    (void) dest_port;
+}
+
+static uint64_t bench_now_ms(void *ctx) {
+    (void) ctx;
+    return 0;
+}
+
+static void bench_set_update_timer(void *ctx, uint64_t delay_ms) {
+    (void) ctx;
+    (void) delay_ms;
+}
+
+const struct router_ops my_bench_ops = {
+    bench_reserve,
+    bench_flush_count,
+    bench_send,
+    bench_now_ms,
+    bench_set_update_timer,
+    NULL
+};
+
+// Destinations are ports 1 to size; neighbors are the ports after them
+static inline uint16_t neighbor_port(int size, int i) {
+    return (uint16_t) (size + 1 + i);
+}
+
+// A started router with neighbor_count neighbors and nothing in its DV
+static void bench_router(struct router *r, int size, int neighbor_count) {
+    router_init(r, "X", UINT16_MAX, &my_bench_ops, NULL);
+    int i;
+    for (i=0; i<neighbor_count; i++) {
+        router_add_neighbor(r, neighbor_port(size, i), 1 + i % 4);
+    }
+    router_start(r);
+    bench_flush();
+}
+
+// A DV with a route to each of ports 1 to size, all through first_hop_port
+static void fill_dv(struct dv_table *dv, int size, uint16_t first_hop_port) {
+    int d;
+    for (d=1; d<=size; d++) {
+        struct dv_entry *e = dv_insert(dv, d);
+        e->first_hop_port = first_hop_port;
+        e->cost = 1 + bench_random() % 50;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Running a benchmark
+
+typedef void (*bench_op)(void *state, long i);
+
+// Runs op until min_ms have passed, in growing batches so the clock is
+//  read rarely, and prints ns and allocations per op
+static void bench_run(const char *name, int size, int neighbor_count,
+        bench_op op, void *state) {
+    long batch = 1;
+    long total = 0;
+    unsigned long allocations = my_allocations;
+    double start = now_seconds();
+    double elapsed;
+    while (1) {
+        long i;
+        for (i=0; i<batch; i++) {
+            op(state, total + i);
+        }
+        total += batch;
+        elapsed = now_seconds() - start;
+        if (elapsed * 1000 >= my_min_ms) {
+            break;
+        }
+        if (elapsed * 1000 < my_min_ms / 10.0) {
+            batch *= 2;
+        }
+    }
+    printf("%-22s %8d %9d %12.1f %10.3f %12ld\n", name, size, neighbor_count,
+            elapsed / total * 1e9,
+            (double) (my_allocations - allocations) / total, total);
+    fflush(stdout);
+}
+
+//-----------------------------------------------------------------------------
+// The benchmarks
+
+struct find_state {
+    struct dv_table dv;
+    uint16_t *keys; // Random destinations to look up, hits and misses
+    int key_mask;
+};
+
+static void op_dv_find(void *state, long i) {
+    struct find_state *s = state;
+    struct dv_entry *e = dv_find(&s->dv, s->keys[i & s->key_mask]);
+    __asm__ volatile("" : : "r"(e));
+}
+
+// Looks up random ports, about 1 in 9 of them not in the table
+static void bench_dv_find(int size, int neighbor_count) {
+    struct find_state s;
+    dv_init(&s.dv);
+    fill_dv(&s.dv, size, 1);
+    s.key_mask = 4095;
+    s.keys = router_alloc(NULL, (s.key_mask + 1) * sizeof(uint16_t));
+    int i;
+    for (i=0; i<=s.key_mask; i++) {
+        s.keys[i] = 1 + bench_random() % (size + size/8);
+    }
+    bench_run("dv_find", size, neighbor_count, op_dv_find, &s);
+    free(s.keys);
+    dv_free(&s.dv);
+}
+
+struct decrease_state {
+    struct router r;
+    int size;
+};
+
+static void op_bellman_ford_decrease(void *state, long i) {
+    struct decrease_state *s = state;
+    uint16_t dest_port = 1 + i % s->size;
+    // Every destination gets cheaper each time round, from 63 down to 1
+    uint32_t cost = MAX_POSSIBLE_COST - 1
+            - (i / s->size) % (MAX_POSSIBLE_COST - 1);
+    if (cost == MAX_POSSIBLE_COST - 1) {
+        // Starting over from the top needs the entry gone first
+        dv_remove(&s->r.dv, dest_port);
+        if (dest_port < s->r.routes_limit) {
+            s->r.routes[dest_port].feasible_cost = UINT32_MAX;
+        }
+    }
+    bellman_ford_decrease(&s->r, dest_port, neighbor_port(s->size, 0), cost,
+            cost - 1);
+    if ((i & 1023) == 1023) {
+        dv_journal_trim(&s->r);
+    }
+}
+
+// Each op improves the route to one destination
+static void bench_bellman_ford_decrease(int size, int neighbor_count) {
+    struct decrease_state s;
+    s.size = size;
+    bench_router(&s.r, size, neighbor_count);
+    // Nobody hears about the changes, so the journal may be trimmed freely
+    struct neighbor_list_node *node = s.r.neighbors;
+    for (; node!=NULL; node = node->next) {
+        node->dv_version_sent = UINT64_MAX;
+    }
+    bench_run("bellman_ford_decrease", size, neighbor_count,
+            op_bellman_ford_decrease, &s);
+    router_free(&s.r);
+}
+
+struct create_state {
+    struct router r;
+};
+
+static void op_create_dv_message(void *state, long i) {
+    (void) i;
+    struct create_state *s = state;
+    struct dv_message m;
+    create_dv_message(&s->r, &m, DV_EMPTY_PORT, s->r.aggregate);
+    bench_flush();
+}
+
+// Each op encodes the whole DV
+static void bench_create_dv_message(int size, int neighbor_count) {
+    struct create_state s;
+    bench_router(&s.r, size, neighbor_count);
+    fill_dv(&s.r.dv, size, neighbor_port(size, 0));
+    bench_run("create_dv_message", size, neighbor_count,
+            op_create_dv_message, &s);
+    router_free(&s.r);
+}
+
+static int compare_dest_port(const void *a, const void *b) {
+    return (int) ((const struct dv_entry *) a)->dest_port -
+            (int) ((const struct dv_entry *) b)->dest_port;
+}
+
+// Full DV messages, as datagrams, ready to be handled
+struct encoded_dv {
+    char **datagrams;
+    size_t *lengths;
+    int count;
+};
+
+static void encode_dv(struct encoded_dv *out, struct dv_table *dv,
+        uint32_t seq) {
+    struct dv_entry *entries = router_alloc(NULL,
+            (dv->length > 0 ? dv->length : 1) * sizeof(struct dv_entry));
+    int n = 0;
+    int i;
+    for (i=0; i<dv->capacity; i++) {
+        if (dv_slot_used(&dv->slots[i])) {
+            entries[n++] = dv->slots[i];
+        }
+    }
+    qsort(entries, n, sizeof(struct dv_entry), compare_dest_port);
+    char *body = router_alloc(NULL, (size_t) n * DV_ENTRY_MAX_ENCODED + 1);
+    struct dv_message m;
+    dv_message_encode(&m, body, entries, NULL, n, DV_FRAGMENT_BODY_MAX);
+    out->count = m.fragment_count;
+    out->datagrams = router_alloc(NULL, m.fragment_count * sizeof(char *));
+    out->lengths = router_alloc(NULL, m.fragment_count * sizeof(size_t));
+    for (i=0; i<m.fragment_count; i++) {
+        struct dv_header header;
+        dv_message_header(&m, i, DV_PACKET, seq, &header);
+        size_t body_length;
+        const char *fragment = dv_message_fragment(&m, i, &body_length);
+        out->lengths[i] = sizeof header + body_length;
+        out->datagrams[i] = router_alloc(NULL, out->lengths[i]);
+        memcpy(out->datagrams[i], &header, sizeof header);
+        memcpy(out->datagrams[i] + sizeof header, fragment, body_length);
+    }
+    free(body);
+    free(entries);
+}
+
+static void free_encoded_dv(struct encoded_dv *e) {
+    int i;
+    for (i=0; i<e->count; i++) {
+        free(e->datagrams[i]);
+    }
+    free(e->datagrams);
+    free(e->lengths);
+}
+
+#define DV_VARIANTS 8
+
+struct handle_state {
+    struct router r;
+    int size;
+    int neighbor_count;
+    // Per neighbor, DVs that each differ from the one before in 1 in 10
+    //  costs. Sequence numbers are patched in as they are sent.
+    struct encoded_dv (*variants)[DV_VARIANTS];
+    uint32_t *seq;
+};
+
+static void op_handle_dv_packet(void *state, long i) {
+    struct handle_state *s = state;
+    int k = i % s->neighbor_count;
+    struct encoded_dv *e = &s->variants[k][(i / s->neighbor_count)
+            % DV_VARIANTS];
+    s->seq[k] = dv_next_seq(s->seq[k]);
+    int f;
+    for (f=0; f<e->count; f++) {
+        struct dv_header *header = (struct dv_header *) e->datagrams[f];
+        header->seq = htonl(s->seq[k]);
+        handle_dv_packet(&s->r, neighbor_port(s->size, k), e->datagrams[f],
+                e->lengths[f]);
+    }
+    // No update goes out, but the journal must not grow without bound
+    struct neighbor_list_node *node = s->r.neighbors;
+    for (; node!=NULL; node = node->next) {
+        node->dv_version_sent = dv_version(&s->r);
+    }
+    dv_journal_trim(&s->r);
+    bench_flush();
+}
+
+// Each op is a full DV from the next neighbor in turn, in which 1 in 10
+//  costs changed since its last one
+static void bench_handle_dv_packet(int size, int neighbor_count) {
+    if (neighbor_count == 0) {
+        return;
+    }
+    struct handle_state s;
+    s.size = size;
+    s.neighbor_count = neighbor_count;
+    bench_router(&s.r, size, neighbor_count);
+    s.variants = router_alloc(NULL,
+            neighbor_count * sizeof(struct encoded_dv[DV_VARIANTS]));
+    s.seq = calloc(neighbor_count, sizeof(uint32_t));
+    struct dv_table dv;
+    dv_init(&dv);
+    fill_dv(&dv, size, 0);
+    int k, v, d;
+    for (k=0; k<neighbor_count; k++) {
+        for (v=0; v<DV_VARIANTS; v++) {
+            for (d=1; d<=size; d++) {
+                if (bench_random() % 10 == 0) {
+                    dv_find(&dv, d)->cost = 1 + bench_random() % 50;
+                }
+            }
+            encode_dv(&s.variants[k][v], &dv, 0);
+        }
+    }
+    dv_free(&dv);
+
+    // Every neighbor's first DV is handled before timing starts
+    for (k=0; k<neighbor_count; k++) {
+        op_handle_dv_packet(&s, k);
+    }
+    bench_run("handle_dv_packet", size, neighbor_count,
+            op_handle_dv_packet, &s);
+
+    for (k=0; k<neighbor_count; k++) {
+        for (v=0; v<DV_VARIANTS; v++) {
+            free_encoded_dv(&s.variants[k][v]);
+        }
+    }
+    free(s.variants);
+    free(s.seq);
+    router_free(&s.r);
+}
+
+#define BENCH_PAYLOAD_SIZE 80
+#define BENCH_PACKET_SIZE (DATA_HEADER_SIZE + BENCH_PAYLOAD_SIZE)
+#define BENCH_PATHS 4
+
+struct forward_state {
+    struct router r;
+    struct forward_node node;
+    struct qsbr qsbr;
+    struct metrics metrics;
+    struct tx_queue tx;
+    char *packets; // Data packets to random destinations
+    struct data_header *headers; // Theirs, for the lookup alone
+    int packet_mask;
+};
+
+static void op_fib_lookup(void *state, long i) {
+    struct forward_state *s = state;
+    const struct data_header *h = &s->headers[i & s->packet_mask];
+    uint16_t next_port = fib_lookup(fib_current(&s->node.fib), h->src_port,
+            h->dest_port, h->flow);
+    __asm__ volatile("" : : "r"(next_port));
+}
+
+static void op_forward_data_packet(void *state, long i) {
+    struct forward_state *s = state;
+    char *buffer = &s->packets[(i & s->packet_mask) * BENCH_PACKET_SIZE];
+    // Each packet is forwarded many times; make it look freshly sent
+    buffer[DATA_TTL_OFFSET] = DATA_DEFAULT_TTL;
+    forward_data_packet(&s->node, 0, buffer, BENCH_PACKET_SIZE, &s->tx,
+            &s->metrics);
+}
+
+// Each op forwards one data packet: either just the FIB lookup, or all of
+//  forward_data_packet, sending (in batches of DEFAULT_BATCH_SIZE) to
+//  sockets that never read. The router has BENCH_PATHS neighbors at the
+//  same cost advertising the same DV, and the lookup is also timed with
+//  every destination spread over all of them.
+static void bench_forward(int size, int neighbor_count) {
+    struct forward_state s;
+    memset(&s, 0, sizeof s);
+    router_init(&s.r, "X", UINT16_MAX, &my_bench_ops, NULL);
+
+    // The neighbors are all sockets of ours, so nothing leaves the host
+    int sink_fds[BENCH_PATHS];
+    int k;
+    for (k=0; k<BENCH_PATHS; k++) {
+        sink_fds[k] = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_length = sizeof addr;
+        if (sink_fds[k] < 0 || bind(sink_fds[k], (struct sockaddr *) &addr,
+                sizeof addr) < 0 || getsockname(sink_fds[k],
+                (struct sockaddr *) &addr, &addr_length) < 0) {
+            perror("Error creating sink socket");
+            exit(1);
+        }
+        router_add_neighbor(&s.r, ntohs(addr.sin_port), 1);
+    }
+    router_start(&s.r);
+    struct dv_table dv;
+    dv_init(&dv);
+    fill_dv(&dv, size, 0);
+    struct encoded_dv e;
+    encode_dv(&e, &dv, 1);
+    struct neighbor_list_node *node = s.r.neighbors;
+    for (; node!=NULL; node = node->next) {
+        int f;
+        for (f=0; f<e.count; f++) {
+            router_handle_packet(&s.r, node->port, e.datagrams[f],
+                    e.lengths[f]);
+        }
+    }
+    free_encoded_dv(&e);
+    dv_free(&dv);
+    bench_flush();
+
+    s.node.port = s.r.port;
+    qsbr_init(&s.qsbr, 0);
+    metrics_init(&s.metrics);
+    s.packet_mask = 4095;
+    s.packets = calloc(s.packet_mask + 1, BENCH_PACKET_SIZE);
+    s.headers = calloc(s.packet_mask + 1, sizeof(struct data_header));
+    int i;
+    for (i=0; i<=s.packet_mask; i++) {
+        struct data_header header = {
+            .type = DATA_PACKET,
+            .version = DATA_WIRE_VERSION,
+            .ttl = DATA_DEFAULT_TTL,
+            .src_port = 1 + bench_random() % size,
+            .dest_port = 1 + bench_random() % size,
+            .flow = bench_random(),
+            .payload_length = BENCH_PAYLOAD_SIZE,
+        };
+        data_header_write(&s.packets[i * BENCH_PACKET_SIZE], &header);
+        s.headers[i] = header;
+    }
+
+    forward_update_fib(&s.node, &s.r, 1, &s.qsbr);
+    bench_run("fib_lookup", size, neighbor_count, op_fib_lookup, &s);
+    forward_update_fib(&s.node, &s.r, BENCH_PATHS, &s.qsbr);
+    bench_run("fib_lookup ecmp", size, neighbor_count, op_fib_lookup, &s);
+
+    int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (send_fd < 0) {
+        perror("Error creating socket");
+        exit(1);
+    }
+    tx_queue_init(&s.tx, send_fd, DEFAULT_BATCH_SIZE);
+    forward_update_fib(&s.node, &s.r, 1, &s.qsbr);
+    bench_run("forward_data_packet", size, neighbor_count,
+            op_forward_data_packet, &s);
+    tx_queue_flush(&s.tx);
+    if (s.metrics.counters[METRIC_FORWARDED] == 0
+            || s.metrics.counters[METRIC_UNROUTABLE] > 0) {
+        fprintf(stderr, "Error: Not every data packet was forwarded\n");
+        exit(1);
+    }
+    qsbr_reclaim(&s.qsbr);
+
+    close(send_fd);
+    for (k=0; k<BENCH_PATHS; k++) {
+        close(sink_fds[k]);
+    }
+    free(s.packets);
+    free(s.headers);
+    router_free(&s.r);
+}
+
+//-----------------------------------------------------------------------------
+
+struct benchmark {
+    const char *name;
+    void (*run)(int size, int neighbor_count);
+    int per_neighbor_count; // Whether results depend on the neighbor count
+};
+
+const struct benchmark my_benchmarks[] = {
+    { "dv_find", bench_dv_find, 0 },
+    { "bellman_ford_decrease", bench_bellman_ford_decrease, 0 },
+    { "create_dv_message", bench_create_dv_message, 0 },
+    { "handle_dv_packet", bench_handle_dv_packet, 1 },
+    { "forward", bench_forward, 0 },
+};
+
+// Parses a comma separated list of numbers from low to high
+static int parse_list(const char *str, int low, int high, int *values) {
+    int count = 0;
+    while (*str != '\0') {
+        char *end;
+        errno = 0;
+        long value = strtol(str, &end, 10);
+        if (errno == ERANGE || end == str || value < low || value > high
+                || count == MAX_PARAMETERS
+                || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        values[count++] = value;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-b benchmark] [-n sizes] [-k neighbors]"
+            " [-m min_ms]\n", program_name);
+    fprintf(stderr, "  -b  run only this benchmark (dv_find,"
+            " bellman_ford_decrease,\n"
+            "      create_dv_message, handle_dv_packet or forward)\n");
+    fprintf(stderr, "  -n  DV sizes, comma separated (default 100,1000,10000)\n");
+    fprintf(stderr, "  -k  neighbor counts, comma separated (default 2,8,32)\n");
+    fprintf(stderr, "  -m  ms to run each benchmark for (default 200)\n");
+}
+
+int main(int argc, char **argv) {
+    const char *only = NULL;
+    int sizes[MAX_PARAMETERS] = { 100, 1000, 10000 };
+    int size_count = 3;
+    int neighbor_counts[MAX_PARAMETERS] = { 2, 8, 32 };
+    int neighbor_count_count = 3;
+    int max_size = UINT16_MAX - 1 - 256; // Ports above are for neighbors
+    int opt;
+    log_level = LOG_ERROR;
+    while ((opt = getopt(argc, argv, "b:n:k:m:")) != -1) {
+        switch (opt) {
+            case 'b':
+                only = optarg;
+            break;
+            case 'n':
+                size_count = parse_list(optarg, 1, max_size, sizes);
+                if (size_count <= 0) {
+                    fprintf(stderr, "Error: Invalid sizes %s\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'k':
+                neighbor_count_count = parse_list(optarg, 1, 256,
+                        neighbor_counts);
+                if (neighbor_count_count <= 0) {
+                    fprintf(stderr, "Error: Invalid neighbor counts %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'm':
+                my_min_ms = atoi(optarg);
+                if (my_min_ms <= 0) {
+                    fprintf(stderr, "Error: Invalid time %s\n", optarg);
+                    exit(1);
+                }
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    printf("%-22s %8s %9s %12s %10s %12s\n", "benchmark", "dv size",
+            "neighbors", "ns/op", "allocs/op", "ops");
+    size_t b;
+    int found = 0;
+    for (b=0; b<sizeof my_benchmarks / sizeof my_benchmarks[0]; b++) {
+        const struct benchmark *bench = &my_benchmarks[b];
+        if (only != NULL && strcmp(only, bench->name) != 0) {
+            continue;
+        }
+        found = 1;
+        int n, k;
+        for (n=0; n<size_count; n++) {
+            if (!bench->per_neighbor_count) {
+                bench->run(sizes[n], neighbor_counts[0]);
+                continue;
+            }
+            for (k=0; k<neighbor_count_count; k++) {
+                bench->run(sizes[n], neighbor_counts[k]);
+            }
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "Error: Unknown benchmark %s\n", only);
+        exit(1);
+    }
+    free(my_arena);
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "capture.h"
+#include "logger.h"
+
+// pcapng block types and the bits of them that are used here. Blocks are in
+//  host byte order, which the byte-order magic tells readers, and are laid
+//  out as packed structs.
+#define PCAPNG_SECTION_HEADER 0x0A0D0D0Au
+#define PCAPNG_INTERFACE_DESCRIPTION 1u
+#define PCAPNG_ENHANCED_PACKET 6u
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4Du
+#define PCAPNG_LINKTYPE_IPV4 228 // Raw IPv4, no link layer
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_EPB_FLAGS 2
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+#define FAKE_HEADERS_SIZE 28 // IPv4 and UDP
+
+#define CAPTURE_PATH_LEN 4096
+
+struct pcapng_option {
+    uint16_t code;
+    uint16_t length;
+} __attribute__((packed));
+
+struct pcapng_section_header {
+    uint32_t type;
+    uint32_t length;
+    uint32_t byte_order_magic;
+    uint16_t major_version;
+    uint16_t minor_version;
+    int64_t section_length; // -1: not given
+    uint32_t trailing_length;
+} __attribute__((packed));
+
+struct pcapng_interface_description {
+    uint32_t type;
+    uint32_t length;
+    uint16_t linktype;
+    uint16_t reserved;
+    uint32_t snaplen;
+    struct pcapng_option tsresol;
+    uint8_t tsresol_value; // 9: timestamps are in nanoseconds
+    uint8_t tsresol_padding[3];
+    struct pcapng_option end;
+    uint32_t trailing_length;
+} __attribute__((packed));
+
+struct pcapng_packet_header {
+    uint32_t type;
+    uint32_t length;
+    uint32_t interface_id;
+    uint32_t timestamp_high;
+    uint32_t timestamp_low;
+    uint32_t captured_length;
+    uint32_t original_length;
+} __attribute__((packed));
+
+// Follows the padded packet data
+struct pcapng_packet_trailer {
+    struct pcapng_option flags;
+    uint32_t flags_value; // The direction in the low two bits
+    struct pcapng_option end;
+    uint32_t trailing_length;
+} __attribute__((packed));
+
+static uint16_t ip_checksum(const unsigned char *header, size_t length) {
+    uint32_t sum = 0;
+    size_t i;
+    for (i=0; i+1<length; i+=2) {
+        sum += (header[i] << 8) | header[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t) ~sum;
+}
+
+// The IPv4 and UDP headers the datagram would have had on the wire
+static void fake_headers(const struct capture_record *r,
+        unsigned char *headers) {
+    uint16_t source_port = r->direction == CAPTURE_SENT ?
+            r->local_port : r->remote_port;
+    uint16_t dest_port = r->direction == CAPTURE_SENT ?
+            r->remote_port : r->local_port;
+    uint16_t ip_length = FAKE_HEADERS_SIZE + r->length;
+    uint16_t udp_length = 8 + r->length;
+
+    memset(headers, 0, FAKE_HEADERS_SIZE);
+    headers[0] = 0x45; // Version 4, 5 words of header
+    headers[2] = ip_length >> 8;
+    headers[3] = ip_length & 0xFF;
+    headers[8] = 64; // TTL
+    headers[9] = 17; // UDP
+    headers[12] = 127; // 127.0.0.1 at both ends
+    headers[15] = 1;
+    headers[16] = 127;
+    headers[19] = 1;
+    uint16_t checksum = ip_checksum(headers, 20);
+    headers[10] = checksum >> 8;
+    headers[11] = checksum & 0xFF;
+
+    headers[20] = source_port >> 8;
+    headers[21] = source_port & 0xFF;
+    headers[22] = dest_port >> 8;
+    headers[23] = dest_port & 0xFF;
+    headers[24] = udp_length >> 8;
+    headers[25] = udp_length & 0xFF;
+    // A UDP checksum of 0 means there isn't one
+}
+
+static void capture_ring_init(struct capture_ring *ring, int capacity) {
+    ring->records = calloc(capacity, sizeof(struct capture_record));
+    if (ring->records == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    ring->length = 0;
+    ring->next = 0;
+    ring->wrapped = 0;
+}
+
+void capture_init(struct capture *c, int capacity) {
+    pthread_mutex_init(&c->lock, NULL);
+    c->capacity = capacity;
+    capture_ring_init(&c->halves[0], capacity);
+    capture_ring_init(&c->halves[1], capacity);
+    c->active = &c->halves[0];
+    c->full = &c->halves[1];
+    c->overwritten = 0;
+}
+
+void capture_add(struct capture *c, enum capture_direction direction,
+        uint16_t local_port, uint16_t remote_port, const struct iovec *iov,
+        int iov_count, size_t length) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    pthread_mutex_lock(&c->lock);
+    struct capture_ring *ring = c->active;
+    if (ring->length == c->capacity && c->full->length == 0) {
+        c->active = c->full;
+        c->full = ring;
+        ring = c->active;
+    }
+    struct capture_record *r;
+    if (ring->length < c->capacity) {
+        r = &ring->records[ring->length];
+        __atomic_store_n(&ring->length, ring->length + 1, __ATOMIC_RELAXED);
+    } else {
+        // The full half hasn't been written out yet, so make room here
+        r = &ring->records[ring->next];
+        ring->next = (ring->next + 1) % c->capacity;
+        ring->wrapped = 1;
+        c->overwritten++;
+    }
+    r->time_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    r->length = length;
+    r->local_port = local_port;
+    r->remote_port = remote_port;
+    r->direction = direction;
+    size_t captured = 0;
+    int i;
+    for (i=0; i<iov_count && captured<CAPTURE_SNAPLEN; i++) {
+        size_t part = iov[i].iov_len;
+        if (part > CAPTURE_SNAPLEN - captured) {
+            part = CAPTURE_SNAPLEN - captured;
+        }
+        if (part > 0) {
+            memcpy(r->data + captured, iov[i].iov_base, part);
+        }
+        captured += part;
+    }
+    r->captured_length = captured;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static int capture_write_header(FILE *file) {
+    struct pcapng_section_header section;
+    memset(&section, 0, sizeof section);
+    section.type = PCAPNG_SECTION_HEADER;
+    section.length = sizeof section;
+    section.byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC;
+    section.major_version = 1;
+    section.minor_version = 0;
+    section.section_length = -1;
+    section.trailing_length = sizeof section;
+
+    struct pcapng_interface_description interface;
+    memset(&interface, 0, sizeof interface);
+    interface.type = PCAPNG_INTERFACE_DESCRIPTION;
+    interface.length = sizeof interface;
+    interface.linktype = PCAPNG_LINKTYPE_IPV4;
+    interface.snaplen = FAKE_HEADERS_SIZE + CAPTURE_SNAPLEN;
+    interface.tsresol.code = PCAPNG_OPT_IF_TSRESOL;
+    interface.tsresol.length = 1;
+    interface.tsresol_value = 9;
+    interface.end.code = PCAPNG_OPT_ENDOFOPT;
+    interface.trailing_length = sizeof interface;
+
+    return fwrite(&section, sizeof section, 1, file) == 1
+            && fwrite(&interface, sizeof interface, 1, file) == 1;
+}
+
+static int capture_write_record(FILE *file, const struct capture_record *r) {
+    static const char padding[4];
+    uint32_t captured = FAKE_HEADERS_SIZE + r->captured_length;
+    uint32_t padded = (captured + 3) & ~3u;
+
+    struct pcapng_packet_header header;
+    header.type = PCAPNG_ENHANCED_PACKET;
+    header.length = sizeof header + padded
+            + sizeof(struct pcapng_packet_trailer);
+    header.interface_id = 0;
+    header.timestamp_high = r->time_ns >> 32;
+    header.timestamp_low = r->time_ns & 0xFFFFFFFFu;
+    header.captured_length = captured;
+    header.original_length = FAKE_HEADERS_SIZE + r->length;
+
+    unsigned char headers[FAKE_HEADERS_SIZE];
+    fake_headers(r, headers);
+
+    struct pcapng_packet_trailer trailer;
+    memset(&trailer, 0, sizeof trailer);
+    trailer.flags.code = PCAPNG_OPT_EPB_FLAGS;
+    trailer.flags.length = sizeof trailer.flags_value;
+    trailer.flags_value = r->direction;
+    trailer.end.code = PCAPNG_OPT_ENDOFOPT;
+    trailer.trailing_length = header.length;
+
+    return fwrite(&header, sizeof header, 1, file) == 1
+            && fwrite(headers, sizeof headers, 1, file) == 1
+            && fwrite(r->data, 1, r->captured_length, file)
+                    == r->captured_length
+            && fwrite(padding, 1, padded - captured, file) == padded - captured
+            && fwrite(&trailer, sizeof trailer, 1, file) == 1;
+}
+
+// Writes a full half, oldest record first
+static int capture_write_ring(FILE *file, const struct capture_ring *ring) {
+    int start = ring->wrapped ? ring->next : 0;
+    int i;
+    for (i=0; i<ring->length; i++) {
+        if (!capture_write_record(file,
+                &ring->records[(start + i) % ring->length])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Takes the full half for writing out, or failing that whatever the active
+//  half has. Returns NULL if there is nothing to write.
+static struct capture_ring *capture_take(struct capture *c) {
+    pthread_mutex_lock(&c->lock);
+    if (c->full->length == 0 && c->active->length > 0) {
+        struct capture_ring *ring = c->active;
+        c->active = c->full;
+        c->full = ring;
+    }
+    struct capture_ring *ring = c->full->length > 0 ? c->full : NULL;
+    pthread_mutex_unlock(&c->lock);
+    return ring;
+}
+
+static void capture_release(struct capture *c, struct capture_ring *ring) {
+    pthread_mutex_lock(&c->lock);
+    ring->next = 0;
+    ring->wrapped = 0;
+    __atomic_store_n(&ring->length, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&c->lock);
+}
+
+int capture_dump(struct capture *c, const char *prefix, int index) {
+    char path[CAPTURE_PATH_LEN];
+    snprintf(path, sizeof path, "%s.%d.pcapng", prefix, index);
+    // The log formats its records later, so it gets the prefix, not path
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        LOG(LOG_WARN, "Warning: Can't write capture %s.%d.pcapng (errno %d)",
+                LOG_STR(prefix), index, errno);
+        return -1;
+    }
+    int ok = capture_write_header(file);
+    int written = 0;
+    // At most both halves: the full one, then what the active one has
+    //  gathered meanwhile
+    int pass;
+    for (pass=0; pass<2 && ok; pass++) {
+        struct capture_ring *ring = capture_take(c);
+        if (ring == NULL) {
+            break;
+        }
+        ok = capture_write_ring(file, ring);
+        written += ring->length;
+        capture_release(c, ring);
+    }
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        LOG(LOG_WARN, "Warning: Can't write capture %s.%d.pcapng (errno %d)",
+                LOG_STR(prefix), index, errno);
+        return -1;
+    }
+    return written;
+}
@@ -0,0 +1,79 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// Packet capture into a fixed-size ring in memory, written out as pcapng
+//  files that Wireshark, tcpdump and the like read. Sockets to capture on
+//  are handed the capture (rx_batch_capture, tx_queue_capture); the rest
+//  pay nothing but a NULL check.
+//
+// Datagrams are recorded with the time, whether they were received or sent,
+//  and the ports at both ends, and are truncated to CAPTURE_SNAPLEN. In the
+//  file each one is dressed up as a UDP/IPv4 packet between 127.0.0.1 ports,
+//  with the direction in the packet's flags.
+//
+// The ring has two halves. Packets go into the active half; when it fills
+//  up it becomes the full half, which capture_full reports as ready to be
+//  written out, and recording carries on in the other. capture_dump writes
+//  the full half without holding the lock, so packets keep being recorded
+//  meanwhile. If the active half fills up again before the full one has
+//  been written, the oldest packets are overwritten (and counted).
+
+#define CAPTURE_SNAPLEN 2048 // Of the datagram; the fake headers come on top
+#define CAPTURE_DEFAULT_PACKETS 4096 // Per half of the ring
+
+enum capture_direction {
+    CAPTURE_RECEIVED = 1, // As epb_flags encodes it
+    CAPTURE_SENT = 2
+};
+
+struct capture_record {
+    uint64_t time_ns; // CLOCK_REALTIME
+    uint32_t length; // Of the whole datagram
+    uint16_t local_port;
+    uint16_t remote_port;
+    uint16_t captured_length;
+    uint8_t direction;
+    char data[CAPTURE_SNAPLEN];
+};
+
+struct capture_ring {
+    struct capture_record *records;
+    int length;
+    int next; // Where the next record goes once the ring has wrapped
+    int wrapped;
+};
+
+struct capture {
+    pthread_mutex_t lock; // Packets come from any thread
+    int capacity; // Records per half
+    struct capture_ring halves[2];
+    struct capture_ring *active;
+    struct capture_ring *full; // Waiting to be written out, if not empty
+    uint64_t overwritten;
+};
+
+void capture_init(struct capture *c, int capacity);
+
+// Records one datagram, made up of iov_count parts of length bytes in all
+void capture_add(struct capture *c, enum capture_direction direction,
+        uint16_t local_port, uint16_t remote_port, const struct iovec *iov,
+        int iov_count, size_t length);
+
+// A half has filled up, so it is time to write it out. Only a hint, read
+//  without the lock.
+static inline int capture_full(struct capture *c) {
+    return __atomic_load_n(&c->full->length, __ATOMIC_RELAXED) > 0;
+}
+
+// Writes everything captured so far, oldest first, to a new pcapng file
+//  named <prefix>.<index>.pcapng and empties the ring. prefix must outlive
+//  the log's records of it. Returns the number of packets written, or -1
+//  (after saying why) if the file couldn't be written.
+int capture_dump(struct capture *c, const char *prefix, int index);
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef DATA_PACKET_H
+#define DATA_PACKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "netio.h"
+
+// DATA_PACKET format (version 1). Multi-byte fields are in network byte
+//  order:
+//      uint8  type             DATA_PACKET
+//      uint8  version          DATA_WIRE_VERSION
+//      uint8  ttl              Hops left. A router drops a packet it would
+//                               have to forward with a TTL of 1.
+//      uint8  flags            DATA_FLAG_* bits
+//      uint16 src_port         Router the packet entered the network at
+//      uint16 dest_port        Router the packet is for
+//      uint16 flow             Tells a sender's flows apart, 0 if unused
+//      uint16 payload_length
+//      payload_length bytes of payload
+// Routers rewrite only the TTL, so a packet is forwarded straight from the
+//  buffer it was received into. Fields are read with memcpy, so the buffer
+//  needs no particular alignment.
+
+#define DATA_WIRE_VERSION 1
+#define DATA_HEADER_SIZE 12
+#define DATA_DEFAULT_TTL 64
+#define DATA_PAYLOAD_MAX (MAX_DATAGRAM_SIZE - DATA_HEADER_SIZE)
+
+#define DATA_TTL_OFFSET 2
+
+// The destination acks the packet (see below)
+#define DATA_FLAG_PROBE 0x01
+// An ack of a probe, sent straight back to the load generator
+#define DATA_FLAG_ACK 0x02
+
+// A probe's payload starts with
+//      uint32 seq              Counts up from 0 for each flow
+//      uint64 send_ns          CLOCK_MONOTONIC at the load generator
+//      uint16 reply_port       Where the ack goes
+// and the destination router replies to reply_port with a DATA_FLAG_ACK
+//  packet from itself, of the same flow, whose payload is
+//      the probe's first DATA_PROBE_SIZE bytes
+//      uint64 receive_ns       CLOCK_MONOTONIC at the destination
+//      uint16 payload_length   Of the probe
+// The generator and the routers share one host, and so one clock, which
+//  makes receive_ns - send_ns the one-way latency.
+#define DATA_PROBE_SIZE 14
+#define DATA_PROBE_ACK_SIZE (DATA_PROBE_SIZE + 10)
+
+struct data_probe {
+    uint32_t seq;
+    uint64_t send_ns;
+    uint16_t reply_port;
+    uint64_t receive_ns; // Only in acks
+    uint16_t payload_length; // Only in acks
+};
+
+// A header in host byte order
+struct data_header {
+    uint8_t type;
+    uint8_t version;
+    uint8_t ttl;
+    uint8_t flags;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint16_t flow;
+    uint16_t payload_length;
+};
+
+static inline void data_put_u16(char *p, uint16_t value) {
+    value = htons(value);
+    memcpy(p, &value, sizeof value);
+}
+
+static inline uint16_t data_get_u16(const char *p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof value);
+    return ntohs(value);
+}
+
+static inline void data_header_write(char *buffer,
+        const struct data_header *h) {
+    buffer[0] = h->type;
+    buffer[1] = h->version;
+    buffer[2] = h->ttl;
+    buffer[3] = h->flags;
+    data_put_u16(buffer + 4, h->src_port);
+    data_put_u16(buffer + 6, h->dest_port);
+    data_put_u16(buffer + 8, h->flow);
+    data_put_u16(buffer + 10, h->payload_length);
+}
+
+static inline void data_put_u32(char *p, uint32_t value) {
+    value = htonl(value);
+    memcpy(p, &value, sizeof value);
+}
+
+static inline uint32_t data_get_u32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof value);
+    return ntohl(value);
+}
+
+static inline void data_put_u64(char *p, uint64_t value) {
+    data_put_u32(p, value >> 32);
+    data_put_u32(p + 4, (uint32_t) value);
+}
+
+static inline uint64_t data_get_u64(const char *p) {
+    return ((uint64_t) data_get_u32(p) << 32) | data_get_u32(p + 4);
+}
+
+// Returns 0, or -1 if the datagram is too short for its header and payload
+//  or has another version. Bytes after the payload are ignored.
+static inline int data_header_read(const char *buffer, size_t length,
+        struct data_header *h) {
+    if (length < DATA_HEADER_SIZE || buffer[1] != DATA_WIRE_VERSION) {
+        return -1;
+    }
+    h->type = buffer[0];
+    h->version = buffer[1];
+    h->ttl = buffer[2];
+    h->flags = buffer[3];
+    h->src_port = data_get_u16(buffer + 4);
+    h->dest_port = data_get_u16(buffer + 6);
+    h->flow = data_get_u16(buffer + 8);
+    h->payload_length = data_get_u16(buffer + 10);
+    if ((size_t) h->payload_length > length - DATA_HEADER_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the fields a probe carries, or with ack set, those of its ack
+static inline void data_probe_write(char *payload, const struct data_probe *p,
+        int ack) {
+    data_put_u32(payload, p->seq);
+    data_put_u64(payload + 4, p->send_ns);
+    data_put_u16(payload + 12, p->reply_port);
+    if (ack) {
+        data_put_u64(payload + DATA_PROBE_SIZE, p->receive_ns);
+        data_put_u16(payload + DATA_PROBE_SIZE + 8, p->payload_length);
+    }
+}
+
+// Returns 0, or -1 if the payload is too short for a probe (or an ack)
+static inline int data_probe_read(const char *payload, size_t length,
+        struct data_probe *p, int ack) {
+    if (length < (ack ? DATA_PROBE_ACK_SIZE : DATA_PROBE_SIZE)) {
+        return -1;
+    }
+    p->seq = data_get_u32(payload);
+    p->send_ns = data_get_u64(payload + 4);
+    p->reply_port = data_get_u16(payload + 12);
+    p->receive_ns = ack ? data_get_u64(payload + DATA_PROBE_SIZE) : 0;
+    p->payload_length = ack ? data_get_u16(payload + DATA_PROBE_SIZE + 8) : 0;
+    return 0;
+}
+
+#endif
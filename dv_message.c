@@ -0,0 +1,282 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "dv_message.h"
+
+static size_t put_varint(char *p, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        p[n++] = (char) ((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (char) value;
+    return n;
+}
+
+// Returns the number of bytes read, or 0 if the varint is truncated or
+//  longer than 5 bytes
+static size_t get_varint(const char *p, size_t length, uint32_t *value) {
+    uint32_t v = 0;
+    size_t n;
+    for (n=0; n<length && n<5; n++) {
+        uint8_t byte = (uint8_t) p[n];
+        v |= (uint32_t) (byte & 0x7F) << (7*n);
+        if ((byte & 0x80) == 0) {
+            *value = v;
+            return n+1;
+        }
+    }
+    return 0;
+}
+
+// Encodes one entry, whose port follows previous_port, into encoded
+static size_t put_entry(char *encoded, const struct dv_entry *e,
+        const struct dv_run *run, uint16_t previous_port) {
+    uint32_t port_delta = e->dest_port - previous_port;
+    if (run == NULL) {
+        size_t n = put_varint(encoded, port_delta);
+        return n + put_varint(encoded + n, e->cost);
+    }
+    size_t n = put_varint(encoded, port_delta << 1 | (run->length > 0));
+    n += put_varint(encoded + n, e->cost);
+    if (run->length > 0) {
+        n += put_varint(encoded + n, run->length);
+        // Zigzag, so small steps either way take one byte
+        n += put_varint(encoded + n, (uint32_t) run->step << 1
+                ^ (uint32_t) (run->step >> 31));
+    }
+    return n;
+}
+
+int dv_message_encode(struct dv_message *m, char *buffer,
+        const struct dv_entry *entries, const struct dv_run *runs, int count,
+        size_t max_body_length) {
+    m->version = runs != NULL ? DV_WIRE_VERSION_RANGES : DV_WIRE_VERSION;
+    m->body = buffer;
+    m->fragment_count = 1;
+    m->fragment_end[0] = 0;
+    m->entry_count[0] = 0;
+    size_t used = 0;
+    size_t fragment_start = 0;
+    uint16_t previous_port = 0;
+    int i;
+    for (i=0; i<count; i++) {
+        char encoded[DV_RANGE_MAX_ENCODED];
+        int f = m->fragment_count - 1;
+        const struct dv_run *run = runs != NULL ? &runs[i] : NULL;
+        size_t n = put_entry(encoded, &entries[i], run, previous_port);
+        if (used + n - fragment_start > max_body_length ||
+                m->entry_count[f] == UINT16_MAX) {
+            if (m->fragment_count == DV_FRAGMENT_MAX) {
+                break;
+            }
+            // Start a new fragment; port deltas start over from 0
+            m->fragment_count++;
+            f++;
+            fragment_start = used;
+            m->entry_count[f] = 0;
+            n = put_entry(encoded, &entries[i], run, 0);
+        }
+        memcpy(buffer + used, encoded, n);
+        used += n;
+        m->fragment_end[f] = used;
+        m->entry_count[f]++;
+        previous_port = entries[i].dest_port + (run != NULL ? run->length : 0);
+    }
+    return i;
+}
+
+void dv_message_header(const struct dv_message *m, int i, uint8_t type,
+        uint32_t seq, struct dv_header *header) {
+    size_t body_length;
+    dv_message_fragment(m, i, &body_length);
+    header->type = type;
+    header->version = m->version;
+    header->fragment = (uint8_t) i;
+    header->fragment_count = (uint8_t) m->fragment_count;
+    header->seq = htonl(seq);
+    header->entry_count = htons(m->entry_count[i]);
+    header->body_length = htons((uint16_t) body_length);
+}
+
+void dv_reassembly_init(struct dv_reassembly *r) {
+    r->type = 0;
+    r->seq = 0;
+    r->fragment_count = 0;
+    r->received_count = 0;
+    dv_init(&r->entries);
+}
+
+void dv_reassembly_free(struct dv_reassembly *r) {
+    dv_free(&r->entries);
+    dv_reassembly_init(r);
+}
+
+static void dv_reassembly_start(struct dv_reassembly *r, uint8_t type,
+        uint32_t seq, int fragment_count) {
+    r->type = type;
+    r->seq = seq;
+    r->fragment_count = fragment_count;
+    r->received_count = 0;
+    memset(r->received, 0, sizeof r->received);
+    dv_clear(&r->entries);
+}
+
+static int dv_reassembly_add_v0(struct dv_reassembly *r, const char *datagram,
+        size_t length) {
+    if (length < DV_HEADER_V0_SIZE ||
+            (length - DV_HEADER_V0_SIZE) % sizeof(struct dv_entry) != 0) {
+        return -1;
+    }
+    uint32_t seq;
+    memcpy(&seq, datagram + 4, sizeof seq);
+    dv_reassembly_start(r, (uint8_t) datagram[0], ntohl(seq), 1);
+    const char *p = datagram + DV_HEADER_V0_SIZE;
+    for (; p < datagram + length; p += sizeof(struct dv_entry)) {
+        struct dv_entry raw, received;
+        memcpy(&raw, p, sizeof raw);
+        ntoh_dv_entry(&raw, &received);
+        if (received.dest_port == DV_EMPTY_PORT) {
+            continue;
+        }
+        *dv_insert(&r->entries, received.dest_port) = received;
+    }
+    r->fragment_count = 0; // Nothing left in progress
+    return 1;
+}
+
+// Reads one entry of a version 2 body, or of a version 3 one if ranges.
+// Returns the number of bytes read, or 0 if the entry is truncated.
+static size_t get_entry(const char *p, size_t length, int ranges,
+        uint32_t *port_delta, uint32_t *cost, uint32_t *run, int64_t *step) {
+    size_t n = get_varint(p, length, port_delta);
+    if (n == 0) {
+        return 0;
+    }
+    size_t m = get_varint(p + n, length - n, cost);
+    if (m == 0) {
+        return 0;
+    }
+    n += m;
+    *run = 0;
+    *step = 0;
+    if (ranges) {
+        int has_run = *port_delta & 1;
+        *port_delta >>= 1;
+        if (has_run) {
+            uint32_t zigzag;
+            m = get_varint(p + n, length - n, run);
+            if (m == 0) {
+                return 0;
+            }
+            n += m;
+            m = get_varint(p + n, length - n, &zigzag);
+            if (m == 0) {
+                return 0;
+            }
+            n += m;
+            *step = (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+        }
+    }
+    return n;
+}
+
+// Returns 1 if the datagram's version byte says version 2 or 3
+static int is_dv_versioned(const char *datagram, size_t length) {
+    return length >= 2 && ((uint8_t) datagram[1] == DV_WIRE_VERSION
+            || (uint8_t) datagram[1] == DV_WIRE_VERSION_RANGES);
+}
+
+// Returns 1 if the datagram starts with a header that agrees with itself and
+//  with the datagram's length
+static int has_dv_header(const char *datagram, size_t length,
+        struct dv_header *header) {
+    if (length < sizeof *header) {
+        return 0;
+    }
+    memcpy(header, datagram, sizeof *header);
+    return header->fragment_count > 0 &&
+            header->fragment < header->fragment_count &&
+            ntohs(header->body_length) == length - sizeof *header;
+}
+
+int dv_reassembly_add(struct dv_reassembly *r, const char *datagram,
+        size_t length) {
+    if (!is_dv_versioned(datagram, length)) {
+        // Version 0 senders left the version byte uninitialized, so anything
+        //  else is taken for version 0 if it is laid out like it
+        return dv_reassembly_add_v0(r, datagram, length);
+    }
+    struct dv_header header;
+    if (!has_dv_header(datagram, length, &header)) {
+        // Most likely a damaged version 2 or 3 fragment, whose entries must
+        //  not be read as version 0 ones
+        return -1;
+    }
+    uint32_t seq = ntohl(header.seq);
+    const char *body = datagram + sizeof header;
+    size_t body_length = length - sizeof header;
+    int ranges = header.version == DV_WIRE_VERSION_RANGES;
+    if (r->fragment_count == 0 || r->type != header.type || r->seq != seq ||
+            r->fragment_count != header.fragment_count) {
+        dv_reassembly_start(r, header.type, seq, header.fragment_count);
+    }
+    uint8_t bit = 1 << (header.fragment % 8);
+    if (r->received[header.fragment / 8] & bit) {
+        return 0; // Duplicate
+    }
+
+    // Check the whole body before decoding any of it, so that a malformed
+    //  fragment leaves nothing behind
+    int entry_count = ntohs(header.entry_count);
+    uint32_t port = 0;
+    size_t offset = 0;
+    int i;
+    for (i=0; i<entry_count; i++) {
+        uint32_t port_delta, cost, run;
+        int64_t step;
+        size_t n = get_entry(body + offset, body_length - offset, ranges,
+                &port_delta, &cost, &run, &step);
+        if (n == 0) {
+            return -1;
+        }
+        offset += n;
+        if (port_delta == 0 || port_delta > UINT16_MAX - port
+                || run > UINT16_MAX - port - port_delta) {
+            return -1; // Ports must be strictly increasing
+        }
+        int64_t last_cost = cost + step * run;
+        if (last_cost < 0 || last_cost > UINT32_MAX) {
+            return -1;
+        }
+        port += port_delta + run;
+    }
+    if (offset != body_length) {
+        return -1;
+    }
+    port = 0;
+    offset = 0;
+    for (i=0; i<entry_count; i++) {
+        uint32_t port_delta = 0, cost = 0, run = 0; // Validated above
+        int64_t step = 0;
+        offset += get_entry(body + offset, body_length - offset, ranges,
+                &port_delta, &cost, &run, &step);
+        port += port_delta;
+        uint32_t k;
+        for (k=0; k<=run; k++) {
+            struct dv_entry *e = dv_insert(&r->entries,
+                    (uint16_t) (port + k));
+            e->first_hop_port = 0;
+            e->cost = (uint32_t) (cost + step * k);
+        }
+        port += run;
+    }
+
+    r->received[header.fragment / 8] |= bit;
+    r->received_count++;
+    if (r->received_count < r->fragment_count) {
+        return 0;
+    }
+    r->fragment_count = 0; // Nothing left in progress
+    return 1;
+}
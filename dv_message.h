@@ -0,0 +1,131 @@
+#ifndef DV_MESSAGE_H
+#define DV_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dv_table.h"
+
+// DV message wire format, version 2 (or 3, with ranges).
+// A DV message is sent as 1 to DV_FRAGMENT_MAX datagrams (fragments), each
+//  made of a header and a body:
+//
+// 1 byte packet type (DV_PACKET, INITIAL_DV_PACKET or DV_DELTA_PACKET)
+// 1 byte format version (DV_WIRE_VERSION)
+// 1 byte index of this fragment
+// 1 byte number of fragments in the message
+// 4 byte sequence number of the message (the same in every fragment)
+// 2 byte number of entries in this fragment
+// 2 byte length of the body
+// body: the entries, sorted by destination port, each encoded as
+//      varint  destination port minus the previous entry's (or 0)
+//      varint  cost
+//  where a varint is 7 bits per byte, low bits first, with the top bit set
+//  on all bytes but the last. First hops aren't sent; receivers never
+//  use them.
+//
+// Version 3 bodies can cover a range of consecutive destination ports with
+//  one entry, as long as their costs go up (or down) by the same step from
+//  each port to the next:
+//      varint  destination port minus the previous entry's last port (or
+//              0), shifted left by 1, with the low bit set if a run follows
+//      varint  cost of the first port
+//      varint  run: how many more ports the entry covers   } if the bit
+//      varint  step, zigzag encoded (0, -1, 1, -2, ...)    }  is set
+//  Receivers expand ranges into one entry per destination, so nothing but
+//  the size of the message changes. Senders only use version 3 when they
+//  aggregate, and only to neighbors that have said they decode it (see
+//  DV_VERSION_PACKET in router.h); the rest still get version 2.
+//
+// Every fragment can be decoded by itself. A message is only acted on once
+//  all its fragments have arrived, so that a full DV is never applied half.
+//
+// Version 0 messages, which had padding where the version is, carried a
+//  single datagram of 8 byte struct dv_entry's in network byte order after
+//  the first 8 bytes of the header. They are still accepted. Their padding
+//  was never initialized, so a datagram whose version byte isn't 2 or 3 is
+//  decoded as version 0 if its length fits. One whose version byte is 2 or
+//  3 but whose fragment or body length fields don't agree with it is
+//  rejected, not read as version 0; the odd version 0 message whose padding
+//  happened to hold a 2 or a 3 is lost, and the next refresh makes up for
+//  it.
+
+#define DV_WIRE_VERSION 2
+#define DV_WIRE_VERSION_RANGES 3
+#define DV_FRAGMENT_MAX 255
+#define DV_ENTRY_MAX_ENCODED 8 // 3 byte port delta + 5 byte cost
+#define DV_RANGE_MAX_ENCODED 16 // Plus a 3 byte run and a 5 byte step
+
+struct dv_header {
+    uint8_t type;
+    uint8_t version;
+    uint8_t fragment;
+    uint8_t fragment_count;
+    uint32_t seq;
+    uint16_t entry_count;
+    uint16_t body_length;
+};
+
+#define DV_HEADER_V0_SIZE 8
+
+// Consecutive ports after an entry's own that it also covers
+struct dv_run {
+    uint16_t length; // 0 for just the entry's own port
+    int32_t step; // Cost of each port minus the one before's
+};
+
+// An encoded message: the bodies of all its fragments, back to back
+struct dv_message {
+    uint8_t version;
+    char *body;
+    int fragment_count;
+    size_t fragment_end[DV_FRAGMENT_MAX]; // Offset just past each body
+    uint16_t entry_count[DV_FRAGMENT_MAX];
+};
+
+// Encodes entries, which must be sorted by destination port, into buffer,
+//  which must have room for count * DV_ENTRY_MAX_ENCODED bytes. No fragment
+//  body gets longer than max_body_length. Entries that don't fit in
+//  DV_FRAGMENT_MAX fragments are left out.
+// With runs (else NULL), entry i also covers the runs[i].length ports after
+//  its own, which must not reach the next entry, and the message is version
+//  3; buffer then needs count * DV_RANGE_MAX_ENCODED bytes.
+// Returns the number of entries encoded.
+int dv_message_encode(struct dv_message *m, char *buffer,
+        const struct dv_entry *entries, const struct dv_run *runs, int count,
+        size_t max_body_length);
+
+// Fills in the header of fragment i for sending
+void dv_message_header(const struct dv_message *m, int i, uint8_t type,
+        uint32_t seq, struct dv_header *header);
+
+static inline const char *dv_message_fragment(const struct dv_message *m,
+        int i, size_t *length) {
+    size_t start = i == 0 ? 0 : m->fragment_end[i-1];
+    *length = m->fragment_end[i] - start;
+    return m->body + start;
+}
+
+// Collects the fragments of the message currently being received from one
+//  neighbor
+struct dv_reassembly {
+    uint8_t type;
+    uint32_t seq;
+    int fragment_count; // 0 if no message is in progress
+    int received_count;
+    uint8_t received[(DV_FRAGMENT_MAX + 7) / 8];
+    struct dv_table entries; // Decoded so far, in host byte order
+};
+
+void dv_reassembly_init(struct dv_reassembly *r);
+void dv_reassembly_free(struct dv_reassembly *r);
+
+// Adds a received datagram (header included). A fragment of a different
+//  message than the one in progress abandons it.
+// Returns 1 if the message is now complete, in which case r->type, r->seq
+//  and r->entries describe it until the next call; 0 if more fragments are
+//  needed; or -1 if the datagram is malformed.
+int dv_reassembly_add(struct dv_reassembly *r, const char *datagram,
+        size_t length);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "dv_table.h"
+
+#define DV_INITIAL_BITS 4 // Start with 16 slots
+
+void ntoh_dv_entry(struct dv_entry *n, struct dv_entry *h) {
+    h->dest_port = ntohs(n->dest_port);
+    h->first_hop_port = ntohs(n->first_hop_port);
+    h->cost = ntohl(n->cost);
+}
+void hton_dv_entry(struct dv_entry *h, struct dv_entry *n) {
+    n->dest_port = htons(h->dest_port);
+    n->first_hop_port = htons(h->first_hop_port);
+    n->cost = htonl(h->cost);
+}
+
+// Fibonacci hashing: ports are often consecutive, so spread them out
+static inline int dv_home_slot(const struct dv_table *dv, uint16_t port) {
+    return (int) (((uint32_t) port * 2654435761u) >> (32 - dv->bits));
+}
+
+static void dv_alloc_slots(struct dv_table *dv, int bits) {
+    dv->bits = bits;
+    dv->capacity = 1 << bits;
+    dv->slots = calloc(dv->capacity, sizeof(struct dv_entry));
+    if (dv->slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+void dv_init(struct dv_table *dv) {
+    dv->slots = NULL;
+    dv->capacity = 0;
+    dv->bits = 0;
+    dv->length = 0;
+}
+
+void dv_free(struct dv_table *dv) {
+    free(dv->slots);
+    dv_init(dv);
+}
+
+void dv_clear(struct dv_table *dv) {
+    if (dv->slots != NULL) {
+        memset(dv->slots, 0, dv->capacity * sizeof(struct dv_entry));
+    }
+    dv->length = 0;
+}
+
+struct dv_entry *dv_find(struct dv_table *dv, uint16_t dest_port) {
+    if (dv->length == 0) {
+        return NULL;
+    }
+    int mask = dv->capacity - 1;
+    int i = dv_home_slot(dv, dest_port);
+    for (; dv_slot_used(&dv->slots[i]); i = (i+1) & mask) {
+        if (dv->slots[i].dest_port == dest_port) {
+            return &(dv->slots[i]);
+        }
+    }
+    return NULL;
+}
+
+static void dv_grow(struct dv_table *dv) {
+    struct dv_entry *old_slots = dv->slots;
+    int old_capacity = dv->capacity;
+    dv_alloc_slots(dv, old_slots == NULL ? DV_INITIAL_BITS : dv->bits + 1);
+
+    int mask = dv->capacity - 1;
+    int i;
+    for (i=0; i<old_capacity; i++) {
+        if (dv_slot_used(&old_slots[i])) {
+            int j = dv_home_slot(dv, old_slots[i].dest_port);
+            while (dv_slot_used(&dv->slots[j])) {
+                j = (j+1) & mask;
+            }
+            dv->slots[j] = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+struct dv_entry *dv_insert(struct dv_table *dv, uint16_t dest_port) {
+    struct dv_entry *e = dv_find(dv, dest_port);
+    if (e != NULL) {
+        return e;
+    }
+    // Keep the load factor at or below 3/4
+    if ((dv->length+1)*4 > dv->capacity*3) {
+        dv_grow(dv);
+    }
+    int mask = dv->capacity - 1;
+    int i = dv_home_slot(dv, dest_port);
+    while (dv_slot_used(&dv->slots[i])) {
+        i = (i+1) & mask;
+    }
+    e = &(dv->slots[i]);
+    e->dest_port = dest_port;
+    e->first_hop_port = 0;
+    e->cost = 0;
+    dv->length++;
+    return e;
+}
+
+// Empty slot i and shift later members of its probe cluster back so that
+//  every entry stays reachable from its home slot
+static void dv_remove_slot(struct dv_table *dv, int i) {
+    int mask = dv->capacity - 1;
+    int j = i;
+    while (1) {
+        j = (j+1) & mask;
+        if (!dv_slot_used(&dv->slots[j])) {
+            break;
+        }
+        int k = dv_home_slot(dv, dv->slots[j].dest_port);
+        // The entry at j may move to i only if its home slot is not
+        //  cyclically within (i, j]
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            dv->slots[i] = dv->slots[j];
+            i = j;
+        }
+    }
+    dv->slots[i].dest_port = DV_EMPTY_PORT;
+    dv->length--;
+}
+
+int dv_remove(struct dv_table *dv, uint16_t dest_port) {
+    struct dv_entry *e = dv_find(dv, dest_port);
+    if (e == NULL) {
+        return 0;
+    }
+    dv_remove_slot(dv, (int) (e - dv->slots));
+    return 1;
+}
+
+int dv_purge(struct dv_table *dv, uint32_t min_cost) {
+    if (dv->length == 0) {
+        return 0;
+    }
+    // Start scanning just past an empty slot. Backward shifting never moves
+    //  an entry across an empty slot, so entries only move into slots we
+    //  have yet to (re)examine.
+    int mask = dv->capacity - 1;
+    int start = 0;
+    while (dv_slot_used(&dv->slots[start])) {
+        start++;
+    }
+    int removed = 0;
+    int n = 1;
+    while (n <= dv->capacity) {
+        int i = (start + n) & mask;
+        if (dv_slot_used(&dv->slots[i]) && dv->slots[i].cost >= min_cost) {
+            dv_remove_slot(dv, i);
+            removed++;
+            // Slot i may now hold a shifted entry; look at it again
+        } else {
+            n++;
+        }
+    }
+    return removed;
+}
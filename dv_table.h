@@ -0,0 +1,50 @@
+#ifndef DV_TABLE_H
+#define DV_TABLE_H
+
+#include <stdint.h>
+
+struct dv_entry {
+    uint16_t dest_port;
+    uint16_t first_hop_port;
+    uint32_t cost;
+};
+void ntoh_dv_entry(struct dv_entry *n, struct dv_entry *h);
+void hton_dv_entry(struct dv_entry *h, struct dv_entry *n);
+
+// Port 0 is never a valid destination, so it marks an empty slot
+#define DV_EMPTY_PORT 0
+
+// Open-addressing (linear probing) hash table of DV entries, keyed by
+//  destination port. Grows as needed; there is no fixed capacity.
+// Deletion uses backward shifting, so there are no tombstones, but pointers
+//  returned by dv_find/dv_insert are only valid until the next insert or
+//  remove.
+struct dv_table {
+    struct dv_entry *slots;
+    int capacity; // Always a power of two
+    int bits; // log2(capacity)
+    int length; // Number of entries in use
+};
+
+void dv_init(struct dv_table *dv);
+void dv_free(struct dv_table *dv);
+void dv_clear(struct dv_table *dv);
+
+struct dv_entry *dv_find(struct dv_table *dv, uint16_t dest_port);
+
+// Returns the entry for dest_port, creating it (with first hop and cost
+//  zeroed) if it doesn't exist yet
+struct dv_entry *dv_insert(struct dv_table *dv, uint16_t dest_port);
+
+// Returns 1 if an entry was removed, 0 if there was none
+int dv_remove(struct dv_table *dv, uint16_t dest_port);
+
+// Removes every entry whose cost is at least min_cost.
+// Returns the number of entries removed.
+int dv_purge(struct dv_table *dv, uint32_t min_cost);
+
+static inline int dv_slot_used(const struct dv_entry *slot) {
+    return slot->dest_port != DV_EMPTY_PORT;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "event_loop.h"
+
+#define EVENT_LOOP_MAX_EVENTS 16 // Ready sources handled per epoll_wait
+
+void event_loop_init(struct event_loop *loop) {
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        perror("Error creating epoll instance");
+        exit(1);
+    }
+    loop->running = 0;
+}
+
+void event_loop_add(struct event_loop *loop, struct event_source *source,
+        int fd, uint32_t events, event_handler handler, void *arg) {
+    source->fd = fd;
+    source->handler = handler;
+    source->arg = arg;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = source;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("Error adding event source");
+        exit(1);
+    }
+}
+
+void event_loop_remove(struct event_loop *loop, struct event_source *source) {
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL) < 0) {
+        perror("Error removing event source");
+    }
+}
+
+void event_loop_run(struct event_loop *loop) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    loop->running = 1;
+    while (loop->running) {
+        int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS,
+                -1);
+        if (count < 0) {
+            if (errno != EINTR) {
+                perror("Error waiting for events");
+            }
+            continue;
+        }
+        int i;
+        for (i=0; i<count && loop->running; i++) {
+            struct event_source *source = events[i].data.ptr;
+            source->handler(source, events[i].events);
+        }
+    }
+}
+
+void event_loop_stop(struct event_loop *loop) {
+    loop->running = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Timers
+
+static void event_timer_ready(struct event_source *source, uint32_t events) {
+    (void) events;
+    struct event_timer *timer = (struct event_timer *) source;
+    uint64_t expirations;
+    // Fails with EAGAIN if the timer was re-armed since it became readable
+    if (read(source->fd, &expirations, sizeof expirations) < 0) {
+        return;
+    }
+    timer->callback(timer->arg);
+}
+
+void event_timer_init(struct event_loop *loop, struct event_timer *timer,
+        void (*callback)(void *arg), void *arg) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Error creating timer");
+        exit(1);
+    }
+    timer->callback = callback;
+    timer->arg = arg;
+    event_loop_add(loop, &timer->source, fd, EPOLLIN, event_timer_ready,
+            timer);
+}
+
+static struct timespec ms_to_timespec(uint64_t ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    return ts;
+}
+
+void event_timer_arm(struct event_timer *timer, uint64_t delay_ms,
+        uint64_t interval_ms) {
+    struct itimerspec spec;
+    spec.it_value = ms_to_timespec(delay_ms);
+    if (delay_ms == 0) {
+        spec.it_value.tv_nsec = 1; // A zero it_value would disarm the timer
+    }
+    spec.it_interval = ms_to_timespec(interval_ms);
+    if (timerfd_settime(timer->source.fd, 0, &spec, NULL) < 0) {
+        perror("Error arming timer");
+    }
+}
+
+void event_timer_disarm(struct event_timer *timer) {
+    struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+    if (timerfd_settime(timer->source.fd, 0, &spec, NULL) < 0) {
+        perror("Error disarming timer");
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Signals
+
+static void event_signals_ready(struct event_source *source, uint32_t events) {
+    (void) events;
+    struct event_signals *sigs = (struct event_signals *) source;
+    struct signalfd_siginfo info;
+    while (read(source->fd, &info, sizeof info) == sizeof info) {
+        sigs->callback(sigs->arg, (int) info.ssi_signo);
+    }
+}
+
+void event_signals_init(struct event_loop *loop, struct event_signals *sigs,
+        const int *signals, int signal_count,
+        void (*callback)(void *arg, int sig), void *arg) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    int i;
+    for (i=0; i<signal_count; i++) {
+        sigaddset(&mask, signals[i]);
+    }
+    // Threads started later inherit the mask, so the signals can only ever
+    //  be picked up through the signalfd
+    int err = pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    if (err != 0) {
+        fprintf(stderr, "Error blocking signals\n");
+        exit(1);
+    }
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Error creating signalfd");
+        exit(1);
+    }
+    sigs->callback = callback;
+    sigs->arg = arg;
+    event_loop_add(loop, &sigs->source, fd, EPOLLIN, event_signals_ready,
+            sigs);
+}
@@ -0,0 +1,68 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// Single-threaded event loop on epoll. Sockets, timers (timerfd) and
+//  signals (signalfd) are all file descriptors, so one epoll_wait covers
+//  every kind of event and handlers never run in signal context.
+// Sources are owned by the caller and must stay put while registered.
+// Errors while setting anything up are fatal.
+
+struct event_source;
+typedef void (*event_handler)(struct event_source *source, uint32_t events);
+
+struct event_source {
+    int fd;
+    event_handler handler;
+    void *arg;
+};
+
+struct event_loop {
+    int epoll_fd;
+    int running;
+};
+
+// Fires after a delay, then optionally every interval
+struct event_timer {
+    struct event_source source; // Must be first
+    void (*callback)(void *arg);
+    void *arg;
+};
+
+// Delivers the given signals, which are blocked for normal delivery
+struct event_signals {
+    struct event_source source; // Must be first
+    void (*callback)(void *arg, int sig);
+    void *arg;
+};
+
+void event_loop_init(struct event_loop *loop);
+
+// Watches fd for events (EPOLLIN etc.), calling handler when any occur
+void event_loop_add(struct event_loop *loop, struct event_source *source,
+        int fd, uint32_t events, event_handler handler, void *arg);
+void event_loop_remove(struct event_loop *loop, struct event_source *source);
+
+// Handles events until event_loop_stop is called from a handler
+void event_loop_run(struct event_loop *loop);
+void event_loop_stop(struct event_loop *loop);
+
+// The timer starts out disarmed
+void event_timer_init(struct event_loop *loop, struct event_timer *timer,
+        void (*callback)(void *arg), void *arg);
+
+// (Re)arms the timer to fire in delay_ms (0 means as soon as possible) and,
+//  if interval_ms isn't 0, every interval_ms after that
+void event_timer_arm(struct event_timer *timer, uint64_t delay_ms,
+        uint64_t interval_ms);
+void event_timer_disarm(struct event_timer *timer);
+
+// Blocks the signals in the calling thread, so this must be called before
+//  any other thread is started for the process-wide signals to arrive here
+void event_signals_init(struct event_loop *loop, struct event_signals *sigs,
+        const int *signals, int signal_count,
+        void (*callback)(void *arg, int sig), void *arg);
+
+#endif
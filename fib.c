@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fib.h"
+
+static struct fib *fib_alloc(struct fib *fib, int group_capacity) {
+    fib = realloc(fib, sizeof(struct fib)
+            + group_capacity * sizeof(struct fib_group));
+    if (fib == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    fib->group_capacity = group_capacity;
+    return fib;
+}
+
+struct fib *fib_new(uint32_t generation, uint32_t hash_seed) {
+    struct fib *fib = fib_alloc(NULL, 0);
+    fib->generation = generation;
+    fib->hash_seed = hash_seed;
+    memset(fib->next_hop, 0, sizeof fib->next_hop);
+    memset(fib->multipath, 0, sizeof fib->multipath);
+    fib->group_count = 0;
+    return fib;
+}
+
+void fib_set(struct fib **fib, uint16_t dest_port, const uint16_t *next_hops,
+        int count) {
+    struct fib *f = *fib;
+    uint64_t bit = (uint64_t) 1 << (dest_port & 63);
+    if (count <= 1) {
+        f->next_hop[dest_port] = count == 1 ? next_hops[0] : FIB_NO_ROUTE;
+        f->multipath[dest_port >> 6] &= ~bit;
+        return;
+    }
+    if (f->group_count == f->group_capacity) {
+        *fib = f = fib_alloc(f, f->group_capacity == 0 ?
+                16 : 2*f->group_capacity);
+    }
+    struct fib_group *g = &(f->groups[f->group_count]);
+    g->count = count < FIB_MAX_PATHS ? count : FIB_MAX_PATHS;
+    memcpy(g->next_hop, next_hops, g->count * sizeof(uint16_t));
+    f->next_hop[dest_port] = f->group_count++;
+    f->multipath[dest_port >> 6] |= bit;
+}
+
+void fib_publish(_Atomic(struct fib *) *slot, struct fib *fib,
+        struct qsbr *qsbr) {
+    struct fib *old = atomic_exchange(slot, fib);
+    if (old != NULL) {
+        qsbr_retire(qsbr, old);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FIB_H
+#define FIB_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "qsbr.h"
+
+// Marks a destination with no route in the FIB
+#define FIB_NO_ROUTE 0
+
+// Most next hops a destination can be spread over
+#define FIB_MAX_PATHS 8
+
+// Equal-cost next hops of one destination, in port order
+struct fib_group {
+    int count;
+    uint16_t next_hop[FIB_MAX_PATHS];
+};
+
+// Forwarding table: an immutable snapshot of my_dv, compiled for the data
+//  path. Indexed directly by the 16-bit destination port, so a lookup is a
+//  single array load no matter how large the DV gets.
+// A destination with several equal-cost next hops has its bit set in
+//  multipath, and its next_hop entry is the index of its group instead.
+//  Packets are spread over a group by a hash of their flow, so the packets
+//  of one flow all take the same path and stay in order.
+// A FIB is never modified once published; changes to the DV produce a new
+//  generation which replaces the old one with one atomic pointer store.
+struct fib {
+    uint32_t generation;
+    uint32_t hash_seed; // Differs between routers, so that each router
+                        //  splits the flows another way
+    uint16_t next_hop[UINT16_MAX + 1]; // FIB_NO_ROUTE if unreachable
+    uint64_t multipath[(UINT16_MAX + 1) / 64];
+    int group_count;
+    int group_capacity;
+    struct fib_group groups[];
+};
+
+// An empty FIB, to be filled in with fib_set before it is published
+struct fib *fib_new(uint32_t generation, uint32_t hash_seed);
+
+// Routes dest_port over count next hops (at most FIB_MAX_PATHS), or none if
+//  count is 0. May move the FIB, hence the double pointer.
+void fib_set(struct fib **fib, uint16_t dest_port, const uint16_t *next_hops,
+        int count);
+
+// Atomically replaces the FIB in *slot with fib. The previous generation is
+//  retired through qsbr and freed once no data plane thread can be using it.
+void fib_publish(_Atomic(struct fib *) *slot, struct fib *fib,
+        struct qsbr *qsbr);
+
+static inline struct fib *fib_current(_Atomic(struct fib *) *slot) {
+    return atomic_load_explicit(slot, memory_order_acquire);
+}
+
+static inline uint32_t fib_flow_hash(uint32_t seed, uint16_t src_port,
+        uint16_t dest_port, uint16_t flow) {
+    // The murmur3 finalizer
+    uint64_t h = ((uint64_t) src_port << 32 | (uint32_t) dest_port << 16
+            | flow) ^ seed;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (uint32_t) h;
+}
+
+// Next hop for a packet of the given flow, which only needs hashing if
+//  there is more than one
+static inline uint16_t fib_lookup(const struct fib *fib, uint16_t src_port,
+        uint16_t dest_port, uint16_t flow) {
+    uint16_t next_hop = fib->next_hop[dest_port];
+    if (!(fib->multipath[dest_port >> 6] >> (dest_port & 63) & 1)) {
+        return next_hop;
+    }
+    const struct fib_group *g = &(fib->groups[next_hop]);
+    uint32_t hash = fib_flow_hash(fib->hash_seed, src_port, dest_port, flow);
+    return g->next_hop[(uint64_t) hash * g->count >> 32];
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "forward.h"
+#include "data_packet.h"
+#include "logger.h"
+
+void forward_update_fib(struct forward_node *node, struct router *r,
+        int max_paths, struct qsbr *qsbr) {
+    node->fib_generation++;
+    struct fib *fib = fib_new(node->fib_generation, node->port);
+    struct dv_table *dv = &r->dv;
+    uint16_t next_hops[FIB_MAX_PATHS];
+    int i;
+    for (i=0; i<dv->capacity; i++) {
+        struct dv_entry *e = &(dv->slots[i]);
+        if (dv_slot_used(e) && e->cost < MAX_POSSIBLE_COST) {
+            fib_set(&fib, e->dest_port, next_hops, router_next_hops(
+                    r, e, next_hops, max_paths));
+        }
+    }
+    fib_publish(&node->fib, fib, qsbr);
+}
+
+// Answers a load generator's probe that has reached this router (see
+//  data_packet.h). The ack goes straight back, not through the network.
+// Returns 0, or -1 if the probe is too short to ack
+static int ack_probe(struct forward_node *node,
+        const struct data_header *probe_header, const char *payload,
+        struct tx_queue *tx) {
+    struct data_probe probe;
+    if (data_probe_read(payload, probe_header->payload_length, &probe, 0)
+            < 0) {
+        LOG(LOG_WARN, "Dropping probe too short to ack");
+        return -1;
+    }
+    probe.receive_ns = metrics_now_ns();
+    probe.payload_length = probe_header->payload_length;
+
+    struct data_header header = {
+        .type = DATA_PACKET,
+        .version = DATA_WIRE_VERSION,
+        .ttl = 1,
+        .flags = DATA_FLAG_ACK,
+        .src_port = node->port,
+        .dest_port = probe.reply_port,
+        .flow = probe_header->flow,
+        .payload_length = DATA_PROBE_ACK_SIZE,
+    };
+    char ack[DATA_HEADER_SIZE + DATA_PROBE_ACK_SIZE];
+    data_header_write(ack, &header);
+    data_probe_write(ack + DATA_HEADER_SIZE, &probe, 1);
+    tx_queue_add(tx, ack, sizeof ack, probe.reply_port);
+    return 0;
+}
+
+void forward_data_packet(struct forward_node *node, uint16_t sender_port,
+        char *buffer, size_t length, struct tx_queue *tx, struct metrics *m) {
+    struct data_header header;
+    if (data_header_read(buffer, length, &header) < 0) {
+        metrics_count(m, METRIC_DROPPED_MALFORMED);
+        LOG(LOG_WARN, "Dropping malformed data packet (%u bytes) from port %u",
+                (unsigned) length, sender_port);
+        return;
+    }
+
+    LOG_FILE(node->log_file, LOG_INFO,
+            "Timestamp %T sourceID %u destID %u arrivalPort %u prevPort %u"
+            " length %u", header.src_port, header.dest_port, node->port,
+            sender_port, header.payload_length);
+
+    //check if we are at at the destined router
+    if (header.dest_port != node->port) {
+        if (header.ttl <= 1) {
+            metrics_count(m, METRIC_DROPPED_TTL);
+            LOG(LOG_WARN, "TTL expired for data packet from %u to %u",
+                    header.src_port, header.dest_port);
+            return;
+        }
+        uint16_t next_port = fib_lookup(fib_current(&node->fib),
+                header.src_port, header.dest_port, header.flow);
+        if (next_port == FIB_NO_ROUTE) {
+            metrics_count(m, METRIC_UNROUTABLE);
+            LOG(LOG_WARN, "DV entry not found for destination port %u",
+                    header.dest_port);
+            return;
+        }
+
+        LOG_FILE(node->log_file, LOG_INFO, "next port %u", next_port);
+
+        buffer[DATA_TTL_OFFSET] = header.ttl - 1;
+        // The receive buffer stays valid until the batch has been sent
+        tx_queue_add_ref(tx, buffer, DATA_HEADER_SIZE + header.payload_length,
+                next_port);
+        metrics_count(m, METRIC_FORWARDED);
+    }
+    else if (header.flags & DATA_FLAG_PROBE) {
+        metrics_count(m, ack_probe(node, &header, buffer + DATA_HEADER_SIZE,
+                tx) < 0 ? METRIC_DROPPED_MALFORMED : METRIC_PROBES_ACKED);
+    }
+    else {
+        metrics_count(m, METRIC_DELIVERED);
+        LOG_FILE_DATA(node->log_file, LOG_INFO, buffer + DATA_HEADER_SIZE,
+                header.payload_length, "Received message, %u bytes:",
+                header.payload_length);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef FORWARD_H
+#define FORWARD_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fib.h"
+#include "netio.h"
+#include "metrics.h"
+#include "router.h"
+
+// The data plane of one router: DATA_PACKETs are forwarded through a FIB
+//  compiled from the router's DV, delivered, or (probes) acked.
+
+struct forward_node {
+    uint16_t port;
+    FILE *log_file; // Forwarded and delivered packets are logged here
+    _Atomic(struct fib *) fib;
+    uint32_t fib_generation;
+};
+
+// Compiles the router's DV into a new FIB generation, spreading each
+//  destination over up to max_paths equal-cost next hops, and publishes it.
+//  The old one is freed through qsbr.
+void forward_update_fib(struct forward_node *node, struct router *r,
+        int max_paths, struct qsbr *qsbr);
+
+// Forwards go out through tx, and the packet is counted in m, both of which
+//  belong to the calling thread. Only the TTL is rewritten; the packet is
+//  sent on straight from the receive buffer.
+void forward_data_packet(struct forward_node *node, uint16_t sender_port,
+        char *buffer, size_t length, struct tx_queue *tx, struct metrics *m);
+
+#endif
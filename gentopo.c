@@ -0,0 +1,307 @@
+// Writes a large synthetic topology in the format of sample_topology.txt:
+//  one line per direction of each link,
+//      <source router>,<destination router>,<destination port>,<link cost>
+//  with router i on port base_port + i.
+//
+// Shapes:
+//   random     a ring (so it is connected) plus random chords
+//   grid       a square lattice, each router linked to up to 4 others
+//   scalefree  preferential attachment (Barabasi-Albert): each new router
+//              links to existing ones with probability proportional to
+//              their degree, giving a few hubs and many leaves
+//
+// Routers are named by single letters when there are few enough of them,
+//  otherwise n0, n1, ...
+//
+// Usage: gentopo [-t shape] [-n routers] [-d degree] [-c max_cost]
+//                [-p base_port] [-s seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define SINGLE_LETTER_NAMES "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+
+struct link {
+    int a, b;
+    int cost;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+int my_router_count = 1000;
+int my_degree = 4; // Average links per router
+int my_max_cost = 5;
+long my_base_port = 10000;
+uint64_t my_rng_state;
+struct link *my_links;
+int my_link_count = 0;
+int my_link_capacity = 0;
+int **my_adjacent; // Routers each router is linked to, for spotting repeats
+int *my_adjacent_count;
+int *my_adjacent_capacity;
+//-----------------------------------------------------------------------------
+
+static void *gen_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+// xorshift64*
+static uint64_t gen_random() {
+    my_rng_state ^= my_rng_state >> 12;
+    my_rng_state ^= my_rng_state << 25;
+    my_rng_state ^= my_rng_state >> 27;
+    return my_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int linked(int a, int b) {
+    int i;
+    for (i=0; i<my_adjacent_count[a]; i++) {
+        if (my_adjacent[a][i] == b) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void add_adjacent(int a, int b) {
+    if (my_adjacent_count[a] == my_adjacent_capacity[a]) {
+        my_adjacent_capacity[a] = my_adjacent_capacity[a] == 0 ?
+                4 : 2*my_adjacent_capacity[a];
+        my_adjacent[a] = gen_alloc(my_adjacent[a],
+                my_adjacent_capacity[a] * sizeof(int));
+    }
+    my_adjacent[a][my_adjacent_count[a]++] = b;
+}
+
+// Returns 0 (and adds nothing) for a self-link or a repeated link
+static int add_link(int a, int b) {
+    if (a == b || linked(a, b)) {
+        return 0;
+    }
+    if (my_link_count == my_link_capacity) {
+        my_link_capacity = my_link_capacity == 0 ? 1024 : 2*my_link_capacity;
+        my_links = gen_alloc(my_links, my_link_capacity * sizeof(struct link));
+    }
+    struct link *l = &my_links[my_link_count++];
+    l->a = a;
+    l->b = b;
+    l->cost = 1 + gen_random() % my_max_cost;
+    add_adjacent(a, b);
+    add_adjacent(b, a);
+    return 1;
+}
+
+static void generate_random() {
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        add_link(i, (i+1) % my_router_count);
+    }
+    long target = (long) my_router_count * my_degree / 2;
+    long attempts = 0;
+    while (my_link_count < target && attempts < 100 * target) {
+        attempts++;
+        add_link(gen_random() % my_router_count,
+                gen_random() % my_router_count);
+    }
+}
+
+// The degree is always about 4; the last row may be short
+static void generate_grid() {
+    int columns = 1;
+    while (columns * columns < my_router_count) {
+        columns++;
+    }
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        if ((i+1) % columns != 0 && i+1 < my_router_count) {
+            add_link(i, i+1);
+        }
+        if (i + columns < my_router_count) {
+            add_link(i, i + columns);
+        }
+    }
+}
+
+static void generate_scale_free() {
+    // Every link end, so picking one uniformly picks a router with
+    //  probability proportional to its degree
+    int *ends = gen_alloc(NULL,
+            2 * ((size_t) my_router_count * my_degree + 2) * sizeof(int));
+    int end_count = 0;
+    int per_router = my_degree / 2 > 0 ? my_degree / 2 : 1;
+    int i, k;
+    // Start from a small clique
+    int seed_count = per_router + 1 < my_router_count ?
+            per_router + 1 : my_router_count;
+    for (i=0; i<seed_count; i++) {
+        for (k=0; k<i; k++) {
+            add_link(i, k);
+            ends[end_count++] = i;
+            ends[end_count++] = k;
+        }
+    }
+    for (i=seed_count; i<my_router_count; i++) {
+        int added = 0;
+        int attempts = 0;
+        while (added < per_router && attempts < 100 * per_router) {
+            attempts++;
+            int other = ends[gen_random() % end_count];
+            if (add_link(i, other)) {
+                ends[end_count++] = i;
+                ends[end_count++] = other;
+                added++;
+            }
+        }
+    }
+    free(ends);
+}
+
+static void print_name(int router) {
+    if (my_router_count <= (int) strlen(SINGLE_LETTER_NAMES)) {
+        putchar(SINGLE_LETTER_NAMES[router]);
+    } else {
+        printf("n%d", router);
+    }
+}
+
+static void print_direction(int src, int dest, int cost) {
+    print_name(src);
+    putchar(',');
+    print_name(dest);
+    printf(",%ld,%d\n", my_base_port + dest, cost);
+}
+
+// Each router's links are listed together, as in sample_topology.txt
+static void print_topology() {
+    struct link **by_router = gen_alloc(NULL,
+            my_router_count * sizeof(struct link *));
+    int *counts = calloc(my_router_count, sizeof(int));
+    if (counts == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int i, k;
+    for (i=0; i<my_router_count; i++) {
+        by_router[i] = gen_alloc(NULL,
+                (my_adjacent_count[i] + 1) * sizeof(struct link));
+    }
+    for (i=0; i<my_link_count; i++) {
+        struct link *l = &my_links[i];
+        by_router[l->a][counts[l->a]++] = *l;
+        struct link reverse = { l->b, l->a, l->cost };
+        by_router[l->b][counts[l->b]++] = reverse;
+    }
+    for (i=0; i<my_router_count; i++) {
+        for (k=0; k<counts[i]; k++) {
+            print_direction(i, by_router[i][k].b, by_router[i][k].cost);
+        }
+        free(by_router[i]);
+    }
+    free(by_router);
+    free(counts);
+}
+
+static int parse_long(const char *str, long low, long high, long *result) {
+    char *end;
+    errno = 0;
+    long value = strtol(str, &end, 10);
+    if (errno == ERANGE || value < low || value > high
+            || end == str || *end != '\0') {
+        return -1;
+    }
+    *result = value;
+    return 0;
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-t shape] [-n routers] [-d degree]"
+            " [-c max_cost] [-p base_port] [-s seed]\n", program_name);
+    fprintf(stderr, "  -t  random, grid or scalefree (default random)\n");
+    fprintf(stderr, "  -n  routers (default 1000)\n");
+    fprintf(stderr, "  -d  average links per router (default 4)\n");
+    fprintf(stderr, "  -c  link costs are 1 to this (default 5)\n");
+    fprintf(stderr, "  -p  port of the first router (default 10000)\n");
+    fprintf(stderr, "  -s  random seed (default 1)\n");
+}
+
+int main(int argc, char **argv) {
+    const char *shape = "random";
+    long value;
+    long seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:d:c:p:s:")) != -1) {
+        int ok = 1;
+        switch (opt) {
+            case 't':
+                shape = optarg;
+            break;
+            case 'n':
+                ok = parse_long(optarg, 2, UINT16_MAX, &value) == 0;
+                my_router_count = value;
+            break;
+            case 'd':
+                ok = parse_long(optarg, 2, 1000, &value) == 0;
+                my_degree = value;
+            break;
+            case 'c':
+                ok = parse_long(optarg, 1, 63, &value) == 0;
+                my_max_cost = value;
+            break;
+            case 'p':
+                ok = parse_long(optarg, 1, UINT16_MAX, &my_base_port) == 0;
+            break;
+            case 's':
+                ok = parse_long(optarg, 0, INT32_MAX, &seed) == 0;
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid value %s for -%c\n", optarg, opt);
+            exit(1);
+        }
+    }
+    if (optind < argc) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    if (my_base_port + my_router_count - 1 > UINT16_MAX) {
+        fprintf(stderr, "Error: Ports of %d routers from %ld exceed %d\n",
+                my_router_count, my_base_port, UINT16_MAX);
+        exit(1);
+    }
+    // xorshift must not start at 0
+    my_rng_state = (uint64_t) seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    my_adjacent = calloc(my_router_count, sizeof(int *));
+    my_adjacent_count = calloc(my_router_count, sizeof(int));
+    my_adjacent_capacity = calloc(my_router_count, sizeof(int));
+    if (my_adjacent == NULL || my_adjacent_count == NULL
+            || my_adjacent_capacity == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    if (strcmp(shape, "random") == 0) {
+        generate_random();
+    } else if (strcmp(shape, "grid") == 0) {
+        generate_grid();
+    } else if (strcmp(shape, "scalefree") == 0) {
+        generate_scale_free();
+    } else {
+        fprintf(stderr, "Error: Unknown shape %s\n", shape);
+        exit(1);
+    }
+    print_topology();
+    return 0;
+}
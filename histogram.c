@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "histogram.h"
+
+static int bucket_of(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT) {
+        return (int) value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_COUNT
+            + (int) ((value >> shift) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+// The largest value that falls in the bucket
+static uint64_t bucket_high(int bucket) {
+    if (bucket < HISTOGRAM_SUB_COUNT) {
+        return bucket;
+    }
+    int shift = bucket / HISTOGRAM_SUB_COUNT - 1;
+    uint64_t low = (uint64_t) (HISTOGRAM_SUB_COUNT
+            + bucket % HISTOGRAM_SUB_COUNT) << shift;
+    return low + (((uint64_t) 1 << shift) - 1);
+}
+
+void histogram_init(struct histogram *h) {
+    memset(h, 0, sizeof *h);
+    h->min = UINT64_MAX;
+}
+
+void histogram_add(struct histogram *h, uint64_t value) {
+    h->buckets[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void histogram_merge(struct histogram *into, const struct histogram *from) {
+    int i;
+    for (i=0; i<HISTOGRAM_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+uint64_t histogram_percentile(const struct histogram *h, double percentile) {
+    if (h->count == 0) {
+        return 0;
+    }
+    // The rank of the value wanted, from 1 to count
+    double exact_rank = percentile / 100.0 * h->count;
+    uint64_t rank = (uint64_t) exact_rank;
+    if ((double) rank < exact_rank) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+    uint64_t seen = 0;
+    int i;
+    for (i=0; i<HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
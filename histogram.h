@@ -0,0 +1,31 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histogram of 64-bit values: each power of two is split into
+//  HISTOGRAM_SUB_COUNT equal buckets, so any value is recorded to within
+//  1/HISTOGRAM_SUB_COUNT of itself (values below 2*HISTOGRAM_SUB_COUNT
+//  exactly) in a fixed amount of memory and with no allocation.
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram *h);
+void histogram_add(struct histogram *h, uint64_t value);
+void histogram_merge(struct histogram *into, const struct histogram *from);
+
+// The value that percentile percent of the values are at or below (to the
+//  histogram's precision), or 0 if it is empty
+uint64_t histogram_percentile(const struct histogram *h, double percentile);
+
+#endif
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "link_probe.h"
+#include "logger.h"
+
+// Weight of each new sample in the smoothed RTT and loss rate, as TCP
+//  weighs its RTT samples
+#define LINK_SMOOTHING (1.0 / 8)
+
+// A link losing nearly every probe costs as much as any link can
+#define LINK_LOSS_MAX 0.95
+
+static void put_probe(char *buffer, uint32_t seq, uint64_t send_ns) {
+    uint32_t seq_n = htonl(seq);
+    uint32_t high = htonl(send_ns >> 32);
+    uint32_t low = htonl(send_ns & 0xFFFFFFFFu);
+    memset(buffer, 0, PROBE_PACKET_SIZE);
+    buffer[0] = PROBE_PACKET;
+    memcpy(buffer + 4, &seq_n, 4);
+    memcpy(buffer + 8, &high, 4);
+    memcpy(buffer + 12, &low, 4);
+}
+
+static void get_probe(const char *buffer, uint32_t *seq, uint64_t *send_ns) {
+    uint32_t seq_n, high, low;
+    memcpy(&seq_n, buffer + 4, 4);
+    memcpy(&high, buffer + 8, 4);
+    memcpy(&low, buffer + 12, 4);
+    *seq = ntohl(seq_n);
+    *send_ns = ((uint64_t) ntohl(high) << 32) | ntohl(low);
+}
+
+void link_prober_init(struct link_prober *p, struct router *r) {
+    memset(p, 0, sizeof *p);
+    p->router = r;
+    p->interval_ms = LINK_PROBE_DEFAULT_INTERVAL_MS;
+    p->rtt_per_cost_ns = (uint64_t) LINK_PROBE_DEFAULT_RTT_PER_COST_US * 1000;
+    p->hysteresis_percent = LINK_PROBE_DEFAULT_HYSTERESIS_PERCENT;
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        p->link_count++;
+    }
+    p->links = calloc(p->link_count > 0 ? p->link_count : 1,
+            sizeof(struct link_state));
+    if (p->links == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int i = 0;
+    for (node = r->neighbors; node!=NULL; node = node->next) {
+        struct link_state *l = &p->links[i++];
+        l->neighbor = node;
+        l->base_cost = node->cost;
+        l->measured_cost = node->cost;
+    }
+}
+
+void link_prober_free(struct link_prober *p) {
+    free(p->links);
+    p->links = NULL;
+    p->link_count = 0;
+}
+
+static uint32_t measured_cost(struct link_prober *p, struct link_state *l) {
+    double cost = l->base_cost + l->srtt_ns / p->rtt_per_cost_ns;
+    double loss = l->loss < LINK_LOSS_MAX ? l->loss : LINK_LOSS_MAX;
+    cost /= 1 - loss;
+    return cost < MAX_POSSIBLE_COST ?
+            (uint32_t) (cost + 0.5) : MAX_POSSIBLE_COST - 1;
+}
+
+static void leak_penalty(struct link_state *l, uint64_t now_ns) {
+    if (l->penalty_ns != 0 && now_ns > l->penalty_ns) {
+        l->penalty -= (now_ns - l->penalty_ns) / 1e9
+                * LINK_PENALTY_DECAY_PER_S;
+        if (l->penalty < 0) {
+            l->penalty = 0;
+        }
+    }
+    l->penalty_ns = now_ns;
+    if (l->suppressed && l->penalty < LINK_PENALTY_REUSE) {
+        LOG(LOG_INFO, "Link cost to neighbor %u may change again",
+                l->neighbor->port);
+        l->suppressed = 0;
+    }
+}
+
+// Hands the measured cost to the router once it has been out of the
+//  hysteresis band for LINK_CONFIRM_SAMPLES samples in a row, unless the
+//  link is being damped. Only a change that turns back the way the
+//  previous one came is a flap, and adds to the penalty; a link getting
+//  steadily worse (or better) isn't.
+static void update_cost(struct link_prober *p, struct link_state *l,
+        uint64_t now_ns) {
+    l->measured_cost = measured_cost(p, l);
+    leak_penalty(l, now_ns);
+    uint32_t cost = l->neighbor->cost;
+    uint32_t band = cost * p->hysteresis_percent / 100;
+    if (band < 1) {
+        band = 1;
+    }
+    int direction = 0;
+    if (l->measured_cost >= cost + band) {
+        direction = 1;
+    } else if (l->measured_cost + band <= cost) {
+        direction = -1;
+    }
+    if (direction == 0 || direction != l->pending_direction) {
+        l->pending_direction = direction;
+        l->pending_samples = direction != 0;
+        return;
+    }
+    if (++l->pending_samples < LINK_CONFIRM_SAMPLES) {
+        return;
+    }
+    if (l->suppressed) {
+        p->stats.changes_damped++;
+        return;
+    }
+    if (l->last_direction != 0 && direction != l->last_direction) {
+        l->penalty += LINK_PENALTY_PER_FLAP;
+        if (l->penalty >= LINK_PENALTY_SUPPRESS) {
+            LOG(LOG_INFO, "Link cost to neighbor %u keeps flapping; holding"
+                    " it at %u for a while", l->neighbor->port, cost);
+            l->suppressed = 1;
+            p->stats.changes_damped++;
+            return;
+        }
+    }
+    l->last_direction = direction;
+    l->pending_direction = 0;
+    l->pending_samples = 0;
+    p->stats.cost_changes++;
+    router_set_link_cost(p->router, l->neighbor->port, l->measured_cost);
+}
+
+void link_prober_tick(struct link_prober *p, uint64_t now_ns) {
+    struct router *r = p->router;
+    int i;
+    for (i=0; i<p->link_count; i++) {
+        struct link_state *l = &p->links[i];
+        if (!l->neighbor->up) {
+            // Start over when it comes back
+            l->outstanding = 0;
+            l->srtt_ns = 0;
+            l->loss = 0;
+            continue;
+        }
+        if (l->outstanding) {
+            l->loss += LINK_SMOOTHING * (1 - l->loss);
+            LOG(LOG_DEBUG, "Probe %u to neighbor %u lost", l->seq,
+                    l->neighbor->port);
+            update_cost(p, l, now_ns);
+        }
+        char probe[PROBE_PACKET_SIZE];
+        l->seq++;
+        put_probe(probe, l->seq, now_ns);
+        r->ops->send(r->ctx, probe, sizeof probe, NULL, 0, l->neighbor->port);
+        l->outstanding = 1;
+        p->stats.probes_sent++;
+    }
+}
+
+void link_prober_handle_reply(struct link_prober *p, uint16_t sender_port,
+        const char *buffer, size_t length, uint64_t now_ns) {
+    if (length != PROBE_PACKET_SIZE) {
+        LOG(LOG_WARN, "Message not understood, malformed probe reply");
+        return;
+    }
+    uint32_t seq;
+    uint64_t send_ns;
+    get_probe(buffer, &seq, &send_ns);
+    int i;
+    for (i=0; i<p->link_count; i++) {
+        struct link_state *l = &p->links[i];
+        if (l->neighbor->port != sender_port) {
+            continue;
+        }
+        if (!l->outstanding || seq != l->seq || send_ns > now_ns) {
+            LOG(LOG_DEBUG, "Late probe reply %u from port %u", seq,
+                    sender_port);
+            return;
+        }
+        l->outstanding = 0;
+        p->stats.replies++;
+        double rtt_ns = now_ns - send_ns;
+        l->srtt_ns = l->srtt_ns == 0 ?
+                rtt_ns : l->srtt_ns + LINK_SMOOTHING * (rtt_ns - l->srtt_ns);
+        l->loss -= LINK_SMOOTHING * l->loss;
+        LOG(LOG_DEBUG, "Probe %u to neighbor %u: RTT %u us, smoothed %u us,"
+                " loss %u per mille", seq, sender_port,
+                (uint32_t) (rtt_ns / 1000), (uint32_t) (l->srtt_ns / 1000),
+                (uint32_t) (l->loss * 1000));
+        update_cost(p, l, now_ns);
+        return;
+    }
+    LOG(LOG_WARN, "Warning: Probe reply from port %u, which isn't a neighbor",
+            sender_port);
+}
@@ -0,0 +1,90 @@
+#ifndef LINK_PROBE_H
+#define LINK_PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "router.h"
+
+// Link costs from measured round trips. Every interval each neighbor that
+//  is up gets a PROBE_PACKET, which it echoes back (see router.h); a probe
+//  not answered by the next one counts as lost. The round trip and the loss
+//  rate are smoothed, and give the link's measured cost:
+//
+//      (topology cost + smoothed RTT / rtt_per_cost) / (1 - loss rate)
+//
+//  so a slow link costs more, and a lossy one more again, by the expected
+//  number of tries.
+// Measured costs only reach the router (router_set_link_cost) once they
+//  have stayed out of the hysteresis band around the cost in use for
+//  LINK_CONFIRM_SAMPLES probes in a row. A change that goes back the way the
+//  previous one came is a flap and adds to the link's penalty, which leaks
+//  away over time; while the penalty is above LINK_PENALTY_SUPPRESS, the
+//  link's cost stays put until it has leaked down to LINK_PENALTY_REUSE, so
+//  a link whose delay swings back and forth doesn't take the routes with it.
+//
+// Probe format, in network byte order:
+//      uint8  type             PROBE_PACKET or PROBE_REPLY_PACKET
+//      uint8  unused[3]
+//      uint32 seq              Counts up for each neighbor
+//      uint64 send_ns          CLOCK_MONOTONIC at the prober
+
+#define LINK_PROBE_DEFAULT_INTERVAL_MS 500
+#define LINK_PROBE_DEFAULT_RTT_PER_COST_US 1000
+#define LINK_PROBE_DEFAULT_HYSTERESIS_PERCENT 20
+
+#define LINK_CONFIRM_SAMPLES 2
+#define LINK_PENALTY_PER_FLAP 1000
+#define LINK_PENALTY_SUPPRESS 3000
+#define LINK_PENALTY_REUSE 1500
+#define LINK_PENALTY_DECAY_PER_S 100
+
+struct link_state {
+    struct neighbor_list_node *neighbor;
+    uint32_t base_cost; // From the topology
+    uint32_t seq; // Of the last probe sent
+    int outstanding; // It hasn't been answered yet
+    double srtt_ns; // Smoothed round trip, 0 until the first is measured
+    double loss; // Smoothed fraction of probes lost
+    uint32_t measured_cost;
+    int pending_direction; // 1 above the band, -1 below, 0 inside it
+    int pending_samples; // In a row in pending_direction
+    int last_direction; // Of the last change handed to the router
+    double penalty;
+    int suppressed;
+    uint64_t penalty_ns; // When the penalty was last brought up to date
+};
+
+struct link_prober_stats {
+    uint64_t probes_sent;
+    uint64_t replies; // Answers to the latest probe; late ones don't count
+    uint64_t cost_changes;
+    uint64_t changes_damped; // Confirmed changes held back by the penalty
+};
+
+struct link_prober {
+    struct router *router;
+    int interval_ms;
+    uint64_t rtt_per_cost_ns;
+    int hysteresis_percent;
+    struct link_state *links;
+    int link_count;
+    struct link_prober_stats stats;
+};
+
+// Takes the router's neighbors as they are now, so call it once they have
+//  all been added. Configuration fields may be changed before the first
+//  tick.
+void link_prober_init(struct link_prober *p, struct router *r);
+void link_prober_free(struct link_prober *p);
+
+// Called every interval_ms: counts unanswered probes as lost and sends new
+//  ones. now_ns is CLOCK_MONOTONIC. Link costs may change, so the caller
+//  ends the batch afterwards.
+void link_prober_tick(struct link_prober *p, uint64_t now_ns);
+
+// Takes a PROBE_REPLY_PACKET from sender_port
+void link_prober_handle_reply(struct link_prober *p, uint16_t sender_port,
+        const char *buffer, size_t length, uint64_t now_ns);
+
+#endif
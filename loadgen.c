@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "loadgen.h"
+#include "data_packet.h"
+#include "histogram.h"
+#include "netio.h"
+#include "router.h"
+
+#define LOADGEN_RX_BUFFER_SIZE 2048 // Acks are much smaller
+#define LOADGEN_SOCKET_BUFFER_SIZE (8 << 20)
+
+struct pair_stats {
+    uint32_t next_seq;
+    uint64_t sent;
+    uint64_t sent_bytes; // Of payload
+    uint64_t acked;
+    uint64_t acked_bytes;
+    uint64_t reordered; // Acked after one with a higher sequence number
+    uint64_t duplicates;
+    uint32_t highest_seq; // Acked so far, if acked > 0
+    uint8_t *acked_seqs; // Bitmap of seq_limit bits
+    uint32_t seq_limit;
+    struct histogram latency_ns;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+static uint64_t my_rng_state;
+static char my_filler[DATA_PAYLOAD_MAX]; // Payload after the probe fields
+//-----------------------------------------------------------------------------
+
+static void *loadgen_calloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t loadgen_random() {
+    my_rng_state ^= my_rng_state >> 12;
+    my_rng_state ^= my_rng_state << 25;
+    my_rng_state ^= my_rng_state >> 27;
+    return my_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int parse_int(const char *str, char **end, int low, int high,
+        int *result) {
+    errno = 0;
+    long value = strtol(str, end, 10);
+    if (errno == ERANGE || *end == str || value < low || value > high) {
+        return -1;
+    }
+    *result = (int) value;
+    return 0;
+}
+
+int loadgen_parse_sizes(const char *spec, struct loadgen_config *c) {
+    if (strcmp(spec, "imix") == 0) {
+        spec = "64:7,576:4,1500:1";
+    }
+    c->size_count = 0;
+    const char *p = spec;
+    while (1) {
+        if (c->size_count == LOADGEN_MAX_SIZES) {
+            return -1;
+        }
+        struct loadgen_size *s = &(c->sizes[c->size_count++]);
+        char *end;
+        if (parse_int(p, &end, DATA_PROBE_SIZE, DATA_PAYLOAD_MAX,
+                &s->min) < 0) {
+            return -1;
+        }
+        s->max = s->min;
+        if (*end == '-' && parse_int(end + 1, &end, s->min, DATA_PAYLOAD_MAX,
+                &s->max) < 0) {
+            return -1;
+        }
+        s->weight = 1;
+        if (*end == ':' && parse_int(end + 1, &end, 1, 1000000,
+                &s->weight) < 0) {
+            return -1;
+        }
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        p = end + 1;
+    }
+}
+
+static int pick_size(const struct loadgen_config *c, int total_weight) {
+    int pick = loadgen_random() % total_weight;
+    const struct loadgen_size *s = c->sizes;
+    while (pick >= s->weight) {
+        pick -= s->weight;
+        s++;
+    }
+    return s->min + loadgen_random() % (s->max - s->min + 1);
+}
+
+static void send_probe(const struct loadgen_config *c, struct tx_queue *tx,
+        int pair, struct pair_stats *stats, int payload_length) {
+    char head[DATA_HEADER_SIZE + DATA_PROBE_SIZE];
+    struct data_header header = {
+        .type = DATA_PACKET,
+        .version = DATA_WIRE_VERSION,
+        .ttl = DATA_DEFAULT_TTL,
+        .flags = DATA_FLAG_PROBE,
+        .src_port = c->pairs[pair].src_port,
+        .dest_port = c->pairs[pair].dest_port,
+        .flow = pair,
+        .payload_length = payload_length,
+    };
+    struct data_probe probe = {
+        .seq = stats->next_seq++,
+        .send_ns = now_ns(),
+        .reply_port = c->port,
+    };
+    data_header_write(head, &header);
+    data_probe_write(head + DATA_HEADER_SIZE, &probe, 0);
+    tx_queue_add_parts(tx, head, sizeof head, my_filler,
+            payload_length - DATA_PROBE_SIZE, header.src_port);
+    stats->sent++;
+    stats->sent_bytes += payload_length;
+}
+
+static void handle_ack(const struct loadgen_config *c, const char *buffer,
+        size_t length, struct pair_stats *all_stats) {
+    struct data_header header;
+    struct data_probe probe;
+    if (data_header_read(buffer, length, &header) < 0
+            || !(header.flags & DATA_FLAG_ACK)
+            || header.flow >= c->pair_count
+            || data_probe_read(buffer + DATA_HEADER_SIZE,
+                    header.payload_length, &probe, 1) < 0) {
+        return;
+    }
+    struct pair_stats *stats = &(all_stats[header.flow]);
+    if (probe.seq >= stats->seq_limit) {
+        return;
+    }
+    uint8_t bit = 1 << (probe.seq & 7);
+    if (stats->acked_seqs[probe.seq >> 3] & bit) {
+        stats->duplicates++;
+        return;
+    }
+    stats->acked_seqs[probe.seq >> 3] |= bit;
+    if (stats->acked > 0 && probe.seq < stats->highest_seq) {
+        stats->reordered++;
+    } else {
+        stats->highest_seq = probe.seq;
+    }
+    stats->acked++;
+    stats->acked_bytes += probe.payload_length;
+    histogram_add(&stats->latency_ns, probe.receive_ns > probe.send_ns ?
+            probe.receive_ns - probe.send_ns : 0);
+}
+
+static uint64_t acked_count(const struct loadgen_config *c,
+        const struct pair_stats *stats) {
+    uint64_t acked = 0;
+    int i;
+    for (i=0; i<c->pair_count; i++) {
+        acked += stats[i].acked;
+    }
+    return acked;
+}
+
+// Waits up to timeout_ns for acks, then takes whatever has arrived
+static void receive_acks(const struct loadgen_config *c, struct rx_batch *rx,
+        struct pair_stats *stats, uint64_t timeout_ns) {
+    struct pollfd pfd = { .fd = c->socket_fd, .events = POLLIN };
+    struct timespec timeout = {
+        .tv_sec = timeout_ns / 1000000000,
+        .tv_nsec = timeout_ns % 1000000000,
+    };
+    int ready = ppoll(&pfd, 1, &timeout, NULL);
+    if (ready < 0 && errno != EINTR) {
+        perror("Error waiting for acks");
+        exit(1);
+    }
+    if (ready <= 0) {
+        return;
+    }
+    // Something is queued, so this doesn't block
+    int count = rx_batch_receive(c->socket_fd, rx);
+    if (count < 0) {
+        perror("Error receiving acks");
+        return;
+    }
+    int i;
+    for (i=0; i<count; i++) {
+        handle_ack(c, rx_batch_buffer(rx, i), rx_batch_length(rx, i), stats);
+    }
+}
+
+static void print_row(const char *label, const struct pair_stats *s) {
+    double lost = s->sent > 0 ?
+            100.0 * (s->sent - s->acked) / s->sent : 0;
+    const struct histogram *h = &(s->latency_ns);
+    printf("%-16s %10llu %10llu %7.3f %9llu %6llu %9.1f %9.1f %9.1f %9.1f\n",
+            label, (unsigned long long) s->sent,
+            (unsigned long long) s->acked, lost,
+            (unsigned long long) s->reordered,
+            (unsigned long long) s->duplicates,
+            histogram_percentile(h, 50) / 1e3,
+            histogram_percentile(h, 99) / 1e3,
+            histogram_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+static void print_report(const struct loadgen_config *c,
+        struct pair_stats *stats, double sending_s) {
+    struct pair_stats total;
+    memset(&total, 0, sizeof total);
+    histogram_init(&total.latency_ns);
+    printf("%-16s %10s %10s %7s %9s %6s %9s %9s %9s %9s\n", "pair", "sent",
+            "acked", "lost%", "reordered", "dups", "p50 us", "p99 us",
+            "p99.9 us", "max us");
+    int i;
+    for (i=0; i<c->pair_count; i++) {
+        struct pair_stats *s = &(stats[i]);
+        char label[64];
+        snprintf(label, sizeof label, "%s->%s", c->pairs[i].src_name,
+                c->pairs[i].dest_name);
+        print_row(label, s);
+        total.sent += s->sent;
+        total.sent_bytes += s->sent_bytes;
+        total.acked += s->acked;
+        total.acked_bytes += s->acked_bytes;
+        total.reordered += s->reordered;
+        total.duplicates += s->duplicates;
+        histogram_merge(&total.latency_ns, &s->latency_ns);
+    }
+    if (c->pair_count > 1) {
+        print_row("total", &total);
+    }
+    printf("offered   %.0f packets/s, %.2f Mbit/s of payload over %.2f s\n",
+            total.sent / sending_s, total.sent_bytes * 8 / sending_s / 1e6,
+            sending_s);
+    printf("delivered %.0f packets/s, %.2f Mbit/s of payload\n",
+            total.acked / sending_s, total.acked_bytes * 8 / sending_s / 1e6);
+}
+
+void loadgen_run(const struct loadgen_config *c) {
+    my_rng_state = c->seed * 0x9E3779B97F4A7C15ULL + 1;
+    int total_weight = 0;
+    int i;
+    for (i=0; i<c->size_count; i++) {
+        total_weight += c->sizes[i].weight;
+    }
+
+    // Acks come back at the full rate
+    int buffer_size = LOADGEN_SOCKET_BUFFER_SIZE;
+    setsockopt(c->socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size,
+            sizeof buffer_size);
+    setsockopt(c->socket_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size,
+            sizeof buffer_size);
+
+    uint64_t total_packets = (uint64_t) (c->rate * c->duration_s);
+    if (total_packets > (uint64_t) UINT32_MAX * c->pair_count) {
+        total_packets = (uint64_t) UINT32_MAX * c->pair_count;
+    }
+    struct pair_stats *stats = loadgen_calloc(c->pair_count,
+            sizeof(struct pair_stats));
+    for (i=0; i<c->pair_count; i++) {
+        stats[i].seq_limit = total_packets / c->pair_count + 1;
+        stats[i].acked_seqs = loadgen_calloc(stats[i].seq_limit / 8 + 1, 1);
+        histogram_init(&stats[i].latency_ns);
+    }
+    struct tx_queue tx;
+    tx_queue_init(&tx, c->socket_fd, c->batch_size);
+    struct rx_batch rx;
+    rx_batch_init(&rx, c->batch_size, LOADGEN_RX_BUFFER_SIZE);
+
+    uint64_t start = now_ns();
+    uint64_t sent = 0;
+    while (sent < total_packets) {
+        // Packet k is due k/rate seconds after the start
+        uint64_t now = now_ns();
+        uint64_t due = (uint64_t) ((now - start) * c->rate / 1e9) + 1;
+        if (due > total_packets) {
+            due = total_packets;
+        }
+        int queued = 0;
+        while (sent < due && queued < c->batch_size) {
+            int pair = sent % c->pair_count;
+            send_probe(c, &tx, pair, &stats[pair], pick_size(c, total_weight));
+            sent++;
+            queued++;
+        }
+        tx_queue_flush(&tx);
+        uint64_t next = start + (uint64_t) (sent * 1e9 / c->rate);
+        now = now_ns();
+        receive_acks(c, &rx, stats, sent < due || next <= now ?
+                0 : next - now);
+    }
+    double sending_s = (now_ns() - start) / 1e9;
+
+    uint64_t drain_end = now_ns() + (uint64_t) (c->drain_s * 1e9);
+    uint64_t now;
+    while (acked_count(c, stats) < sent && (now = now_ns()) < drain_end) {
+        receive_acks(c, &rx, stats, drain_end - now);
+    }
+
+    print_report(c, stats, sending_s);
+    for (i=0; i<c->pair_count; i++) {
+        free(stats[i].acked_seqs);
+    }
+    free(stats);
+}
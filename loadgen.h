@@ -0,0 +1,55 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <stdint.h>
+
+// Load generator for capacity testing the forwarding plane. It sends probe
+//  data packets (see data_packet.h) into the network at a steady rate,
+//  spread round-robin over a set of source/destination router pairs, and
+//  collects the acks the destinations send back. At the end it prints the
+//  throughput, loss, reordering and one-way latency percentiles of each pair
+//  and of all of them together.
+
+#define LOADGEN_MAX_PAIRS 256
+#define LOADGEN_MAX_SIZES 16
+
+struct loadgen_pair {
+    const char *src_name;
+    const char *dest_name;
+    uint16_t src_port; // Where its packets are injected
+    uint16_t dest_port;
+};
+
+// Payloads of min to max bytes (uniformly), picked weight times out of the
+//  total weight of all the sizes
+struct loadgen_size {
+    int min;
+    int max;
+    int weight;
+};
+
+struct loadgen_config {
+    int socket_fd; // Bound to port, which the acks come back to
+    uint16_t port;
+    struct loadgen_pair *pairs;
+    int pair_count;
+    double rate; // Packets per second, over all pairs
+    double duration_s; // Of sending
+    double drain_s; // How long to wait for the last acks
+    int batch_size; // Datagrams per sendmmsg/recvmmsg
+    struct loadgen_size sizes[LOADGEN_MAX_SIZES];
+    int size_count;
+    uint64_t seed;
+};
+
+// Parses a payload size distribution into c->sizes: a comma separated list
+//  of sizes or ranges, each optionally weighted, as in "64", "64-1400" or
+//  "64:7,576:4,1500:1". "imix" is short for the last one, the sizes of the
+//  simple IMIX. Sizes must be from DATA_PROBE_SIZE to DATA_PAYLOAD_MAX.
+// Returns 0, or -1 if spec is invalid.
+int loadgen_parse_sizes(const char *spec, struct loadgen_config *c);
+
+// Runs the load and prints the report to stdout
+void loadgen_run(const struct loadgen_config *c);
+
+#endif
@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "logger.h"
+
+#define LOG_RING_SIZE 8192 // Records; must be a power of two
+#define LOG_WRITER_INTERVAL_NS 10000000 // Writer wakes up every 10 ms
+#define LOG_FILE_BUFFER_SIZE (1 << 20)
+#define LOG_LINE_MAX 1024
+
+// One slot of a bounded MPMC ring (Vyukov's algorithm): a slot is free for
+//  the producer claiming position p when sequence == p, and holds a record
+//  for the consumer at position p when sequence == p+1
+struct log_record {
+    _Atomic size_t sequence;
+    uint64_t timestamp_ns;
+    const char *fmt;
+    FILE *file;
+    uint8_t level;
+    uint8_t arg_count;
+    uint16_t blob_length;
+    uint64_t args[LOG_MAX_ARGS];
+    char blob[LOG_BLOB_MAX];
+    char *data; // Written out whole after the record, if not NULL; freed by
+                //  the writer
+    size_t data_length;
+};
+
+int log_level = LOG_INFO;
+
+static struct log_record log_ring[LOG_RING_SIZE];
+static _Atomic size_t log_enqueue_pos;
+static _Atomic size_t log_dequeue_pos;
+static _Atomic uint64_t log_dropped;
+
+static pthread_t log_writer;
+static _Atomic int log_running;
+static pthread_mutex_t log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *log_level_names[] = {
+    "error", "warn", "info", "debug", "trace"
+};
+
+int log_parse_level(const char *name) {
+    int i;
+    for (i=0; i<=LOG_TRACE; i++) {
+        if (strcmp(name, log_level_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Claims the next free slot, setting *claimed to its position.
+// Returns NULL if the ring is full.
+static struct log_record *log_claim(size_t *claimed) {
+    size_t pos = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+    struct log_record *r;
+    while (1) {
+        r = &log_ring[pos & (LOG_RING_SIZE-1)];
+        size_t seq = atomic_load_explicit(&r->sequence, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&log_enqueue_pos, &pos,
+                    pos+1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            // Full: the writer hasn't caught up, so lose this record
+            atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&log_enqueue_pos,
+                    memory_order_relaxed);
+        }
+    }
+    *claimed = pos;
+    return r;
+}
+
+// Fills in the claimed slot r and hands it to the writer
+static void log_fill(struct log_record *r, size_t pos, FILE *file, int level,
+        const char *blob, size_t blob_length, char *data, size_t data_length,
+        const char *fmt, const uint64_t *args, int arg_count) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    r->timestamp_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    r->fmt = fmt;
+    r->file = file;
+    r->level = level;
+    if (arg_count > LOG_MAX_ARGS) {
+        arg_count = LOG_MAX_ARGS;
+    }
+    r->arg_count = arg_count;
+    memcpy(r->args, args, arg_count * sizeof(uint64_t));
+    if (blob_length > LOG_BLOB_MAX) {
+        blob_length = LOG_BLOB_MAX;
+    }
+    r->blob_length = blob_length;
+    if (blob_length > 0) {
+        memcpy(r->blob, blob, blob_length);
+    }
+    r->data = data;
+    r->data_length = data_length;
+    atomic_store_explicit(&r->sequence, pos+1, memory_order_release);
+}
+
+void log_emit(FILE *file, int level, const char *blob, size_t blob_length,
+        const char *fmt, const uint64_t *args, int arg_count) {
+    size_t pos;
+    struct log_record *r = log_claim(&pos);
+    if (r != NULL) {
+        log_fill(r, pos, file, level, blob, blob_length, NULL, 0, fmt, args,
+                arg_count);
+    }
+}
+
+void log_emit_data(FILE *file, int level, const char *data,
+        size_t data_length, const char *fmt, const uint64_t *args,
+        int arg_count) {
+    size_t pos;
+    struct log_record *r = log_claim(&pos);
+    if (r == NULL) {
+        return;
+    }
+    char *copy = malloc(data_length > 0 ? data_length : 1);
+    if (copy == NULL) {
+        // The slot is taken, so the record still goes out, without the data
+        atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+        data_length = 0;
+    } else {
+        memcpy(copy, data, data_length);
+    }
+    log_fill(r, pos, file, level, NULL, 0, copy, data_length, fmt, args,
+            arg_count);
+}
+
+//-----------------------------------------------------------------------------
+// Writer side
+
+struct line_buffer {
+    char text[LOG_LINE_MAX];
+    size_t length;
+};
+
+static void line_append(struct line_buffer *line, const char *s, size_t n) {
+    if (n > LOG_LINE_MAX - 1 - line->length) {
+        n = LOG_LINE_MAX - 1 - line->length;
+    }
+    memcpy(line->text + line->length, s, n);
+    line->length += n;
+}
+
+static void line_append_number(struct line_buffer *line, uint64_t value,
+        int is_signed, int base, int upper, int width, char pad) {
+    char digits[24];
+    const char *symbols = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int negative = is_signed && (int64_t) value < 0;
+    if (negative) {
+        value = -(int64_t) value;
+    }
+    int n = 0;
+    do {
+        digits[n++] = symbols[value % base];
+        value /= base;
+    } while (value != 0);
+    if (negative && pad == '0') {
+        line_append(line, "-", 1);
+        width--;
+    } else if (negative) {
+        digits[n++] = '-';
+    }
+    for (; width > n; width--) {
+        line_append(line, &pad, 1);
+    }
+    while (n > 0) {
+        line_append(line, &digits[--n], 1);
+    }
+}
+
+// Same layout print_hexadecimal used to produce
+static void line_append_hex(struct line_buffer *line, const char *bytes,
+        int length) {
+    int i;
+    for (i=0; i<length; i++) {
+        if (i!=0) {
+            if (i%16 == 0)
+                line_append(line, "\n", 1);
+            else if (i%4 == 0)
+                line_append(line, " ", 1);
+        }
+        line_append_number(line, bytes[i] & 0xFF, 0, 16, 1, 2, '0');
+    }
+}
+
+// Returns 1 if data reads as text: no control characters but tabs and line
+//  breaks
+static int is_text(const char *data, size_t length) {
+    size_t i;
+    for (i=0; i<length; i++) {
+        unsigned char c = data[i];
+        if ((c < 0x20 && c != '\t' && c != '\n' && c != '\r') || c == 0x7F) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Writes a record's data after the record: text as it is, anything else as
+//  a hex dump in the same layout as %H, with "hex: " before every line
+static void write_data(FILE *file, const char *data, size_t length) {
+    if (is_text(data, length)) {
+        fwrite(data, 1, length, file);
+        if (length == 0 || data[length-1] != '\n') {
+            fputc('\n', file);
+        }
+        return;
+    }
+    size_t i;
+    for (i=0; i<length; i++) {
+        if (i%16 == 0) {
+            fputs(i == 0 ? "hex: " : "\nhex: ", file);
+        } else if (i%4 == 0) {
+            fputc(' ', file);
+        }
+        fprintf(file, "%02X", (unsigned) (data[i] & 0xFF));
+    }
+    fputc('\n', file);
+}
+
+static void format_record(struct log_record *r, struct line_buffer *line) {
+    line->length = 0;
+    int next_arg = 0;
+    const char *p = r->fmt;
+    while (*p != '\0') {
+        const char *literal = p;
+        while (*p != '\0' && *p != '%') {
+            p++;
+        }
+        line_append(line, literal, p - literal);
+        if (*p == '\0') {
+            break;
+        }
+        p++; // Skip '%'
+        char pad = ' ';
+        int width = 0;
+        if (*p == '0') {
+            pad = '0';
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            width = width*10 + (*p - '0');
+            p++;
+        }
+        while (*p == 'l' || *p == 'h' || *p == 'z') {
+            p++; // Every argument is 64 bits anyway
+        }
+        uint64_t arg = 0;
+        if (strchr("diuxXcs", *p) != NULL && next_arg < r->arg_count) {
+            arg = r->args[next_arg++];
+        }
+        char c;
+        switch (*p) {
+            case 'd':
+            case 'i':
+                line_append_number(line, arg, 1, 10, 0, width, pad);
+            break;
+            case 'u':
+                line_append_number(line, arg, 0, 10, 0, width, pad);
+            break;
+            case 'x':
+            case 'X':
+                line_append_number(line, arg, 0, 16, *p == 'X', width, pad);
+            break;
+            case 'c':
+                c = (char) arg;
+                line_append(line, &c, 1);
+            break;
+            case 's':
+                if (arg != 0) {
+                    const char *s = (const char *) (uintptr_t) arg;
+                    line_append(line, s, strlen(s));
+                }
+            break;
+            case 'b':
+                line_append(line, r->blob, strnlen(r->blob, r->blob_length));
+            break;
+            case 'H':
+                line_append_hex(line, r->blob, r->blob_length);
+            break;
+            case 'T': {
+                char time_text[64];
+                time_t seconds = r->timestamp_ns / 1000000000;
+                struct tm tm;
+                localtime_r(&seconds, &tm);
+                size_t n = strftime(time_text, sizeof time_text,
+                        "%a %b %e %H:%M:%S %Y", &tm);
+                line_append(line, time_text, n);
+            }
+            break;
+            case '%':
+                line_append(line, "%", 1);
+            break;
+            case '\0':
+                p--; // Stray '%' at the end
+            break;
+            default:
+                line_append(line, p-1, 2);
+        }
+        p++;
+    }
+    line_append(line, "\n", 1);
+}
+
+// Formats and writes out every record currently in the ring.
+// Returns the number of records written.
+static int log_drain() {
+    pthread_mutex_lock(&log_drain_lock);
+    struct line_buffer line;
+    int count = 0;
+    while (1) {
+        size_t pos = atomic_load_explicit(&log_dequeue_pos,
+                memory_order_relaxed);
+        struct log_record *r = &log_ring[pos & (LOG_RING_SIZE-1)];
+        size_t seq = atomic_load_explicit(&r->sequence, memory_order_acquire);
+        if (seq != pos+1) {
+            break; // Empty (or the next record is still being written)
+        }
+        format_record(r, &line);
+        FILE *file = r->file;
+        char *data = r->data;
+        size_t data_length = r->data_length;
+        atomic_store_explicit(&log_dequeue_pos, pos+1, memory_order_relaxed);
+        atomic_store_explicit(&r->sequence, pos + LOG_RING_SIZE,
+                memory_order_release);
+
+        fwrite(line.text, 1, line.length, stdout);
+        if (file != NULL) {
+            fwrite(line.text, 1, line.length, file);
+        }
+        if (data != NULL) {
+            write_data(stdout, data, data_length);
+            if (file != NULL) {
+                write_data(file, data, data_length);
+            }
+            free(data);
+        }
+        count++;
+    }
+    uint64_t dropped = atomic_exchange(&log_dropped, 0);
+    if (dropped > 0) {
+        fprintf(stdout, "[%" PRIu64 " log records dropped]\n", dropped);
+    }
+    if (count > 0 || dropped > 0) {
+        fflush(NULL); // stdout and every file written to
+    }
+    pthread_mutex_unlock(&log_drain_lock);
+    return count;
+}
+
+static void *log_writer_main(void *arg) {
+    (void) arg;
+    // Leave signals to the router's threads so a handler never runs here
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    // Sleeping between drains lets records pile up into large writes
+    struct timespec interval = { 0, LOG_WRITER_INTERVAL_NS };
+    while (atomic_load(&log_running)) {
+        log_drain();
+        nanosleep(&interval, NULL);
+    }
+    log_drain();
+    return NULL;
+}
+
+void log_init(void) {
+    int i;
+    for (i=0; i<LOG_RING_SIZE; i++) {
+        atomic_init(&log_ring[i].sequence, i);
+    }
+    static char stdout_buffer[LOG_FILE_BUFFER_SIZE];
+    setvbuf(stdout, stdout_buffer, _IOFBF, sizeof stdout_buffer);
+
+    atomic_store(&log_running, 1);
+    int err = pthread_create(&log_writer, NULL, log_writer_main, NULL);
+    if (err != 0) {
+        fprintf(stderr, "Error creating log writer thread: %s\n",
+                strerror(err));
+        exit(1);
+    }
+    atexit(log_shutdown);
+}
+
+void log_shutdown(void) {
+    if (atomic_exchange(&log_running, 0)) {
+        pthread_join(log_writer, NULL);
+    }
+}
+
+FILE *log_open_file(const char *file_name) {
+    FILE *file = fopen(file_name, "w");
+    if (file != NULL) {
+        setvbuf(file, NULL, _IOFBF, LOG_FILE_BUFFER_SIZE);
+    }
+    return file;
+}
@@ -0,0 +1,93 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Asynchronous leveled logging.
+// LOG* macros check the level and, if it is enabled, copy the format pointer
+//  and the arguments into a slot of a lock-free ring. No formatting or I/O
+//  happens on the caller's thread: a background writer thread drains the
+//  ring, formats the records and writes them out in large batches.
+// If the ring is full the record is dropped (and counted) rather than block.
+//
+// Every record is one line on stdout; records sent to a file are written
+//  there as well. Format strings must be string literals (only the pointer is
+//  stored) and support a small printf subset, with every argument widened to
+//  64 bits:
+//      %d %i %u %x %X %c  with optional '0' flag and width
+//      %s                 a string with static lifetime, passed via LOG_STR
+//      %b                 the record's blob as text
+//      %H                 the record's blob as a hex dump
+//      %T                 the time the record was logged
+//      %%
+// The trailing newline is added by the writer.
+//
+// Blobs are for short snippets. LOG_FILE_DATA is for data that must be
+//  logged whole, such as a delivered payload: it is copied to the heap, and
+//  the writer puts it on the lines after the record (which should say how
+//  long it is), as it is if it reads as text, or else as a hex dump with
+//  every line starting "hex: ".
+
+enum log_level {
+    LOG_ERROR = 0,
+    LOG_WARN = 1,
+    LOG_INFO = 2,
+    LOG_DEBUG = 3,
+    LOG_TRACE = 4
+};
+
+#define LOG_MAX_ARGS 6
+#define LOG_BLOB_MAX 128 // Longer blobs are truncated
+
+extern int log_level; // Records above this level are skipped entirely
+
+// Starts the writer thread; also registers log_shutdown with atexit
+void log_init(void);
+
+// Writes out everything logged so far and stops the writer thread
+void log_shutdown(void);
+
+// Parses "error", "warn", "info", "debug" or "trace". Returns -1 if unknown.
+int log_parse_level(const char *name);
+
+// Opens a file for the writer to append records to
+FILE *log_open_file(const char *file_name);
+
+void log_emit(FILE *file, int level, const char *blob, size_t blob_length,
+        const char *fmt, const uint64_t *args, int arg_count);
+void log_emit_data(FILE *file, int level, const char *data,
+        size_t data_length, const char *fmt, const uint64_t *args,
+        int arg_count);
+
+#define LOG_STR(s) ((uint64_t) (uintptr_t) (s))
+
+#define LOG_ENABLED(level) ((level) <= log_level)
+
+// Element 0 is a dummy so that a call with no arguments still works
+#define LOG_ARGS_(...) ((const uint64_t []) {0, ##__VA_ARGS__}) + 1, \
+        (int) (sizeof((uint64_t []) {0, ##__VA_ARGS__}) / sizeof(uint64_t) - 1)
+
+#define LOG_FILE_BLOB(file, level, blob, blob_length, fmt, ...) \
+    do { \
+        if (LOG_ENABLED(level)) { \
+            log_emit((file), (level), (blob), (blob_length), (fmt), \
+                    LOG_ARGS_(__VA_ARGS__)); \
+        } \
+    } while (0)
+
+#define LOG_FILE_DATA(file, level, data, data_length, fmt, ...) \
+    do { \
+        if (LOG_ENABLED(level)) { \
+            log_emit_data((file), (level), (data), (data_length), (fmt), \
+                    LOG_ARGS_(__VA_ARGS__)); \
+        } \
+    } while (0)
+
+#define LOG_FILE(file, level, fmt, ...) \
+    LOG_FILE_BLOB(file, level, NULL, 0, fmt, ##__VA_ARGS__)
+
+#define LOG(level, fmt, ...) \
+    LOG_FILE_BLOB(NULL, level, NULL, 0, fmt, ##__VA_ARGS__)
+
+#endif
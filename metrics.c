@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+#include "router.h"
+
+static const char *const metric_names[METRIC_COUNT] = {
+    [METRIC_RX_DATA] = "rx_data_packets_total",
+    [METRIC_RX_DV] = "rx_dv_packets_total",
+    [METRIC_RX_KILLED] = "rx_killed_packets_total",
+    [METRIC_RX_INITIAL] = "rx_initial_packets_total",
+    [METRIC_RX_DELTA] = "rx_delta_packets_total",
+    [METRIC_RX_RESYNC] = "rx_resync_packets_total",
+    [METRIC_RX_RESTARTING] = "rx_restarting_packets_total",
+    [METRIC_RX_PROBE] = "rx_probe_packets_total",
+    [METRIC_RX_PROBE_REPLY] = "rx_probe_reply_packets_total",
+    [METRIC_RX_VERSION] = "rx_version_packets_total",
+    [METRIC_RX_UNKNOWN] = "rx_unknown_packets_total",
+    [METRIC_FORWARDED] = "data_forwarded_total",
+    [METRIC_DELIVERED] = "data_delivered_total",
+    [METRIC_PROBES_ACKED] = "data_probes_acked_total",
+    [METRIC_DROPPED_MALFORMED] = "data_dropped_malformed_total",
+    [METRIC_DROPPED_TTL] = "data_dropped_ttl_total",
+    [METRIC_UNROUTABLE] = "data_unroutable_total",
+    [METRIC_DATA_DROPPED_OVERFLOW] = "data_dropped_overflow_total",
+    [METRIC_CONTROL_DROPPED_OVERFLOW] = "control_dropped_overflow_total",
+};
+
+void metrics_init(struct metrics *m) {
+    memset(m->counters, 0, sizeof m->counters);
+    histogram_init(&m->packet_ns);
+}
+
+void metrics_count_rx(struct metrics *m, const char *packet, size_t length) {
+    if (length == 0) {
+        metrics_count(m, METRIC_RX_UNKNOWN);
+        return;
+    }
+    switch (packet[0]) {
+        case DATA_PACKET:
+            metrics_count(m, METRIC_RX_DATA);
+        break;
+        case DV_PACKET:
+            metrics_count(m, METRIC_RX_DV);
+        break;
+        case KILLED_PACKET:
+            metrics_count(m, METRIC_RX_KILLED);
+        break;
+        case INITIAL_DV_PACKET:
+            metrics_count(m, METRIC_RX_INITIAL);
+        break;
+        case DV_DELTA_PACKET:
+            metrics_count(m, METRIC_RX_DELTA);
+        break;
+        case DV_RESYNC_PACKET:
+            metrics_count(m, METRIC_RX_RESYNC);
+        break;
+        case RESTARTING_PACKET:
+            metrics_count(m, METRIC_RX_RESTARTING);
+        break;
+        case PROBE_PACKET:
+            metrics_count(m, METRIC_RX_PROBE);
+        break;
+        case PROBE_REPLY_PACKET:
+            metrics_count(m, METRIC_RX_PROBE_REPLY);
+        break;
+        case DV_VERSION_PACKET:
+            metrics_count(m, METRIC_RX_VERSION);
+        break;
+        default:
+            metrics_count(m, METRIC_RX_UNKNOWN);
+    }
+}
+
+void metrics_sum(struct metrics *total, const struct metrics *each,
+        int count) {
+    metrics_init(total);
+    int i, k;
+    for (i=0; i<count; i++) {
+        for (k=0; k<METRIC_COUNT; k++) {
+            total->counters[k] += each[i].counters[k];
+        }
+        histogram_merge(&total->packet_ns, &each[i].packet_ns);
+    }
+}
+
+void metrics_print(FILE *file, const struct metrics *m) {
+    int i;
+    for (i=0; i<METRIC_COUNT; i++) {
+        fprintf(file, "%s %llu\n", metric_names[i],
+                (unsigned long long) m->counters[i]);
+    }
+    const struct histogram *h = &(m->packet_ns);
+    fprintf(file, "packet_ns_count %llu\n", (unsigned long long) h->count);
+    fprintf(file, "packet_ns_sum %llu\n", (unsigned long long) h->sum);
+    fprintf(file, "packet_ns_p50 %llu\n",
+            (unsigned long long) histogram_percentile(h, 50));
+    fprintf(file, "packet_ns_p90 %llu\n",
+            (unsigned long long) histogram_percentile(h, 90));
+    fprintf(file, "packet_ns_p99 %llu\n",
+            (unsigned long long) histogram_percentile(h, 99));
+    fprintf(file, "packet_ns_p999 %llu\n",
+            (unsigned long long) histogram_percentile(h, 99.9));
+    fprintf(file, "packet_ns_max %llu\n", (unsigned long long) h->max);
+}
+
+int metrics_listen(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "Error: Stats socket path %s is too long\n", path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating stats socket");
+        exit(1);
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0
+            || listen(fd, 16) < 0) {
+        perror("Error binding stats socket");
+        exit(1);
+    }
+    return fd;
+}
@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "histogram.h"
+
+// Packet counters and handling times, kept per thread so that counting is a
+//  plain increment on a cache line no other thread writes. They are read
+//  (by the stats socket) without any locking, so a snapshot can be a few
+//  counts out of step with itself, which is fine for monitoring.
+
+enum metric {
+    METRIC_RX_DATA,
+    METRIC_RX_DV,
+    METRIC_RX_KILLED,
+    METRIC_RX_INITIAL,
+    METRIC_RX_DELTA,
+    METRIC_RX_RESYNC,
+    METRIC_RX_RESTARTING,
+    METRIC_RX_PROBE,
+    METRIC_RX_PROBE_REPLY,
+    METRIC_RX_VERSION,
+    METRIC_RX_UNKNOWN, // Empty, or of no known packet type
+    METRIC_FORWARDED,
+    METRIC_DELIVERED,
+    METRIC_PROBES_ACKED,
+    METRIC_DROPPED_MALFORMED,
+    METRIC_DROPPED_TTL,
+    METRIC_UNROUTABLE, // No DV entry for the destination
+    // Dropped by the kernel for lack of receive buffer space
+    METRIC_DATA_DROPPED_OVERFLOW,
+    METRIC_CONTROL_DROPPED_OVERFLOW,
+    METRIC_COUNT
+};
+
+struct metrics {
+    uint64_t counters[METRIC_COUNT];
+    struct histogram packet_ns; // Time spent handling each received packet
+} __attribute__((aligned(64)));
+
+void metrics_init(struct metrics *m);
+
+static inline void metrics_count(struct metrics *m, enum metric which) {
+    m->counters[which]++;
+}
+
+// For counters kept elsewhere, such as by the kernel
+static inline void metrics_set(struct metrics *m, enum metric which,
+        uint64_t value) {
+    m->counters[which] = value;
+}
+
+// Counts a received packet under its type
+void metrics_count_rx(struct metrics *m, const char *packet, size_t length);
+
+static inline uint64_t metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Records the time since *start as one packet's handling time, and starts
+//  timing the next packet. Timing back to back packets this way takes one
+//  clock read per packet.
+static inline void metrics_packet_done(struct metrics *m, uint64_t *start) {
+    uint64_t now = metrics_now_ns();
+    histogram_add(&m->packet_ns, now - *start);
+    *start = now;
+}
+
+// Adds up the metrics of count threads
+void metrics_sum(struct metrics *total, const struct metrics *each,
+        int count);
+
+// Writes the metrics as "name value" lines, the format the stats socket
+//  serves and routerstat reads. Names of counters, which only ever go up,
+//  end in _total, _count or _sum; anything else is a gauge.
+void metrics_print(FILE *file, const struct metrics *m);
+
+// Listens for stats readers on a UNIX stream socket at path, replacing any
+//  stale socket left there. Returns the non-blocking listening socket.
+int metrics_listen(const char *path);
+
+#endif
@@ -6,85 +6,112 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dv_table.h"
+#include "fib.h"
+#include "netio.h"
+#include "qsbr.h"
+#include "logger.h"
+#include "event_loop.h"
+#include "router.h"
+#include "topology.h"
+#include "data_packet.h"
+#include "loadgen.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "forward.h"
+#include "capture.h"
+#include "link_probe.h"
 
 // Size of the buffer for packet payload
 #define BUFFER_SIZE 65536
 
-// Maximum number of routers supported, not including this one
-// (Really only needs to be 5 for the purposes of the project)
-#define DV_CAPACITY 16
-
-#define MAX_LINE_LEN 80 // Max line size in topology file (for fgets)
-#define MAX_BODY_LEN 81 // Max size of msg body of data packet
 #define LOG_FILE_NAME_LEN 256
-#define MAX_POSSIBLE_COST 64
+#define MAX_WORKERS 64
+#define MAX_UPDATE_DELAY_MS 60000
 
-enum packet_type {
-    DATA_PACKET = 1,
-    DV_PACKET = 2,
-    KILLED_PACKET = 3,
-    INITIAL_DV_PACKET = 4
-};
+// Where the stats socket goes unless -s says otherwise; see routerstat.c
+#define STATS_SOCKET_FORMAT "myrouter_%u.sock"
 
-struct dv_entry {
-    uint16_t dest_port;
-    uint16_t first_hop_port;
-    uint32_t cost;
-};
-void ntoh_dv_entry(struct dv_entry *n, struct dv_entry *h) {
-    h->dest_port = ntohs(n->dest_port);
-    h->first_hop_port = ntohs(n->first_hop_port);
-    h->cost = ntohl(n->cost);
-}
-void hton_dv_entry(struct dv_entry *h, struct dv_entry *n) {
-    n->dest_port = htons(h->dest_port);
-    n->first_hop_port = htons(h->first_hop_port);
-    n->cost = htonl(h->cost);
-}
+// Load generator defaults
+#define DEFAULT_LOAD_SIZE 64
+#define DEFAULT_LOAD_DURATION_S 10
+#define LOAD_DRAIN_S 2 // How long to wait for acks after sending
 
-// Linear search of an array of DV entries
-struct dv_entry *
-dv_find(struct dv_entry *dv, int dv_length, uint16_t dest_port) {
-    int i;
-    for (i=0; i<dv_length; i++) {
-        if (dv[i].dest_port == dest_port) {
-            return &(dv[i]);
-        }
-    }
-    return NULL;
-}
+// Equal-cost next hops data packets are spread over
+#define DEFAULT_MAX_PATHS 4
 
-// Singly linked list of information about neighboring nodes
-struct neighbor_list_node {
-    uint16_t port;
-    uint32_t cost;
-    struct dv_entry *dv; // The neighbor node's DV (an array of DV entries)
-    int dv_length; // Number of entries in the neighbor node's DV
-    struct neighbor_list_node *next;
-};
+// Full DVs are re-sent this often, in case a delta or a resync got lost
+#define DEFAULT_REFRESH_INTERVAL_S 30
 
-struct neighbor_list_node *
-neighbor_list_find(struct neighbor_list_node *list_head, uint16_t port) {
-    struct neighbor_list_node *node = list_head;
-    for (; node!=NULL; node = node->next) {
-        if (node->port == port) {
-            return node;
-        }
-    }
-    return NULL;
-}
+// Routes are checkpointed to the snapshot at most this often
+#define CHECKPOINT_DELAY_MS 1000
+
+// How often the capture ring is checked for a full half to write out, in
+//  case the control thread has nothing else to do
+#define CAPTURE_CHECK_INTERVAL_MS 1000
 
 //-----------------------------------------------------------------------------
 // Global variables
-char my_label; // used find immediate neighbors in topology files
-// Note: we assume node names are single char
+char *my_name; // This router's name in the topology file
 uint16_t my_port;
-struct dv_entry my_dv[DV_CAPACITY];
-int my_dv_length = 0;
-struct neighbor_list_node *my_neighbor_list_head = NULL;
+const char *my_topology_file_name = "sample_topology.txt";
+struct topology my_topology;
+struct router my_router; // The DV protocol, driven by the socket and timers
+struct forward_node my_node; // Forwards data packets with a FIB of my DV
+int my_max_paths = DEFAULT_MAX_PATHS; // Next hops per destination in the FIB
 int my_socket_fd; // Needs to be global for sig handler
+int my_batch_size = DEFAULT_BATCH_SIZE; // Datagrams per recvmmsg/sendmmsg
+struct rx_batch my_rx_batch;
+struct tx_queue my_tx_queue; // Data packets sent while handling a batch
+uint16_t my_control_port_offset = DEFAULT_CONTROL_PORT_OFFSET;
+int my_control_fd; // Socket on the control port, or my_socket_fd if shared
+struct rx_batch my_control_rx_batch;
+struct tx_queue my_control_tx_queue; // Everything the router sends
+int my_data_rcvbuf = 0; // SO_RCVBUF of the data socket(s); 0 keeps the default
+int my_control_rcvbuf = 0;
+int my_worker_count = 0; // Data plane threads; 0 means single-threaded
+struct qsbr my_qsbr; // Reclaims FIB generations the workers may still read
+int my_min_update_delay_ms = DEFAULT_MIN_UPDATE_DELAY_MS;
+int my_max_update_delay_ms = DEFAULT_MAX_UPDATE_DELAY_MS;
+int my_refresh_interval_s = DEFAULT_REFRESH_INTERVAL_S; // 0 means never
+int my_aggregate = 0; // DV messages carry ranges of destinations
+int my_feasibility = 0; // Only feasible routes are taken
+struct event_loop my_event_loop;
+struct event_source my_socket_source; // Router socket or worker handoff
+struct event_source my_control_source;
+struct event_timer my_update_timer; // Fires when the hold-down expires
+struct event_timer my_refresh_timer;
+struct event_signals my_shutdown_signals;
+const char *my_snapshot_path; // Checkpoint for warm restarts, or NULL
+struct event_timer my_checkpoint_timer;
+int my_checkpoint_pending = 0;
+const char *my_capture_prefix; // Capture files are <prefix>.<n>.pcapng
+int my_capture_packets = CAPTURE_DEFAULT_PACKETS; // Per half of the ring
+struct capture my_capture;
+int my_capture_files = 0; // Files written so far
+struct event_timer my_capture_timer;
+struct event_signals my_capture_signals; // SIGUSR2 writes the capture out
+int my_probe_interval_ms = 0; // Link costs follow measured RTTs unless 0
+int my_rtt_per_cost_us = LINK_PROBE_DEFAULT_RTT_PER_COST_US;
+int my_hysteresis_percent = LINK_PROBE_DEFAULT_HYSTERESIS_PERCENT;
+struct link_prober my_prober;
+struct event_timer my_probe_timer;
+struct metrics my_metrics[MAX_WORKERS + 1]; // The control thread's, then
+                                            //  each worker's
+const char *my_stats_path; // UNIX socket the stats are served on
+struct event_source my_stats_source;
+uint64_t my_start_ms;
+struct loadgen_config my_load = { // Load generator settings from the options
+    .duration_s = DEFAULT_LOAD_DURATION_S,
+    .drain_s = LOAD_DRAIN_S,
+    .seed = 1,
+};
 FILE *log_file;
 //-----------------------------------------------------------------------------
 
@@ -100,333 +127,215 @@ void send_message(int socket_fd, char *message, size_t message_length,
     }
 }
 
-void print_my_dv() {
-    fprintf(stdout, "Entries in my DV:\n");
-    fprintf(log_file, "Entries in my DV:\n");
+//-----------------------------------------------------------------------------
+// What the router needs from the socket and the event loop
 
-    int i;
-    for (i = 0; i < my_dv_length; i++) {
-        fprintf(stdout, "Dest port %u first hop port %u cost %u\n",
-                my_dv[i].dest_port, my_dv[i].first_hop_port, my_dv[i].cost);
-        fprintf(log_file, "Dest port %u first hop port %u cost %u\n",
-                my_dv[i].dest_port, my_dv[i].first_hop_port, my_dv[i].cost);
-    }
-    fprintf(log_file, "\n");
-    fflush(log_file);
+static char *router_reserve(void *ctx, size_t size) {
+    (void) ctx;
+    return tx_queue_reserve(&my_control_tx_queue, size);
 }
 
-void create_dv_message(char *buffer, enum packet_type type) {
-    // See comment on message format
-    buffer[0] = (char) type;
-    struct dv_entry *dv = ((struct dv_entry *) buffer)+1;
-    int i;
-    for (i=0; i<my_dv_length; i++) {
-        hton_dv_entry(&(my_dv[i]), &(dv[i]));
-    }
+static unsigned long router_flush_count(void *ctx) {
+    (void) ctx;
+    return my_control_tx_queue.flush_count;
 }
 
-void send_my_dv(int socket_fd, uint16_t dest_port) {
-    printf("Sending DV to port %u\n", dest_port);
-    char message[(DV_CAPACITY+1)*(sizeof(struct dv_entry))];
-    create_dv_message(message, DV_PACKET);
-
-    send_message(socket_fd, message,
-            (my_dv_length+1)*(sizeof(struct dv_entry)), dest_port);
+static void router_send_parts(void *ctx, const char *head, size_t head_length,
+        const char *body, size_t body_length, uint16_t dest_port) {
+    (void) ctx;
+    tx_queue_add_parts(&my_control_tx_queue, head, head_length, body,
+            body_length, dest_port + my_control_port_offset);
 }
 
-void broadcast_my_dv(int socket_fd, enum packet_type type) {
-    printf("Sending DV broadcast\n");
-    char message[(DV_CAPACITY+1)*(sizeof(struct dv_entry))];
-    create_dv_message(message, type);
-
-    struct neighbor_list_node *node = my_neighbor_list_head;
-    for (; node!=NULL; node = node->next) {
-        send_message(socket_fd, message,
-                (my_dv_length+1)*(sizeof(struct dv_entry)), node->port);
-    }
+static uint64_t router_now_ms(void *ctx) {
+    (void) ctx;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
-// Returns 1 if DV was changed.
-// Returns 0 if not.
-// Returns a negative number if an error occured.
-int bellman_ford_decrease(uint16_t dest_port, uint16_t sender_port,
-        uint32_t cost_thru_sender) {
-    if (dest_port == my_port) {
-        return 0;
-    }
-    struct dv_entry *e = dv_find(my_dv, my_dv_length, dest_port);
-    if (e == NULL) {
-        if (cost_thru_sender >= MAX_POSSIBLE_COST) {
-            return 0;
-        }
-        if (my_dv_length >= DV_CAPACITY) {
-            // Not necessarily the right thing to do
-            printf("Warning: DV is full, new entry is discarded\n");
-            return -1;
-        } else {
-            my_dv[my_dv_length].dest_port = dest_port;
-            my_dv[my_dv_length].first_hop_port = sender_port;
-            my_dv[my_dv_length].cost = cost_thru_sender;
-            printf("DV update: New entry: Dest %u first hop %u cost %u\n",
-                    my_dv[my_dv_length].dest_port,
-                    my_dv[my_dv_length].first_hop_port,
-                    my_dv[my_dv_length].cost);
-            my_dv_length++;
-            return 1;
-        }
-    } else if (cost_thru_sender >= MAX_POSSIBLE_COST) {
-        // The target is now unreachable, so delete its entry from
-        //  my_dv. We'll do this by moving the last entry into the
-        //  deleted entry's slot.
-        printf("DV update: Deletion: Dest %u no longer reachable\n",
-                dest_port);
-        *e = my_dv[my_dv_length-1];
-        my_dv_length--;
-        return 1;
-    } else if (cost_thru_sender < e->cost) {
-        printf("DV update: Entry for dest %u changed ", dest_port);
-        printf("    from first hop %u cost %u ", e->first_hop_port, e->cost);
-        e->first_hop_port = sender_port;
-        e->cost = cost_thru_sender;
-        printf("    to first hop %u cost %u ", e->first_hop_port, e->cost);
-        return 1;
-    } else {
-        return 0;
-    }
+static void router_set_update_timer(void *ctx, uint64_t delay_ms) {
+    (void) ctx;
+    event_timer_arm(&my_update_timer, delay_ms, 0);
 }
 
-// DV message format:
-// 1 byte indicating that this is a DV packet
-// Padding to fill the length of a dv_entry
-// 0 or more DV entries
-//
-// Returns the number of changes made to the DV, or a negative number if error
-int handle_dv_packet(uint16_t sender_port, char *buffer,
-        ssize_t bytes_received) {
-    if (bytes_received % sizeof(struct dv_entry) != 0) {
-        printf("Message not understood, length is not multiple of dv entry size\n");
-        return -1;
+static void router_routes_changed(void *ctx) {
+    (void) ctx;
+    forward_update_fib(&my_node, &my_router, my_max_paths, &my_qsbr);
+    if (my_snapshot_path != NULL && !my_checkpoint_pending) {
+        my_checkpoint_pending = 1;
+        event_timer_arm(&my_checkpoint_timer, CHECKPOINT_DELAY_MS, 0);
     }
-    printf("DV packet from port %u:\n", sender_port);
-
-    struct neighbor_list_node *sender =
-            neighbor_list_find(my_neighbor_list_head, sender_port);
-    if (sender == NULL) {
-        // Not necessarily the right thing to do
-        printf("Warning: Sender is not a known neighbor; ignoring its message\n");
-        return -1;
-    }
-
-    int received_dv_length = (bytes_received / sizeof(struct dv_entry)) - 1;
-    if (received_dv_length > DV_CAPACITY) {
-        printf("Received DV has %d entries, which exceeds the capacity of %d\n",
-                received_dv_length, DV_CAPACITY);
-        return -1;
-    }
-
-    struct dv_entry *raw_received_dv = ((struct dv_entry *) buffer) + 1;
-    int i;
-    for (i=0; i<received_dv_length; i++) {
-        ntoh_dv_entry(&(raw_received_dv[i]), &(sender->dv[i]));
-    }
-    sender->dv_length = received_dv_length;
-
-    for (i=0; i<sender->dv_length; i++) {
-        printf("Entry: Dest port %u first hop port %u cost %u\n",
-                sender->dv[i].dest_port, sender->dv[i].first_hop_port,
-                sender->dv[i].cost);
-    }
-
-    int change_count = 0;
-    
-    // The Bellman-Ford part operates in two parts:
-    // First, look for all entries in the current DV which have their first hop
-    //  designated as the sender (unless the first hop is the sender itself).
-    // If the DV received from the sender causes that cost to *increase*, then
-    //  we have to look at the DVs from all the neighbors to see who now gives
-    //  the lowest cost (or if the target is now unreachable altogether).
-    i = 0;
-    while(i<my_dv_length) {
-        if (my_dv[i].first_hop_port == sender_port &&
-                my_dv[i].dest_port != sender_port) {
-            struct dv_entry *senders_entry =
-                    dv_find(sender->dv, sender->dv_length, my_dv[i].dest_port);
-            if (senders_entry==NULL ||
-                    sender->cost + senders_entry->cost > my_dv[i].cost) {
-                uint32_t min_cost = UINT32_MAX;
-                uint16_t best_first_hop_port;
-                int is_reachable = 0;
-                struct neighbor_list_node *neighbor;
-                for (neighbor = my_neighbor_list_head; neighbor != NULL;
-                        neighbor = neighbor->next) {
-                    struct dv_entry *neighbors_entry = dv_find(neighbor->dv,
-                            neighbor->dv_length, my_dv[i].dest_port);
-                    if (neighbors_entry!=NULL &&
-                            neighbors_entry->cost + neighbor->cost < min_cost) {
-                        min_cost = neighbors_entry->cost + neighbor->cost;
-                        best_first_hop_port = neighbor->port;
-                        is_reachable = 1;
-                    }
-                }
-                if (is_reachable && min_cost < MAX_POSSIBLE_COST) {
-                    my_dv[i].first_hop_port = best_first_hop_port;
-                    my_dv[i].cost = min_cost;
-                    change_count++;
-                    i++;
-                } else {
-                    // The target is now unreachable, so delete its entry from
-                    //  my_dv. We'll do this by moving the last entry into the
-                    //  deleted entry's slot.
-                    printf("DV update: Deletion: Dest %u no longer reachable\n",
-                            my_dv[i].dest_port);
-                    my_dv[i] = my_dv[my_dv_length-1];
-                    my_dv_length--;
-                    change_count++;
-                    // i remains unchanged
-                }
-            } else {
-                i++;
-            }
-        } else {
-            i++;
-        }
-    }
-    // Second, we do the standard Bellman-Ford: If the cost to go through the
-    //  sender is now better than the old cost, then update the DV entry.
-    for (i=0; i < sender->dv_length; i++) {
-        uint16_t dest_port = sender->dv[i].dest_port;
-        uint32_t cost_thru_sender = sender->cost + sender->dv[i].cost;
-        if(bellman_ford_decrease(dest_port, sender_port,
-                cost_thru_sender) > 0) {
-            change_count++;
-        }
-    }
-    // Finally, if my DV doesn't have an entry for the sender itself (because
-    //  previously the sender was not alive), add an entry.
-    if (bellman_ford_decrease(sender_port, sender_port, sender->cost) > 0) {
-        change_count++;        
-    }
-
-    if (change_count > 0) {
-        print_my_dv();
-    } else {
-        printf("DV did not change\n");
-    }
-    return change_count;
 }
 
-// handle SIGINT, SIGQUIT, SIGTERM by informing neighbors the router is killed
-// Note: the SIGKILL signal (posix) can't be handled/caught
-void handle_kill_signal(int sig) {
-
-    // send dying message to all neighbors
-    // message consists of KILLED_PACKET, padded to length of single dv_entry
-
-    printf("Sending Killed broadcast\n");
-    char message = KILLED_PACKET;
+const struct router_ops my_router_ops = {
+    router_reserve,
+    router_flush_count,
+    router_send_parts,
+    router_now_ms,
+    router_set_update_timer,
+    router_routes_changed
+};
 
-    struct neighbor_list_node *node = my_neighbor_list_head;
-    for (; node!=NULL; node = node->next) {
-        send_message(my_socket_fd, &message, 1, node->port);
-    }
+void handle_update_timer(void *arg) {
+    (void) arg;
+    router_update_timer_expired(&my_router);
+    tx_queue_flush(&my_control_tx_queue);
+}
 
-    signal(sig, SIG_DFL); // Restore default behavior
-    raise(sig);
-    return;
+void handle_refresh_timer(void *arg) {
+    (void) arg;
+    router_refresh(&my_router);
+    tx_queue_flush(&my_control_tx_queue);
 }
 
-void handle_killed_packet(uint16_t sender_port) {
-    // Note: doesn't matter what rest of message is, just that neighbor was killed
-    printf("Killed_packet from port %u:\n", sender_port);
+void handle_probe_timer(void *arg) {
+    (void) arg;
+    link_prober_tick(&my_prober, metrics_now_ns());
+    router_end_batch(&my_router);
+    tx_queue_flush(&my_control_tx_queue);
+}
 
-    struct neighbor_list_node *sender =
-            neighbor_list_find(my_neighbor_list_head, sender_port);
-    if (sender == NULL) {
-        // Not necessarily the right thing to do
-        printf("Warning: Sender is not a known neighbor; ignoring its message\n");
-        return;
-    }
+void handle_checkpoint_timer(void *arg) {
+    (void) arg;
+    my_checkpoint_pending = 0;
+    snapshot_save(&my_router, my_snapshot_path);
+}
 
-    // Dead neighbor is now unreachable, so delete its entry from my_dv. We'll
-    //  do this by moving the last entry into the deleted entry's slot.
-    struct dv_entry *to_delete = dv_find(my_dv, my_dv_length, sender->port);
-    if (to_delete == NULL) {
-        printf("Warning: Sender not found in my_dv, may have already been removed\n");
-        return;
+// Writes what has been captured to the next capture file
+void dump_capture() {
+    int written = capture_dump(&my_capture, my_capture_prefix,
+            my_capture_files);
+    if (written >= 0) {
+        LOG(LOG_INFO, "Wrote %d captured packets to %s.%d.pcapng", written,
+                LOG_STR(my_capture_prefix), my_capture_files);
+        my_capture_files++;
     }
-    printf("DV update: Deletion: Neighbor %u died\n", to_delete->dest_port);
-
-    // Update rest of DV table (anything with dead neighbor as first hop is affected)
-    // use dummy buffer to call BF alg in handle_dv_packet
-    char buffer[sizeof(struct dv_entry)]; // buffer the size of dv entry
-    handle_dv_packet(sender_port, buffer, sizeof(struct dv_entry));
+}
 
-    to_delete = dv_find(my_dv, my_dv_length, sender->port);
-    if (to_delete != NULL) {
-        printf("Neighbor %u didn't get deleted first time, deleting now\n", sender_port);
-        *to_delete = my_dv[my_dv_length-1];
-        my_dv_length--;
+// Called after every batch: half the ring has filled up, so write it out
+//  before the other half does too
+static inline void rotate_capture() {
+    if (my_capture_prefix != NULL && capture_full(&my_capture)) {
+        dump_capture();
     }
+}
 
-    broadcast_my_dv(my_socket_fd, DV_PACKET);
-    printf("Finished dv_table update and broadcast following Killed_packet from port %u:\n", sender_port);
+void handle_capture_timer(void *arg) {
+    (void) arg;
+    rotate_capture();
+}
 
-    return;
+void handle_capture_signal(void *arg, int sig) {
+    (void) arg;
+    (void) sig;
+    dump_capture();
 }
 
-void print_hexadecimal(char *bytes, int length) {
-    int i;
-    for (i=0; i<length; i++) {
-        if (i!=0) {
-            if (i%16 == 0)
-                printf("\n");
-            else if (i%4 == 0)
-                printf(" ");
+// SIGINT, SIGQUIT, SIGTERM and SIGUSR1 arrive through the event loop, so
+//  this is an ordinary function rather than a signal handler: inform
+//  neighbors the router is killed and stop the loop. SIGUSR1 stops it for a
+//  warm restart instead: the snapshot is brought up to date and neighbors
+//  are asked to keep our routes until we're back.
+// Note: the SIGKILL signal (posix) can't be handled/caught
+void handle_shutdown_signal(void *arg, int sig) {
+    (void) arg;
+    if (sig == SIGUSR1 && my_snapshot_path != NULL
+            && snapshot_save(&my_router, my_snapshot_path) == 0) {
+        LOG(LOG_INFO, "Caught signal %d, stopping for a warm restart", sig);
+        router_restart(&my_router);
+    } else {
+        LOG(LOG_INFO, "Caught signal %d, shutting down", sig);
+        router_shutdown(&my_router);
+        // Neighbors drop our routes, so a restart has to start cold
+        if (my_snapshot_path != NULL) {
+            unlink(my_snapshot_path);
         }
-        printf("%02X", bytes[i] & 0xFF);
     }
+    event_loop_stop(&my_event_loop);
 }
 
-void handle_data_packet( uint16_t sender_port, char *buffer ){
-
-    char bodybuf[81]; 
-    strncpy(bodybuf, buffer+5, MAX_BODY_LEN); //message body
-    //uint16_t dest_port = buffer[2] | uint16_t(buffer[3]) << 8;
-    uint16_t dest_port = ntohs(*((uint16_t *) &(buffer[3])));
-    //check if we are at at the destined router
-
-    time_t ltime;
-    ltime = time(NULL);
-
-    fprintf(log_file, "Timestamp %s sourceID %c destID %c arrivalPort %u prevPort %u\n", 
-        asctime(localtime(&ltime)) , buffer[1], buffer[2], my_port, sender_port);
-    fflush(log_file);
-    printf("Timestamp %s sourceID %c destID %c arrivalPort %u prevPort %u\n", 
-        asctime(localtime(&ltime)) , buffer[1], buffer[2], my_port, sender_port);
+//-----------------------------------------------------------------------------
+// Stats socket
+//
+// Every connection gets one snapshot of the metrics (see metrics.h) and is
+//  closed; routerstat reads it. The snapshot is far smaller than a socket
+//  buffer, so writing it never blocks the control thread.
+
+void print_stats(FILE *file) {
+    struct metrics total;
+    metrics_sum(&total, my_metrics, my_worker_count + 1);
+    int neighbor_count = 0;
+    int neighbors_up = 0;
+    struct neighbor_list_node *node = my_router.neighbors;
+    for (; node!=NULL; node = node->next) {
+        neighbor_count++;
+        neighbors_up += node->up;
+    }
+    const struct router_stats *stats = &my_router.stats;
+    fprintf(file, "port %u\n", my_port);
+    fprintf(file, "uptime_ms %llu\n", (unsigned long long)
+            (router_now_ms(NULL) - my_start_ms));
+    fprintf(file, "workers %d\n", my_worker_count);
+    fprintf(file, "neighbors %d\n", neighbor_count);
+    fprintf(file, "neighbors_up %d\n", neighbors_up);
+    fprintf(file, "dv_entries %d\n", my_router.dv.length);
+    fprintf(file, "fib_generation %u\n", my_node.fib_generation);
+    fprintf(file, "fib_multipath_destinations %d\n",
+            fib_current(&my_node.fib)->group_count);
+    fprintf(file, "dv_messages_sent_total %llu\n",
+            (unsigned long long) stats->messages_sent);
+    fprintf(file, "dv_bytes_sent_total %llu\n",
+            (unsigned long long) stats->bytes_sent);
+    fprintf(file, "dv_messages_received_total %llu\n",
+            (unsigned long long) stats->messages_received);
+    fprintf(file, "dv_bytes_received_total %llu\n",
+            (unsigned long long) stats->bytes_received);
+    fprintf(file, "dv_route_changes_total %llu\n",
+            (unsigned long long) stats->route_changes);
+    fprintf(file, "dv_recomputations_total %llu\n",
+            (unsigned long long) stats->recomputations);
+    fprintf(file, "dv_broadcasts_total %llu\n",
+            (unsigned long long) stats->broadcasts);
+    fprintf(file, "capture_files_total %d\n", my_capture_files);
+    fprintf(file, "capture_overwritten_total %llu\n",
+            (unsigned long long) my_capture.overwritten);
+    fprintf(file, "link_probes_sent_total %llu\n",
+            (unsigned long long) my_prober.stats.probes_sent);
+    fprintf(file, "link_probe_replies_total %llu\n",
+            (unsigned long long) my_prober.stats.replies);
+    fprintf(file, "link_cost_changes_total %llu\n",
+            (unsigned long long) my_prober.stats.cost_changes);
+    fprintf(file, "link_cost_changes_damped_total %llu\n",
+            (unsigned long long) my_prober.stats.changes_damped);
+    metrics_print(file, &total);
+}
 
-    if ( dest_port != my_port ){
-        struct dv_entry *dv = dv_find(my_dv, my_dv_length, dest_port);
-        if (dv == NULL) {
-            fprintf(stderr, "DV entry not found for destination port %u\n", dest_port);
-            return;
+void handle_stats_ready(struct event_source *source, uint32_t events) {
+    (void) events;
+    int fd;
+    while ((fd = accept4(source->fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        FILE *file = fdopen(fd, "w");
+        if (file == NULL) {
+            close(fd);
+            continue;
         }
-
-        uint16_t next_port = dv->first_hop_port;
-        fprintf(log_file, "next port %u\n", next_port);
-        fflush(log_file);
-
-        printf("next port %u\n", next_port);
-        size_t msg_sz = 5*sizeof(char) + MAX_BODY_LEN + 1;
-        send_message(my_socket_fd, buffer, msg_sz, next_port);
+        print_stats(file);
+        fclose(file);
     }
-    else {
-        fprintf(log_file, "%s\n", bodybuf);
-        fflush(log_file); // force it to write
-        printf("Received message!\n%s\n", bodybuf);
-    }
-
+}
 
+void start_stats_socket() {
+    static char default_path[LOG_FILE_NAME_LEN];
+    if (my_stats_path == NULL) {
+        snprintf(default_path, sizeof default_path, STATS_SOCKET_FORMAT,
+                my_port);
+        my_stats_path = default_path;
+    }
+    event_loop_add(&my_event_loop, &my_stats_source,
+            metrics_listen(my_stats_path), EPOLLIN, handle_stats_ready, NULL);
 }
+//-----------------------------------------------------------------------------
 
 // Send a UDP packet in Bash using
 //      echo -n "Test" > /dev/udp/localhost/10001
@@ -435,202 +344,347 @@ void handle_data_packet( uint16_t sender_port, char *buffer ){
 // Or instead of "... > /dev/udp/localhost/10001", use
 //      ... | nc -u -p 12345 -w0 localhost 10001
 // to specify the sending port (here, 12345) and not be Bash-specific.
-void server_loop(int socket_fd) {
-    char buffer[BUFFER_SIZE];
-    struct sockaddr_in remote_addr;
-    socklen_t remote_addr_len = sizeof remote_addr;
-    ssize_t bytes_received = recvfrom(socket_fd, buffer, BUFFER_SIZE, 0,
-            (struct sockaddr *) &remote_addr, &remote_addr_len);
-    if (bytes_received < 0) {
-        perror("Error receiving data");
-        return;
+void handle_packet(char *buffer, ssize_t bytes_received,
+        struct sockaddr_in remote_addr) {
+    uint16_t sender_port = ntohs(remote_addr.sin_port);
+    metrics_count_rx(&my_metrics[0], buffer, bytes_received);
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        uint32_t sender_ip_addr = ntohl(remote_addr.sin_addr.s_addr);
+        LOG(LOG_DEBUG, "Received %d bytes from IP address %u.%u.%u.%u port %u:",
+                (int) bytes_received, (sender_ip_addr>>24) & 0xFF,
+                (sender_ip_addr>>16) & 0xFF, (sender_ip_addr>>8) & 0xFF,
+                sender_ip_addr & 0xFF, sender_port);
+        LOG_FILE_BLOB(NULL, LOG_TRACE, buffer, bytes_received,
+                "Hexadecimal:\n%H");
     }
 
-    uint16_t sender_port = ntohs(remote_addr.sin_port);
-    uint32_t sender_ip_addr = ntohl(remote_addr.sin_addr.s_addr);
-    unsigned char ip_bytes[4];
-    ip_bytes[0] = sender_ip_addr & 0xFF;
-    ip_bytes[1] = (sender_ip_addr>>8) & 0xFF;
-    ip_bytes[2] = (sender_ip_addr>>16) & 0xFF;
-    ip_bytes[3] = (sender_ip_addr>>24) & 0xFF;
-
-    printf("Received %d bytes ", (int) bytes_received);
-    printf("from IP address %u.%u.%u.%u ",
-            ip_bytes[3], ip_bytes[2], ip_bytes[1], ip_bytes[0]);
-    printf("port %u:\n", sender_port);
-    // printf("ASCII: %.*s\n", (int) bytes_received, buffer);
-    printf("Hexadecimal:\n");
-    print_hexadecimal(buffer, bytes_received);
-    printf("\n");
-
-    if (bytes_received == 0) {
-        printf("Message not understood, 0 bytes received\n");
+    if (bytes_received > 0 && buffer[0] == DATA_PACKET) {
+        LOG(LOG_DEBUG, "Data packet received");
+        forward_data_packet(&my_node, sender_port, buffer, bytes_received,
+                &my_tx_queue, &my_metrics[0]);
+        return;
+    }
+    if (bytes_received > 0 && buffer[0] == PROBE_REPLY_PACKET
+            && my_probe_interval_ms > 0) {
+        link_prober_handle_reply(&my_prober, sender_port, buffer,
+                bytes_received, metrics_now_ns());
         return;
     }
+    router_handle_packet(&my_router, sender_port, buffer, bytes_received);
+}
 
-    switch (buffer[0]) {
-        case DATA_PACKET:
-            printf("Data packet received\n");
-            handle_data_packet(sender_port, buffer);
-        break;
-        case DV_PACKET:
-            if (handle_dv_packet(sender_port, buffer, bytes_received) > 0) {
-                broadcast_my_dv(socket_fd, DV_PACKET);
+// Handles everything waiting on the control socket, which doesn't block.
+// Control packets never queue behind data packets this way: this runs
+//  whenever the control socket is readable, and before every batch of data
+//  packets besides. When data comes in faster than it can be forwarded, the
+//  data socket's receive buffer (-B) fills up and the kernel drops the
+//  newest data packets, which the data_dropped_overflow_total metric counts.
+// The caller ends the batch.
+void drain_control() {
+    int count;
+    do {
+        // Data forwarded from the batch buffers goes before they're reused
+        tx_queue_flush(&my_tx_queue);
+        count = rx_batch_receive(my_control_fd, &my_control_rx_batch);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Error receiving control packets");
             }
-        break;
-        case KILLED_PACKET:
-            handle_killed_packet(sender_port);
-        break;
-        case INITIAL_DV_PACKET:
-            if (handle_dv_packet(sender_port, buffer, bytes_received) > 0) {
-                broadcast_my_dv(socket_fd, DV_PACKET);
-            } else {
-                send_my_dv(socket_fd, sender_port);
-            }
-        break;
-        default:
-            printf("Message not understood, packet type not recognized\n");
+            break;
+        }
+        uint64_t start = metrics_now_ns();
+        int i;
+        for (i=0; i<count; i++) {
+            // They come from the sender's control port
+            struct sockaddr_in remote_addr =
+                    *rx_batch_addr(&my_control_rx_batch, i);
+            remote_addr.sin_port = htons(ntohs(remote_addr.sin_port)
+                    - my_control_port_offset);
+            handle_packet(rx_batch_buffer(&my_control_rx_batch, i),
+                    rx_batch_length(&my_control_rx_batch, i), remote_addr);
+            metrics_packet_done(&my_metrics[0], &start);
+        }
+    } while (count == my_control_rx_batch.capacity);
+    metrics_set(&my_metrics[0], METRIC_CONTROL_DROPPED_OVERFLOW,
+            my_control_rx_batch.drops);
+}
+
+void handle_control_ready(struct event_source *source, uint32_t events) {
+    (void) source;
+    (void) events;
+    drain_control();
+    router_end_batch(&my_router);
+    tx_queue_flush(&my_tx_queue);
+    tx_queue_flush(&my_control_tx_queue);
+    rotate_capture();
+}
+
+// Receives a batch of up to my_batch_size datagrams, handles each of them and
+//  then sends out everything they produced in one go
+void server_loop(int socket_fd) {
+    if (my_control_fd != socket_fd) {
+        drain_control();
+    }
+    int count = rx_batch_receive(socket_fd, &my_rx_batch);
+    if (count < 0) {
+        perror("Error receiving data");
+        return;
     }
-    printf("\n");
+    metrics_set(&my_metrics[0], METRIC_DATA_DROPPED_OVERFLOW,
+            my_rx_batch.drops);
+    uint64_t start = metrics_now_ns();
+    int i;
+    for (i=0; i<count; i++) {
+        handle_packet(rx_batch_buffer(&my_rx_batch, i),
+                rx_batch_length(&my_rx_batch, i),
+                *rx_batch_addr(&my_rx_batch, i));
+        metrics_packet_done(&my_metrics[0], &start);
+    }
+    router_end_batch(&my_router);
+    tx_queue_flush(&my_tx_queue);
+    tx_queue_flush(&my_control_tx_queue);
+    rotate_capture();
 }
 
 
-struct neighbor_list_node *
-new_neighbor_list_node(uint16_t port, uint16_t cost,
-        struct neighbor_list_node *next) {
-    struct neighbor_list_node *n = malloc(sizeof(struct neighbor_list_node));
-    if (n==NULL) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
+// Asks for a receive buffer of size bytes (0 leaves the default), and says
+//  what the kernel made of it
+void set_receive_buffer(int socket_fd, int size, const char *what) {
+    if (size > 0 && setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &size,
+            sizeof size) < 0) {
+        perror("Error setting SO_RCVBUF");
         exit(1);
     }
-    n->port = port;
-    n->cost = cost;
-    n->dv = malloc(DV_CAPACITY * sizeof(struct dv_entry));
-    if (n->dv == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        exit(1);
+    int actual;
+    socklen_t length = sizeof actual;
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &actual, &length) == 0) {
+        // The kernel doubles the size for its bookkeeping, and caps it at
+        //  net.core.rmem_max
+        LOG(LOG_INFO, "Receive buffer of the %s socket is %d bytes",
+                LOG_STR(what), actual);
     }
-    n->dv_length = 0;
-    n->next = next;
-    return n;
 }
 
-void find_label(const char *file_name) {
-    // find first edge where dest port matches this router's port
-    // the dest label is then the label corresponding to this port
-
-    FILE* f = fopen(file_name, "rt");
-    char line[MAX_LINE_LEN];
+//-----------------------------------------------------------------------------
+// Multi-threaded data plane (-w)
+//
+// Each worker owns a SO_REUSEPORT socket bound to my_port, so the kernel
+//  spreads incoming datagrams over the workers by source address. Workers
+//  forward DATA_PACKETs themselves using the published FIB and pass every
+//  other packet, prefixed with the sender's address, to the control thread
+//  over a datagram socketpair.
+// The control thread alone owns my_router; it sends through the first
+//  worker's socket.
+
+struct worker {
+    pthread_t thread;
+    int socket_fd;
+    struct qsbr_reader *reader;
+    struct rx_batch rx_batch;
+    struct tx_queue tx_queue;
+    struct metrics *metrics;
+};
 
-    while (fgets(line, MAX_LINE_LEN, f) != NULL) {
-        char src;
-        char dest;
-        uint16_t port;
-        uint16_t cost;
+struct worker *my_workers;
+int my_handoff_fds[2]; // Workers write to [1], the control thread reads [0]
+
+void hand_off_to_control(char *buffer, ssize_t bytes_received,
+        struct sockaddr_in *remote_addr) {
+    struct iovec iov[2];
+    iov[0].iov_base = remote_addr;
+    iov[0].iov_len = sizeof(struct sockaddr_in);
+    iov[1].iov_base = buffer;
+    iov[1].iov_len = bytes_received;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    // Blocks if the control thread falls behind, rather than lose an update
+    if (sendmsg(my_handoff_fds[1], &msg, 0) < 0) {
+        perror("Error handing packet to control thread");
+    }
+}
 
-        if (sscanf(line, "%c,%c,%" SCNd16 ",%" SCNd16 "", &src, &dest, &port, &cost) < 4){
-            fprintf(stderr, "Error: cannot read network topology file");
-            exit(1);
+void *worker_main(void *arg) {
+    struct worker *w = arg;
+    while (1) {
+        // Nothing is held while blocked, so don't hold up FIB reclamation
+        qsbr_offline(w->reader);
+        int count = rx_batch_receive(w->socket_fd, &w->rx_batch);
+        qsbr_online(&my_qsbr, w->reader);
+        if (count < 0) {
+            perror("Error receiving data");
+            continue;
         }
-
-        if (port == my_port){
-            my_label = dest;
-            fclose(f);
-            return;
+        metrics_set(w->metrics, METRIC_DATA_DROPPED_OVERFLOW,
+                w->rx_batch.drops);
+        uint64_t start = metrics_now_ns();
+        int i;
+        for (i=0; i<count; i++) {
+            char *buffer = rx_batch_buffer(&w->rx_batch, i);
+            ssize_t bytes_received = rx_batch_length(&w->rx_batch, i);
+            struct sockaddr_in *remote_addr = rx_batch_addr(&w->rx_batch, i);
+            if (bytes_received > 0 && buffer[0] == DATA_PACKET) {
+                metrics_count(w->metrics, METRIC_RX_DATA);
+                forward_data_packet(&my_node, ntohs(remote_addr->sin_port),
+                        buffer, bytes_received, &w->tx_queue, w->metrics);
+                metrics_packet_done(w->metrics, &start);
+            } else {
+                // Counted and timed by the control thread
+                hand_off_to_control(buffer, bytes_received, remote_addr);
+                start = metrics_now_ns();
+            }
         }
+        tx_queue_flush(&w->tx_queue);
     }
-    // If port not found while scanning, error
-    fclose(f);
-    fprintf(stderr, "Error: Port number not in network topology file\n");
-    exit(1);
+    return NULL;
 }
 
-// The router finds its immediate neighbors from file
-// Initialize neighbors from tuples of 
-//      <source router, destination router, destination UDP port, link cost>
-// (seems to be destination port, even though spec says source port?)
-void initialize_neighbors(const char *file_name) {
-
-    struct neighbor_list_node *next = NULL; // tail node added first, has NULL next
-    struct neighbor_list_node* current = NULL;
-
-    FILE* f = fopen(file_name, "rt");
-    char line[MAX_LINE_LEN];
-    while(fgets(line, MAX_LINE_LEN, f) != NULL){
-        char src;
-        char dest;
-        uint16_t port;
-        uint16_t cost;
-
-        if (sscanf(line, "%c,%c,%" SCNd16 ",%" SCNd16 "", &src, &dest, &port, &cost) < 4){
-            fprintf(stderr, "Error: cannot read network topology file");
-            exit(1);
+// The control thread's counterpart of server_loop
+void control_loop() {
+    int count = rx_batch_receive(my_handoff_fds[0], &my_rx_batch);
+    if (count < 0) {
+        perror("Error receiving data");
+        return;
+    }
+    uint64_t start = metrics_now_ns();
+    int i;
+    for (i=0; i<count; i++) {
+        char *message = rx_batch_buffer(&my_rx_batch, i);
+        struct sockaddr_in remote_addr;
+        memcpy(&remote_addr, message, sizeof remote_addr);
+        handle_packet(message + sizeof remote_addr,
+                rx_batch_length(&my_rx_batch, i) - sizeof remote_addr,
+                remote_addr);
+        metrics_packet_done(&my_metrics[0], &start);
+    }
+    router_end_batch(&my_router);
+    tx_queue_flush(&my_tx_queue);
+    tx_queue_flush(&my_control_tx_queue);
+    rotate_capture();
+}
 
-        }
+// Packets are waiting on the router socket, or on the handoff socket if
+//  there are workers
+void handle_socket_ready(struct event_source *source, uint32_t events) {
+    (void) events;
+    if (my_worker_count > 0) {
+        control_loop();
+    } else {
+        server_loop(source->fd);
+    }
+}
 
-        if (src == my_label) {
-            current = new_neighbor_list_node(port, cost, next);
-            next = current;
+void start_workers() {
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, my_handoff_fds) < 0) {
+        perror("Error creating socket pair");
+        exit(1);
+    }
+    my_workers = calloc(my_worker_count, sizeof(struct worker));
+    if (my_workers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int i;
+    for (i=0; i<my_worker_count; i++) {
+        struct worker *w = &my_workers[i];
+        w->socket_fd = netio_bind_socket(my_port, 1, 0);
+        set_receive_buffer(w->socket_fd, my_data_rcvbuf, "data");
+        w->reader = &my_qsbr.readers[i];
+        w->metrics = &my_metrics[i + 1];
+        rx_batch_init(&w->rx_batch, my_batch_size, BUFFER_SIZE);
+        rx_batch_count_drops(&w->rx_batch, w->socket_fd);
+        tx_queue_init(&w->tx_queue, w->socket_fd, my_batch_size);
+        if (my_capture_prefix != NULL) {
+            rx_batch_capture(&w->rx_batch, &my_capture, my_port);
+            tx_queue_capture(&w->tx_queue, &my_capture, my_port);
+        }
+    }
+    // All sockets are bound before any worker starts receiving
+    for (i=0; i<my_worker_count; i++) {
+        int err = pthread_create(&my_workers[i].thread, NULL, worker_main,
+                &my_workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "Error creating worker thread: %s\n",
+                    strerror(err));
+            exit(1);
         }
     }
-
-    fclose(f);
-    my_neighbor_list_head = current;
-    return;
 }
+//-----------------------------------------------------------------------------
 
-// prompts user for message body, then sends through src node with ultimate goal dest
-int generate_traffic(char src_label, char dest_label, const char *topology_file_name){
-
-    char bodybuf[81];
-    bodybuf[80] = '\0';
-    uint16_t src_port; // corresponding ports to given labels
-    uint16_t dest_port;
-    int src_port_found = 0;
-    int dest_port_found = 0;
-
-
-    printf("What message would you like to send from %c to %c? (up to 80 char)\n", 
-        src_label, dest_label);
 
-    // allow spaces until newline, discard newline
-    if (scanf("%81[^\n]%*c", bodybuf) != 1) { 
-        fprintf(stderr, "Error: Could not read message for traffic generation\n");
+// Loads the topology file once; everything about the network is read
+//  from my_topology
+void load_topology() {
+    if (topology_load(&my_topology, my_topology_file_name) < 0) {
+        fprintf(stderr, "Error: cannot read network topology file %s\n",
+                my_topology_file_name);
         exit(1);
     }
+}
 
-    FILE* f = fopen(topology_file_name, "rt");
-    char line[MAX_LINE_LEN];
-    while(fgets(line, MAX_LINE_LEN, f) != NULL){
-        char src;
-        char dest;
-        uint16_t port; // dest port
-        uint16_t cost;
-
-        if (sscanf(line, "%c,%c,%" SCNd16 ",%" SCNd16 "", &src, &dest, &port, &cost) < 4){
-            fprintf(stderr, "Error: cannot read network topology file\n");
-            exit(1);
-        }
-
-        if (dest == src_label) {
-            src_port = port;
-            src_port_found = 1;
-        }
+// Every router's control port must be free for it
+void check_control_ports() {
+    uint16_t port = topology_offset_conflict(&my_topology,
+            my_control_port_offset);
+    if (port != 0) {
+        fprintf(stderr, "Error: Control port of %u (offset %u) is out of"
+                " range or taken by a router; pick another with -C\n",
+                port, my_control_port_offset);
+        exit(1);
+    }
+}
 
-        if (dest == dest_label) {
-            dest_port = port;
-            dest_port_found = 1;
-        }
+// The router with this port is this router
+void find_name() {
+    int node = topology_find_port(&my_topology, my_port);
+    if (node < 0) {
+        fprintf(stderr, "Error: Port number not in network topology file\n");
+        exit(1);
     }
+    my_name = strndup(my_topology.nodes[node].name,
+            my_topology.nodes[node].name_length);
+}
 
+// The router finds its immediate neighbors from the topology, whose links
+//  are tuples of
+//      <source router, destination router, destination UDP port, link cost>
+void initialize_neighbors() {
+    int node = topology_find_port(&my_topology, my_port);
+    const struct topology_node *n = &my_topology.nodes[node];
+    int i;
+    for (i=0; i<n->link_count; i++) {
+        const struct topology_link *l = &my_topology.links[n->first_link + i];
+        router_add_neighbor(&my_router, l->port, l->cost);
+    }
+}
 
-    if (!(src_port_found && dest_port_found)) {
-        fprintf(stderr, "Error: Cannot find both corresponding ports\n");
+// Port of the router with this name, which must exist and have a port
+uint16_t port_of_name(const char *name) {
+    int node = topology_find_name(&my_topology, name, strlen(name));
+    if (node < 0 || my_topology.nodes[node].port == 0) {
+        fprintf(stderr, "Error: Router %s has no port in network topology"
+                " file\n", name);
         exit(1);
     }
+    return my_topology.nodes[node].port;
+}
 
+// Opens routing-output_<name>.txt as log_file
+void open_log_file() {
+    char log_file_name[LOG_FILE_NAME_LEN];
+    snprintf(log_file_name, sizeof log_file_name, "routing-output_%s.txt",
+            my_name);
+    log_file = log_open_file(log_file_name);
+    if (log_file == NULL) {
+        fprintf(stderr, "Error: Failed to open log file %s\n", log_file_name);
+        exit(1);
+    }
+}
 
-    // create socket
+// Creates the traffic generator's socket, bound to my_port
+int open_generator_socket() {
     int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (socket_fd < 0) {
         perror("Error creating socket");
@@ -648,55 +702,131 @@ int generate_traffic(char src_label, char dest_label, const char *topology_file_
     }
 
     my_socket_fd = socket_fd; // set global too
+    return socket_fd;
+}
+
+// Reads the payload to send: one line when typed at a terminal (without its
+//  newline), otherwise all of standard input, so any bytes can be piped in.
+// Returns the payload length.
+static size_t read_payload(char *payload) {
+    if (isatty(STDIN_FILENO)) {
+        if (fgets(payload, DATA_PAYLOAD_MAX + 1, stdin) == NULL) {
+            fprintf(stderr, "Error: Could not read message for traffic generation\n");
+            exit(1);
+        }
+        size_t length = strcspn(payload, "\n");
+        payload[length] = '\0';
+        return length;
+    }
+    size_t length = fread(payload, 1, DATA_PAYLOAD_MAX + 1, stdin);
+    if (ferror(stdin)) {
+        perror("Error reading message for traffic generation");
+        exit(1);
+    }
+    if (length > DATA_PAYLOAD_MAX) {
+        fprintf(stderr, "Error: Message is longer than %d bytes\n",
+                (int) DATA_PAYLOAD_MAX);
+        exit(1);
+    }
+    return length;
+}
+
+// prompts user for message body, then sends through src node with ultimate goal dest
+int generate_traffic(const char *src_name, const char *dest_name){
+
+    // corresponding ports to given names
+    uint16_t src_port = port_of_name(src_name);
+    uint16_t dest_port = port_of_name(dest_name);
+
+    // Room for one byte too many, to tell when the input is too long
+    char *message = malloc(DATA_HEADER_SIZE + DATA_PAYLOAD_MAX + 1);
+    if (message == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    char *payload = message + DATA_HEADER_SIZE;
 
+    printf("What message would you like to send from %s to %s? (up to %d bytes)\n",
+        src_name, dest_name, (int) DATA_PAYLOAD_MAX);
+    fflush(stdout);
+    size_t payload_length = read_payload(payload);
 
-    // send message to src port consisting of 
-    //      DATA flag
-    //      ultimate destination label
-    //      ultimate destination port byte
-    //      ultimate destination port byte
-    //      message body
 
-    // sloppy array stuff
-    size_t msg_sz = 5*sizeof(char) + MAX_BODY_LEN + 1;
-    char message[msg_sz];
+    int socket_fd = open_generator_socket();
 
-    //char lo = dest_port & 0xFF;
-    //char hi = dest_port >> 8;
-    message[0] = (char) DATA_PACKET;
-    message[1] = src_label;
-    message[2] = dest_label;
-    message[3] = htons(dest_port) & 0xFF;
-    message[4] = htons(dest_port) >> 8;
-    strncpy(message + 5, bodybuf, MAX_BODY_LEN);
+    // send the header (see data_packet.h) and payload to src port
+    struct data_header header = {
+        .type = DATA_PACKET,
+        .version = DATA_WIRE_VERSION,
+        .ttl = DATA_DEFAULT_TTL,
+        .flags = 0,
+        .src_port = src_port,
+        .dest_port = dest_port,
+        .flow = 0,
+        .payload_length = payload_length,
+    };
+    data_header_write(message, &header);
 
-    
     printf("Injecting data into network\n");
-    send_message(socket_fd, message, msg_sz, src_port); 
+    send_message(socket_fd, message, DATA_HEADER_SIZE + payload_length,
+            src_port);
 
 
     // write output
 
-    char log_file_name[LOG_FILE_NAME_LEN];
-    strcpy(log_file_name, "routing-output_.txt");
-    log_file_name[14] = my_label; // will be 'H'
-    log_file = fopen(log_file_name, "w");
-    if (log_file == NULL) {
-        fprintf(stderr, "Error: Failed to open log file %s\n", log_file_name);
-        exit(1);
-    }
-    fprintf(log_file, "This is traffic generator %c on port %u\n", my_label, my_port);
-    fprintf(log_file, "Sending a data packet to router %c on port %u\n", src_label, src_port);
-    fprintf(log_file, "With ultimate destination being router %c on port %u\n", dest_label, dest_port);
-    fprintf(log_file, "The message payload is as follows:\n");
-    fprintf(log_file, "%s\n", bodybuf);
-
+    open_log_file(); // will be routing-output_H.txt
+    fprintf(log_file, "This is traffic generator %s on port %u\n", my_name, my_port);
+    fprintf(log_file, "Sending a data packet to router %s on port %u\n", src_name, src_port);
+    fprintf(log_file, "With ultimate destination being router %s on port %u\n", dest_name, dest_port);
+    fprintf(log_file, "The message payload (%u bytes) is as follows:\n",
+            (unsigned) payload_length);
+    fwrite(payload, 1, payload_length, log_file);
+    fprintf(log_file, "\n");
 
+    free(message);
     return 0;
 }
 
 
 
+// Runs the load generator over the source/destination pairs in names
+void generate_load(char **names, int name_count) {
+    if (name_count == 0 || name_count % 2 != 0) {
+        fprintf(stderr, "Error: Routers must come in <src> <dest> pairs\n");
+        exit(1);
+    }
+    if (name_count / 2 > LOADGEN_MAX_PAIRS) {
+        fprintf(stderr, "Error: At most %d pairs are allowed\n",
+                LOADGEN_MAX_PAIRS);
+        exit(1);
+    }
+    struct loadgen_pair pairs[LOADGEN_MAX_PAIRS];
+    int i;
+    for (i=0; i<name_count/2; i++) {
+        pairs[i].src_name = names[2*i];
+        pairs[i].dest_name = names[2*i + 1];
+        pairs[i].src_port = port_of_name(pairs[i].src_name);
+        pairs[i].dest_port = port_of_name(pairs[i].dest_name);
+    }
+    my_load.pairs = pairs;
+    my_load.pair_count = name_count / 2;
+    my_load.socket_fd = open_generator_socket();
+    my_load.port = my_port;
+    my_load.batch_size = my_batch_size;
+    loadgen_run(&my_load);
+}
+
+int str_to_int(const char *str, int *result) {
+    char *end;
+    errno = 0;
+    long int value = strtol(str, &end, 10);
+    if (errno == ERANGE || value > INT_MAX || value < 0
+            || end == str || *end != '\0')
+        return -1;
+    *result = (int) value;
+    return 0;
+}
+
 int str_to_uint16(const char *str, uint16_t *result) {
     char *end;
     errno = 0;
@@ -708,7 +838,236 @@ int str_to_uint16(const char *str, uint16_t *result) {
     return 0;
 }
 
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-b batch_size] [-w workers] [-l level]"
+            " [-d min_delay] [-D max_delay] [-r refresh]\n"
+            "       [-E paths] [-A] [-F] [-t topology_file] [-s stats_socket]"
+            " [-c snapshot]\n"
+            "       [-C offset] [-B bytes] [-K bytes] [-p prefix"
+            " [-P packets]]\n"
+            "       [-L interval [-U us] [-H percent]]\n"
+            "       [-R rate [-S sizes] [-T duration]]"
+            " <port> [<src> <dest> ...]\n",
+            program_name);
+    fprintf(stderr, "  -b  datagrams received/sent per syscall, 1 to %d"
+            " (default %d; 1 disables batching)\n",
+            MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -w  data plane worker threads, 0 to %d"
+            " (default 0: forward on the control thread)\n", MAX_WORKERS);
+    fprintf(stderr, "  -l  verbosity: error, warn, info, debug or trace"
+            " (default info)\n");
+    fprintf(stderr, "  -d  ms to hold down DV updates after the last change"
+            " (default %d; 0 sends them after every batch)\n",
+            DEFAULT_MIN_UPDATE_DELAY_MS);
+    fprintf(stderr, "  -D  ms a DV update may be held down at most"
+            " (default %d)\n", DEFAULT_MAX_UPDATE_DELAY_MS);
+    fprintf(stderr, "  -r  seconds between full DV refreshes"
+            " (default %d; 0 disables them)\n", DEFAULT_REFRESH_INTERVAL_S);
+    fprintf(stderr, "  -E  equal-cost next hops to spread data packets"
+            " over, 1 to %d (default %d)\n", FIB_MAX_PATHS,
+            DEFAULT_MAX_PATHS);
+    fprintf(stderr, "  -A  advertise runs of destination ports as ranges,"
+            " to neighbors that\n      say they decode DV message version"
+            " 3\n");
+    fprintf(stderr, "  -F  only take routes that pass the feasibility"
+            " condition: no counting\n      to infinity when a link failure"
+            " cuts a destination off, but slower\n      to reconverge after a"
+            " link failure\n");
+    fprintf(stderr, "  -t  network topology file"
+            " (default sample_topology.txt)\n");
+    fprintf(stderr, "  -s  UNIX socket to serve stats on, for routerstat"
+            " (default myrouter_<port>.sock)\n");
+    fprintf(stderr, "  -C  DV messages use each router's port plus this"
+            " (default %d;\n      0 shares the port with data packets)\n",
+            DEFAULT_CONTROL_PORT_OFFSET);
+    fprintf(stderr, "  -B  receive buffer bytes for data packets, which"
+            " are dropped when it's full\n      (default: the kernel's)\n");
+    fprintf(stderr, "  -K  receive buffer bytes for DV messages"
+            " (default: the kernel's)\n");
+    fprintf(stderr, "  -c  routing snapshot to restart warm from and to"
+            " checkpoint to;\n      SIGUSR1 then stops the router for a"
+            " warm restart\n");
+    fprintf(stderr, "  -p  capture packets sent and received into"
+            " <prefix>.<n>.pcapng files,\n      written whenever half the"
+            " ring fills up, on SIGUSR2 and at exit\n");
+    fprintf(stderr, "  -P  packets per half of the capture ring"
+            " (default %d)\n", CAPTURE_DEFAULT_PACKETS);
+    fprintf(stderr, "  -L  ms between RTT probes to each neighbor; link"
+            " costs then follow\n      the measured RTT and loss"
+            " (default 0: topology costs only)\n");
+    fprintf(stderr, "  -U  us of RTT that add 1 to a link's cost"
+            " (default %d)\n", LINK_PROBE_DEFAULT_RTT_PER_COST_US);
+    fprintf(stderr, "  -H  percent a measured cost must differ by to be"
+            " used (default %d)\n", LINK_PROBE_DEFAULT_HYSTERESIS_PERCENT);
+    fprintf(stderr, "With <src> <dest>, sends one packet from stdin instead"
+            " of routing.\nWith -R, generates load over any number of"
+            " <src> <dest> pairs:\n");
+    fprintf(stderr, "  -R  probe packets per second\n");
+    fprintf(stderr, "  -S  payload sizes, as in 64, 64-1400,"
+            " 64:7,576:4,1500:1 or imix (default %d)\n", DEFAULT_LOAD_SIZE);
+    fprintf(stderr, "  -T  seconds to send for (default %d)\n",
+            DEFAULT_LOAD_DURATION_S);
+}
+
 int main(int argc, char **argv) {
+    int opt;
+    uint16_t value;
+    char *end;
+    my_load.sizes[0].min = my_load.sizes[0].max = DEFAULT_LOAD_SIZE;
+    my_load.sizes[0].weight = 1;
+    my_load.size_count = 1;
+    while ((opt = getopt(argc, argv, "b:w:l:d:D:r:E:AFt:s:c:C:B:K:p:P:L:U:H:R:S:T:")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (str_to_uint16(optarg, &value) < 0 || value < 1
+                        || value > MAX_BATCH_SIZE) {
+                    fprintf(stderr, "Error: Invalid batch size %s\n", optarg);
+                    exit(1);
+                }
+                my_batch_size = value;
+            break;
+            case 'w':
+                if (str_to_uint16(optarg, &value) < 0
+                        || value > MAX_WORKERS) {
+                    fprintf(stderr, "Error: Invalid worker count %s\n",
+                            optarg);
+                    exit(1);
+                }
+                my_worker_count = value;
+            break;
+            case 'l':
+                log_level = log_parse_level(optarg);
+                if (log_level < 0) {
+                    fprintf(stderr, "Error: Invalid log level %s\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'd':
+            case 'D':
+                if (str_to_uint16(optarg, &value) < 0
+                        || value > MAX_UPDATE_DELAY_MS) {
+                    fprintf(stderr, "Error: Invalid update delay %s\n",
+                            optarg);
+                    exit(1);
+                }
+                if (opt == 'd') {
+                    my_min_update_delay_ms = value;
+                } else {
+                    my_max_update_delay_ms = value;
+                }
+            break;
+            case 'r':
+                if (str_to_uint16(optarg, &value) < 0) {
+                    fprintf(stderr, "Error: Invalid refresh interval %s\n",
+                            optarg);
+                    exit(1);
+                }
+                my_refresh_interval_s = value;
+            break;
+            case 'E':
+                if (str_to_uint16(optarg, &value) < 0 || value < 1
+                        || value > FIB_MAX_PATHS) {
+                    fprintf(stderr, "Error: Invalid next hop count %s\n",
+                            optarg);
+                    exit(1);
+                }
+                my_max_paths = value;
+            break;
+            case 'A':
+                my_aggregate = 1;
+            break;
+            case 'F':
+                my_feasibility = 1;
+            break;
+            case 't':
+                my_topology_file_name = optarg;
+            break;
+            case 's':
+                my_stats_path = optarg;
+            break;
+            case 'c':
+                my_snapshot_path = optarg;
+            break;
+            case 'C':
+                if (str_to_uint16(optarg, &value) < 0) {
+                    fprintf(stderr, "Error: Invalid control port offset %s\n",
+                            optarg);
+                    exit(1);
+                }
+                my_control_port_offset = value;
+            break;
+            case 'B':
+            case 'K':
+                if (str_to_int(optarg, opt == 'B' ?
+                        &my_data_rcvbuf : &my_control_rcvbuf) < 0) {
+                    fprintf(stderr, "Error: Invalid receive buffer size %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'p':
+                my_capture_prefix = optarg;
+            break;
+            case 'P':
+                if (str_to_int(optarg, &my_capture_packets) < 0
+                        || my_capture_packets < 1) {
+                    fprintf(stderr, "Error: Invalid capture size %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'L':
+            case 'U':
+            case 'H':
+                if (str_to_uint16(optarg, &value) < 0
+                        || (opt == 'U' && value < 1)) {
+                    fprintf(stderr, "Error: Invalid probing setting %s\n",
+                            optarg);
+                    exit(1);
+                }
+                if (opt == 'L') {
+                    my_probe_interval_ms = value;
+                } else if (opt == 'U') {
+                    my_rtt_per_cost_us = value;
+                } else {
+                    my_hysteresis_percent = value;
+                }
+            break;
+            case 'R':
+            case 'T':
+                errno = 0;
+                double number = strtod(optarg, &end);
+                if (errno == ERANGE || end == optarg || *end != '\0'
+                        || !(number > 0 && number <= 1e9)) {
+                    fprintf(stderr, "Error: Invalid %s %s\n",
+                            opt == 'R' ? "rate" : "duration", optarg);
+                    exit(1);
+                }
+                if (opt == 'R') {
+                    my_load.rate = number;
+                } else {
+                    my_load.duration_s = number;
+                }
+            break;
+            case 'S':
+                if (loadgen_parse_sizes(optarg, &my_load) < 0) {
+                    fprintf(stderr, "Error: Invalid payload sizes %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (my_min_update_delay_ms > my_max_update_delay_ms) {
+        fprintf(stderr, "Error: Minimum update delay exceeds maximum\n");
+        exit(1);
+    }
+    argc -= optind - 1; // Leave only the positional arguments after argv[0]
+    argv += optind - 1;
+
     if (argc < 2) {
         fprintf(stderr, "Error: No port number provided\n");
         exit(1);
@@ -723,75 +1082,167 @@ int main(int argc, char **argv) {
 
     // if using this router as a traffic generator from initial point to dest
     // ex/       ./myrouter 10006 A D
-    if (argc == 4) {
-        // cannot use ports _between_ 10000 and 10005 bc they are reserved for network
-        if (my_port >= 10000 && my_port <= 10005) {
+    load_topology();
+    if (argc >= 4 || my_load.rate > 0) {
+        // cannot use ports of routers in the network
+        if (topology_find_port(&my_topology, my_port) >= 0) {
             fprintf(stderr, "Error: Port number %s is reserved for in-network routers\n", port_no_str);
             exit(1);
         }
 
-        my_label = 'H'; // traffic generator gets label H, not part of network
-        // will prompt user for message and send to first specified node
-        generate_traffic(argv[2][0], argv[3][0], "sample_topology.txt"); 
+        my_name = "H"; // traffic generator gets name H, not part of network
+        if (my_load.rate > 0) {
+            generate_load(argv + 2, argc - 2);
+        } else if (argc == 4) {
+            // will prompt user for message and send to first specified node
+            generate_traffic(argv[2], argv[3]);
+        } else {
+            print_usage(argv[0]);
+            exit(1);
+        }
 
         return 0; // quit after injecting message
     }
 
 
-    // TODO give user option to specify file
-    find_label("sample_topology.txt"); // Find this node's own name
-    initialize_neighbors("sample_topology.txt");
-
-    char log_file_name[LOG_FILE_NAME_LEN];
-    strcpy(log_file_name, "routing-output_.txt");
-    log_file_name[14] = my_label;
-    log_file = fopen(log_file_name, "w");
-    if (log_file == NULL) {
-        fprintf(stderr, "Error: Failed to open log file %s\n", log_file_name);
-        exit(1);
+    // Signals must be blocked before the log writer and the workers start
+    event_loop_init(&my_event_loop);
+    const int shutdown_signals[] = { SIGINT, SIGTERM, SIGQUIT, SIGUSR1 };
+    event_signals_init(&my_event_loop, &my_shutdown_signals, shutdown_signals,
+            4, handle_shutdown_signal, NULL);
+    if (my_capture_prefix != NULL) {
+        const int capture_signals[] = { SIGUSR2 };
+        event_signals_init(&my_event_loop, &my_capture_signals,
+                capture_signals, 1, handle_capture_signal, NULL);
+        capture_init(&my_capture, my_capture_packets);
     }
-    fprintf(log_file, "This is router %c on port %u\n", my_label, my_port);
 
-    struct neighbor_list_node *node = my_neighbor_list_head;
-    fprintf(stdout, "My neighbors are:\n");
+    find_name(); // Find this node's own name
+    if (my_control_port_offset > 0) {
+        check_control_ports();
+    }
+    router_init(&my_router, my_name, my_port, &my_router_ops, NULL);
+    my_router.min_update_delay_ms = my_min_update_delay_ms;
+    my_router.max_update_delay_ms = my_max_update_delay_ms;
+    my_router.aggregate = my_aggregate;
+    my_router.feasibility = my_feasibility;
+    initialize_neighbors();
+    // Probing starts from the topology's costs
+    link_prober_init(&my_prober, &my_router);
+    my_prober.interval_ms = my_probe_interval_ms;
+    my_prober.rtt_per_cost_ns = (uint64_t) my_rtt_per_cost_us * 1000;
+    my_prober.hysteresis_percent = my_hysteresis_percent;
+    // Nothing else needs the topology
+    topology_free(&my_topology);
+
+    log_init();
+    open_log_file();
+    my_router.log_file = log_file;
+    my_node.port = my_port;
+    my_node.log_file = log_file;
+    fprintf(log_file, "This is router %s on port %u\n", my_name, my_port);
+
+    struct neighbor_list_node *node = my_router.neighbors;
+    LOG(LOG_INFO, "My neighbors are:");
     for (; node!=NULL; node = node->next) {
-        fprintf(stdout, "Port %u Cost %u\n", node->port, node->cost);
+        LOG(LOG_INFO, "Port %u Cost %u", node->port, node->cost);
     }
 
-    fprintf(stdout, "My label is %c\n\n", my_label);
+    LOG(LOG_INFO, "My name is %s", LOG_STR(my_name));
 
-    // AF_INET ---> IPv4
-    // SOCK_DGRAM ---> UDP
-    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (socket_fd < 0) {
-        perror("Error creating socket");
-        exit(1);
-    }
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_port = htons(my_port);
-    if (bind(socket_fd,
-            (struct sockaddr *) &server_addr,
-            sizeof server_addr) < 0) {
-        perror("Error binding socket");
-        exit(1);
+    if (my_snapshot_path != NULL) {
+        int restored = snapshot_load(&my_router, my_snapshot_path);
+        if (restored >= 0) {
+            LOG(LOG_INFO, "Warm restart: restored %d entries from %s",
+                    restored, LOG_STR(my_snapshot_path));
+        }
     }
 
-    my_socket_fd = socket_fd; // set global too
+    my_start_ms = router_now_ms(NULL);
+    int i;
+    for (i=0; i<=my_worker_count; i++) {
+        metrics_init(&my_metrics[i]);
+    }
+    start_stats_socket();
+
+    qsbr_init(&my_qsbr, my_worker_count);
+    if (my_worker_count > 0) {
+        start_workers();
+        my_socket_fd = my_workers[0].socket_fd;
+        // Handed-off packets carry the sender's address in front
+        rx_batch_init(&my_rx_batch, my_batch_size,
+                BUFFER_SIZE + sizeof(struct sockaddr_in));
+    } else {
+        my_socket_fd = netio_bind_socket(my_port, 0, 0);
+        set_receive_buffer(my_socket_fd, my_data_rcvbuf, "data");
+        rx_batch_init(&my_rx_batch, my_batch_size, BUFFER_SIZE);
+        rx_batch_count_drops(&my_rx_batch, my_socket_fd);
+        if (my_capture_prefix != NULL) {
+            rx_batch_capture(&my_rx_batch, &my_capture, my_port);
+        }
+    }
+    tx_queue_init(&my_tx_queue, my_socket_fd, my_batch_size);
+    if (my_control_port_offset > 0) {
+        my_control_fd = netio_bind_socket(
+                my_port + my_control_port_offset, 0, SOCK_NONBLOCK);
+        set_receive_buffer(my_control_fd, my_control_rcvbuf, "control");
+        rx_batch_init(&my_control_rx_batch, my_batch_size, BUFFER_SIZE);
+        rx_batch_count_drops(&my_control_rx_batch, my_control_fd);
+        if (my_capture_prefix != NULL) {
+            rx_batch_capture(&my_control_rx_batch, &my_capture,
+                    my_port + my_control_port_offset);
+        }
+        event_loop_add(&my_event_loop, &my_control_source, my_control_fd,
+                EPOLLIN, handle_control_ready, NULL);
+    } else {
+        my_control_fd = my_socket_fd;
+    }
+    tx_queue_init(&my_control_tx_queue, my_control_fd, my_batch_size);
+    if (my_capture_prefix != NULL) {
+        tx_queue_capture(&my_tx_queue, &my_capture, my_port);
+        tx_queue_capture(&my_control_tx_queue, &my_capture,
+                my_port + my_control_port_offset);
+        event_timer_init(&my_event_loop, &my_capture_timer,
+                handle_capture_timer, NULL);
+        event_timer_arm(&my_capture_timer, CAPTURE_CHECK_INTERVAL_MS,
+                CAPTURE_CHECK_INTERVAL_MS);
+    }
+    forward_update_fib(&my_node, &my_router, my_max_paths, &my_qsbr);
+
+    event_loop_add(&my_event_loop, &my_socket_source,
+            my_worker_count > 0 ? my_handoff_fds[0] : my_socket_fd,
+            EPOLLIN, handle_socket_ready, NULL);
+    event_timer_init(&my_event_loop, &my_update_timer, handle_update_timer,
+            NULL);
+    event_timer_init(&my_event_loop, &my_refresh_timer, handle_refresh_timer,
+            NULL);
+    event_timer_init(&my_event_loop, &my_checkpoint_timer,
+            handle_checkpoint_timer, NULL);
+    event_timer_init(&my_event_loop, &my_probe_timer, handle_probe_timer,
+            NULL);
+    if (my_probe_interval_ms > 0) {
+        event_timer_arm(&my_probe_timer, my_probe_interval_ms,
+                my_probe_interval_ms);
+    }
+    if (my_refresh_interval_s > 0) {
+        uint64_t interval_ms = (uint64_t) my_refresh_interval_s * 1000;
+        event_timer_arm(&my_refresh_timer, interval_ms, interval_ms);
+    }
 
-    print_my_dv();
-    broadcast_my_dv(socket_fd, INITIAL_DV_PACKET);
-    printf("\n");
+    router_start(&my_router);
+    tx_queue_flush(&my_control_tx_queue);
 
-    // After this point (initial contact w/ neighbors), should let neighbors
-    //  know if killed
-    signal(SIGINT, handle_kill_signal);
-    signal(SIGTERM, handle_kill_signal);
-    signal(SIGQUIT, handle_kill_signal);
+    // Shutdown signals have been blocked since startup and are only handled
+    //  from here on (after initial contact w/ neighbors), so neighbors
+    //  always get to know if we're killed
+    event_loop_run(&my_event_loop);
 
-    while (1) {
-        server_loop(socket_fd);
+    tx_queue_flush(&my_tx_queue);
+    tx_queue_flush(&my_control_tx_queue);
+    if (my_capture_prefix != NULL) {
+        dump_capture();
     }
-    return 0;
+    unlink(my_stats_path);
+    LOG(LOG_INFO, "Router on port %u stopped", my_port);
+    return 0; // The log is written out by log_shutdown at exit
 }
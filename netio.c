@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "netio.h"
+
+// Room for copied messages between flushes
+#define TX_ARENA_SIZE (16 * 65536)
+
+// Ancillary data space for the SO_RXQ_OVFL drop count
+#define RX_CONTROL_SIZE CMSG_SPACE(sizeof(uint32_t))
+
+static void *netio_calloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+// AF_INET ---> IPv4
+// SOCK_DGRAM ---> UDP
+int netio_bind_socket(uint16_t port, int reuse_port, int flags) {
+    int socket_fd = socket(AF_INET, SOCK_DGRAM | flags, 0);
+    if (socket_fd < 0) {
+        perror("Error creating socket");
+        exit(1);
+    }
+    int enable = 1;
+    if (reuse_port && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT,
+            &enable, sizeof enable) < 0) {
+        perror("Error setting SO_REUSEPORT");
+        exit(1);
+    }
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof server_addr);
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_port = htons(port);
+    if (bind(socket_fd,
+            (struct sockaddr *) &server_addr,
+            sizeof server_addr) < 0) {
+        fprintf(stderr, "Error binding socket to port %u: %s\n", port,
+                strerror(errno));
+        exit(1);
+    }
+    return socket_fd;
+}
+
+void rx_batch_init(struct rx_batch *b, int capacity, size_t buffer_size) {
+    b->capacity = capacity;
+    b->buffer_size = buffer_size;
+    b->buffers = netio_calloc(capacity, buffer_size);
+    b->msgs = netio_calloc(capacity, sizeof(struct mmsghdr));
+    b->iovs = netio_calloc(capacity, sizeof(struct iovec));
+    b->addrs = netio_calloc(capacity, sizeof(struct sockaddr_in));
+    b->controls = NULL;
+    b->kernel_drops = 0;
+    b->drops = 0;
+    b->capture = NULL;
+    b->capture_port = 0;
+    int i;
+    for (i=0; i<capacity; i++) {
+        b->iovs[i].iov_base = rx_batch_buffer(b, i);
+        b->iovs[i].iov_len = buffer_size;
+        b->msgs[i].msg_hdr.msg_iov = &(b->iovs[i]);
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+        b->msgs[i].msg_hdr.msg_name = &(b->addrs[i]);
+    }
+}
+
+void rx_batch_count_drops(struct rx_batch *b, int socket_fd) {
+    int enable = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable,
+            sizeof enable) < 0) {
+        perror("Error setting SO_RXQ_OVFL");
+        return;
+    }
+    b->controls = netio_calloc(b->capacity, RX_CONTROL_SIZE);
+}
+
+void rx_batch_capture(struct rx_batch *b, struct capture *c,
+        uint16_t local_port) {
+    b->capture = c;
+    b->capture_port = local_port;
+}
+
+static void rx_batch_record(struct rx_batch *b, int count) {
+    int i;
+    for (i=0; i<count; i++) {
+        struct iovec part;
+        part.iov_base = rx_batch_buffer(b, i);
+        part.iov_len = rx_batch_length(b, i);
+        capture_add(b->capture, CAPTURE_RECEIVED, b->capture_port,
+                ntohs(b->addrs[i].sin_port), &part, 1, part.iov_len);
+    }
+}
+
+// The kernel stamps every datagram with the socket's running drop count, so
+//  the last one of a batch has the latest
+static void rx_batch_update_drops(struct rx_batch *b, int count) {
+    struct msghdr *hdr = &(b->msgs[count - 1].msg_hdr);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+    for (; cmsg!=NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET
+                && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t kernel_drops;
+            memcpy(&kernel_drops, CMSG_DATA(cmsg), sizeof kernel_drops);
+            b->drops += (uint32_t) (kernel_drops - b->kernel_drops);
+            b->kernel_drops = kernel_drops;
+        }
+    }
+}
+
+int rx_batch_receive(int socket_fd, struct rx_batch *b) {
+    int i;
+    for (i=0; i<b->capacity; i++) {
+        // These are overwritten on receive, so they must be reset every time
+        b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        b->msgs[i].msg_hdr.msg_flags = 0;
+        if (b->controls != NULL) {
+            b->msgs[i].msg_hdr.msg_control = b->controls
+                    + i * RX_CONTROL_SIZE;
+            b->msgs[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+        }
+    }
+    int count;
+    if (b->capacity == 1) {
+        ssize_t n = recvmsg(socket_fd, &(b->msgs[0].msg_hdr), 0);
+        if (n < 0) {
+            return -1;
+        }
+        b->msgs[0].msg_len = n;
+        count = 1;
+    } else {
+        count = recvmmsg(socket_fd, b->msgs, b->capacity, MSG_WAITFORONE,
+                NULL);
+        if (count <= 0) {
+            return count;
+        }
+    }
+    if (b->controls != NULL) {
+        rx_batch_update_drops(b, count);
+    }
+    if (b->capture != NULL) {
+        rx_batch_record(b, count);
+    }
+    return count;
+}
+
+void tx_queue_init(struct tx_queue *q, int socket_fd, int capacity) {
+    q->socket_fd = socket_fd;
+    q->capacity = capacity;
+    q->length = 0;
+    q->msgs = netio_calloc(capacity, sizeof(struct mmsghdr));
+    q->iovs = netio_calloc(2 * capacity, sizeof(struct iovec));
+    q->addrs = netio_calloc(capacity, sizeof(struct sockaddr_in));
+    q->heads = netio_calloc(capacity, TX_HEAD_MAX);
+    q->arena_size = TX_ARENA_SIZE;
+    q->arena = netio_calloc(1, q->arena_size);
+    q->arena_used = 0;
+    q->flush_count = 0;
+    q->capture = NULL;
+    q->capture_port = 0;
+}
+
+void tx_queue_capture(struct tx_queue *q, struct capture *c,
+        uint16_t local_port) {
+    q->capture = c;
+    q->capture_port = local_port;
+}
+
+// Sends the queued messages but leaves the arena alone, since messages
+//  still being added may live there
+static void tx_queue_send_pending(struct tx_queue *q) {
+    int sent = 0;
+    while (sent < q->length) {
+        int n = sendmmsg(q->socket_fd, q->msgs + sent, q->length - sent, 0);
+        if (n < 0) {
+            perror("Local error trying to send packet");
+            n = 1; // Give up on this one and carry on with the rest
+        }
+        sent += n;
+    }
+    q->length = 0;
+}
+
+char *tx_queue_reserve(struct tx_queue *q, size_t size) {
+    if (size > q->arena_size) {
+        return NULL; // Not even an empty arena would hold it
+    }
+    if (q->arena_used + size > q->arena_size) {
+        tx_queue_flush(q);
+    }
+    char *p = q->arena + q->arena_used;
+    q->arena_used += size;
+    return p;
+}
+
+void tx_queue_add_parts(struct tx_queue *q, const char *head,
+        size_t head_length, const char *body, size_t body_length,
+        uint16_t dest_port) {
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof dest_addr);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // 127.0.0.1
+    dest_addr.sin_port = htons(dest_port);
+
+    struct iovec parts[2];
+    parts[0].iov_base = (void *) head;
+    parts[0].iov_len = head_length;
+    parts[1].iov_base = (void *) body;
+    parts[1].iov_len = body_length;
+    int part_count = 2;
+    if (q->capture != NULL) {
+        capture_add(q->capture, CAPTURE_SENT, q->capture_port, dest_port,
+                parts, part_count, head_length + body_length);
+    }
+
+    if (q->capacity == 1) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_name = &dest_addr;
+        msg.msg_namelen = sizeof dest_addr;
+        msg.msg_iov = parts;
+        msg.msg_iovlen = part_count;
+        if (sendmsg(q->socket_fd, &msg, 0) < 0) {
+            perror("Local error trying to send packet");
+        }
+        return;
+    }
+    if (q->length == q->capacity) {
+        tx_queue_send_pending(q);
+    }
+    int i = q->length++;
+    q->addrs[i] = dest_addr;
+    if (head_length > 0) {
+        memcpy(q->heads[i], head, head_length);
+    }
+    parts[0].iov_base = q->heads[i];
+    q->iovs[2*i] = parts[0];
+    q->iovs[2*i + 1] = parts[1];
+    memset(&(q->msgs[i]), 0, sizeof(struct mmsghdr));
+    q->msgs[i].msg_hdr.msg_name = &(q->addrs[i]);
+    q->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    q->msgs[i].msg_hdr.msg_iov = &(q->iovs[2*i]);
+    q->msgs[i].msg_hdr.msg_iovlen = part_count;
+}
+
+void tx_queue_add_ref(struct tx_queue *q, const char *message,
+        size_t message_length, uint16_t dest_port) {
+    // The message goes in as the body, so it isn't copied
+    tx_queue_add_parts(q, NULL, 0, message, message_length, dest_port);
+}
+
+void tx_queue_add(struct tx_queue *q, const char *message,
+        size_t message_length, uint16_t dest_port) {
+    if (q->capacity == 1) {
+        tx_queue_add_ref(q, message, message_length, dest_port);
+        return;
+    }
+    char *copy = tx_queue_reserve(q, message_length);
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Message of %zu bytes is too large to send\n",
+                message_length);
+        return;
+    }
+    memcpy(copy, message, message_length);
+    tx_queue_add_ref(q, copy, message_length, dest_port);
+}
+
+void tx_queue_flush(struct tx_queue *q) {
+    tx_queue_send_pending(q);
+    q->arena_used = 0;
+    q->flush_count++;
+}
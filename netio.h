@@ -0,0 +1,114 @@
+#ifndef NETIO_H
+#define NETIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "capture.h"
+
+// Batched datagram I/O. A batch size of 1 falls back to plain
+//  recvfrom/sendto, which is how the router originally worked.
+
+#define DEFAULT_BATCH_SIZE 32
+#define MAX_BATCH_SIZE 1024 // UIO_MAXIOV, the most sendmmsg will take
+
+// Largest payload a single UDP datagram can carry
+#define MAX_DATAGRAM_SIZE 65507
+
+// Creates a UDP socket bound to port on every local address. flags are
+//  socket type flags such as SOCK_NONBLOCK. Errors are fatal.
+int netio_bind_socket(uint16_t port, int reuse_port, int flags);
+
+// Preallocated receive buffers, one per datagram in a batch
+struct rx_batch {
+    int capacity;
+    size_t buffer_size;
+    char *buffers; // capacity * buffer_size bytes
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_in *addrs;
+    char *controls; // Ancillary data space per datagram, if drops are counted
+    uint32_t kernel_drops; // The socket's drop count as of the last datagram
+    uint64_t drops; // Datagrams the kernel dropped since counting started
+    struct capture *capture; // Records what is received, if not NULL
+    uint16_t capture_port; // The socket's own port, for the capture
+};
+
+void rx_batch_init(struct rx_batch *b, int capacity, size_t buffer_size);
+
+// Has the kernel report how many datagrams it dropped on socket_fd for lack
+//  of receive buffer space, which rx_batch_receive then keeps in b->drops
+void rx_batch_count_drops(struct rx_batch *b, int socket_fd);
+
+// Records every datagram received from now on in c, as received on
+//  local_port
+void rx_batch_capture(struct rx_batch *b, struct capture *c,
+        uint16_t local_port);
+
+// Blocks until at least one datagram arrives, then takes as many more as are
+//  already queued (up to the batch capacity) without blocking.
+// Returns the number of datagrams received, or -1 with errno set.
+int rx_batch_receive(int socket_fd, struct rx_batch *b);
+
+static inline char *rx_batch_buffer(struct rx_batch *b, int i) {
+    return b->buffers + i * b->buffer_size;
+}
+static inline ssize_t rx_batch_length(struct rx_batch *b, int i) {
+    return b->msgs[i].msg_len;
+}
+static inline struct sockaddr_in *rx_batch_addr(struct rx_batch *b, int i) {
+    return &(b->addrs[i]);
+}
+
+#define TX_HEAD_MAX 32 // Largest head tx_queue_add_parts accepts
+
+// Outgoing datagrams waiting to go out in one sendmmsg call.
+// Payloads are either copied into the queue's arena (tx_queue_add) or
+//  referenced in place (tx_queue_add_ref, tx_queue_add_parts), in which case
+//  they must stay valid until the queue is flushed.
+struct tx_queue {
+    int socket_fd;
+    int capacity;
+    int length;
+    struct mmsghdr *msgs;
+    struct iovec *iovs; // Two per message
+    struct sockaddr_in *addrs;
+    char (*heads)[TX_HEAD_MAX]; // Copies of each message's head
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+    unsigned long flush_count; // Arena space is reused after each flush
+    struct capture *capture; // Records what is sent, if not NULL
+    uint16_t capture_port;
+};
+
+void tx_queue_init(struct tx_queue *q, int socket_fd, int capacity);
+
+// Records every datagram queued from now on in c, as sent from local_port
+void tx_queue_capture(struct tx_queue *q, struct capture *c,
+        uint16_t local_port);
+
+// Returns space for a message of up to size bytes in the arena. The space
+//  stays valid until the next tx_queue_flush, which may happen inside
+//  tx_queue_reserve itself when the arena is full (flush_count tells).
+// Returns NULL if size is more than the whole arena.
+char *tx_queue_reserve(struct tx_queue *q, size_t size);
+
+void tx_queue_add_ref(struct tx_queue *q, const char *message,
+        size_t message_length, uint16_t dest_port);
+// Sends head followed by body as one datagram, so that messages which only
+//  differ in their header can share a body. The head (at most TX_HEAD_MAX
+//  bytes) is copied; the body is referenced in place.
+void tx_queue_add_parts(struct tx_queue *q, const char *head,
+        size_t head_length, const char *body, size_t body_length,
+        uint16_t dest_port);
+void tx_queue_add(struct tx_queue *q, const char *message,
+        size_t message_length, uint16_t dest_port);
+
+// Sends everything queued so far and releases the arena
+void tx_queue_flush(struct tx_queue *q);
+
+#endif
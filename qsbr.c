@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "qsbr.h"
+
+void qsbr_init(struct qsbr *q, int reader_count) {
+    atomic_init(&q->epoch, 1);
+    q->reader_count = reader_count;
+    q->readers = NULL;
+    q->retired = NULL;
+    if (reader_count > 0) {
+        q->readers = aligned_alloc(64,
+                reader_count * sizeof(struct qsbr_reader));
+        if (q->readers == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        int i;
+        for (i=0; i<reader_count; i++) {
+            atomic_init(&q->readers[i].epoch, QSBR_OFFLINE);
+        }
+    }
+}
+
+void qsbr_retire(struct qsbr *q, void *object) {
+    if (q->reader_count == 0) {
+        free(object);
+        return;
+    }
+    struct qsbr_retired *r = malloc(sizeof(struct qsbr_retired));
+    if (r == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    // The object was unpublished before this increment, so a reader that
+    //  reaches the new epoch can no longer be holding it
+    r->object = object;
+    r->epoch = atomic_fetch_add(&q->epoch, 1) + 1;
+    r->next = q->retired;
+    q->retired = r;
+    qsbr_reclaim(q);
+}
+
+void qsbr_reclaim(struct qsbr *q) {
+    uint64_t min_epoch = UINT64_MAX;
+    int i;
+    for (i=0; i<q->reader_count; i++) {
+        uint64_t e = atomic_load(&q->readers[i].epoch);
+        if (e != QSBR_OFFLINE && e < min_epoch) {
+            min_epoch = e;
+        }
+    }
+    struct qsbr_retired **p = &q->retired;
+    while (*p != NULL) {
+        struct qsbr_retired *r = *p;
+        if (r->epoch <= min_epoch) {
+            *p = r->next;
+            free(r->object);
+            free(r);
+        } else {
+            p = &r->next;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef QSBR_H
+#define QSBR_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Quiescent-state-based reclamation (an epoch flavour of RCU).
+// Readers never lock: they only announce, now and then, that they hold no
+//  references to shared objects. A writer that unpublishes an object retires
+//  it, and it is freed once every online reader has announced a quiescent
+//  state since the retirement.
+
+// Reader epoch value meaning "not reading anything, e.g. blocked in a syscall"
+#define QSBR_OFFLINE 0
+
+struct qsbr_reader {
+    _Atomic uint64_t epoch;
+    char padding[64 - sizeof(uint64_t)]; // Keep readers on separate lines
+};
+
+struct qsbr_retired {
+    void *object;
+    uint64_t epoch; // Safe to free once all readers have reached it
+    struct qsbr_retired *next;
+};
+
+struct qsbr {
+    _Atomic uint64_t epoch;
+    int reader_count;
+    struct qsbr_reader *readers;
+    struct qsbr_retired *retired; // Only touched by the (single) writer
+};
+
+void qsbr_init(struct qsbr *q, int reader_count);
+
+static inline void qsbr_quiescent(struct qsbr *q, struct qsbr_reader *r) {
+    atomic_store(&r->epoch, atomic_load(&q->epoch));
+    // Order the announcement before any later load of a shared pointer
+    atomic_thread_fence(memory_order_seq_cst);
+}
+static inline void qsbr_online(struct qsbr *q, struct qsbr_reader *r) {
+    qsbr_quiescent(q, r);
+}
+static inline void qsbr_offline(struct qsbr_reader *r) {
+    atomic_store(&r->epoch, QSBR_OFFLINE);
+}
+
+// Called by the writer after it has unpublished object. With no readers the
+//  object is freed immediately.
+void qsbr_retire(struct qsbr *q, void *object);
+
+// Frees whatever retired objects no reader can still see
+void qsbr_reclaim(struct qsbr *q);
+
+#endif
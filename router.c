@@ -0,0 +1,1520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "router.h"
+#include "router_internal.h"
+#include "logger.h"
+#include "netio.h"
+
+#define ROUTES_INITIAL_LIMIT 1024
+
+void *router_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+struct neighbor_list_node *
+neighbor_list_find(struct neighbor_list_node *list_head, uint16_t port) {
+    struct neighbor_list_node *node = list_head;
+    for (; node!=NULL; node = node->next) {
+        if (node->port == port) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void router_send(struct router *r, const char *head,
+        size_t head_length, const char *body, size_t body_length,
+        uint16_t dest_port) {
+    r->stats.messages_sent++;
+    r->stats.bytes_sent += head_length + body_length;
+    r->ops->send(r->ctx, head, head_length, body, body_length, dest_port);
+}
+
+void router_print_dv(struct router *r) {
+    if (!LOG_ENABLED(LOG_INFO)) {
+        return;
+    }
+    LOG_FILE(r->log_file, LOG_INFO, "Entries in my DV:");
+
+    int i;
+    for (i = 0; i < r->dv.capacity; i++) {
+        struct dv_entry *e = &(r->dv.slots[i]);
+        if (!dv_slot_used(e)) {
+            continue;
+        }
+        LOG_FILE(r->log_file, LOG_INFO,
+                "Dest port %u first hop port %u cost %u",
+                e->dest_port, e->first_hop_port, e->cost);
+    }
+    LOG_FILE(r->log_file, LOG_INFO, "");
+}
+
+//-----------------------------------------------------------------------------
+// Reverse index by first hop
+
+// Makes the routes array cover port
+static void route_index_reserve(struct router *r, uint16_t port) {
+    if (port < r->routes_limit) {
+        return;
+    }
+    int limit = r->routes_limit == 0 ? ROUTES_INITIAL_LIMIT : r->routes_limit;
+    while (limit <= port) {
+        limit *= 2;
+    }
+    r->routes = router_alloc(r->routes,
+            limit * sizeof(struct route_index_slot));
+    memset(&(r->routes[r->routes_limit]), 0,
+            (limit - r->routes_limit) * sizeof(struct route_index_slot));
+    int i;
+    for (i=r->routes_limit; i<limit; i++) {
+        r->routes[i].feasible_cost = UINT32_MAX;
+    }
+    r->routes_limit = limit;
+}
+
+static void route_index_unlink(struct router *r, uint16_t dest_port) {
+    struct route_index_slot *slot = &(r->routes[dest_port]);
+    if (slot->prev != DV_EMPTY_PORT) {
+        r->routes[slot->prev].next = slot->next;
+    } else {
+        r->routes[slot->hop].via = slot->next;
+    }
+    if (slot->next != DV_EMPTY_PORT) {
+        r->routes[slot->next].prev = slot->prev;
+    }
+    slot->hop = DV_EMPTY_PORT;
+}
+
+static void route_index_link(struct router *r, uint16_t dest_port,
+        uint16_t first_hop_port) {
+    struct route_index_slot *slot = &(r->routes[dest_port]);
+    uint16_t next = r->routes[first_hop_port].via;
+    slot->hop = first_hop_port;
+    slot->prev = DV_EMPTY_PORT;
+    slot->next = next;
+    if (next != DV_EMPTY_PORT) {
+        r->routes[next].prev = dest_port;
+    }
+    r->routes[first_hop_port].via = dest_port;
+}
+
+// Must be called for every change to the DV, including deletions
+static void dv_changed(struct router *r, uint16_t dest_port) {
+    struct dv_entry *e = dv_find(&r->dv, dest_port);
+    uint16_t first_hop_port = e != NULL ? e->first_hop_port : DV_EMPTY_PORT;
+    route_index_reserve(r, dest_port);
+    route_index_reserve(r, first_hop_port);
+    if (first_hop_port != r->routes[dest_port].hop) {
+        if (r->routes[dest_port].hop != DV_EMPTY_PORT) {
+            route_index_unlink(r, dest_port);
+        }
+        if (first_hop_port != DV_EMPTY_PORT) {
+            route_index_link(r, dest_port, first_hop_port);
+        }
+    }
+    if (e != NULL && e->cost < r->routes[dest_port].feasible_cost) {
+        r->routes[dest_port].feasible_cost = e->cost;
+    }
+
+    if (r->journal_length == r->journal_capacity) {
+        r->journal_capacity = r->journal_capacity == 0 ?
+                64 : 2*r->journal_capacity;
+        r->journal = router_alloc(r->journal,
+                r->journal_capacity * sizeof(uint16_t));
+    }
+    r->journal[r->journal_length++] = dest_port;
+    r->stats.route_changes++;
+}
+
+// Forget journal entries that every neighbor has been told about
+void dv_journal_trim(struct router *r) {
+    uint64_t oldest = dv_version(r);
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (node->dv_version_sent < oldest) {
+            oldest = node->dv_version_sent;
+        }
+    }
+    size_t drop = oldest - r->journal_base;
+    if (drop == 0) {
+        return;
+    }
+    memmove(r->journal, r->journal + drop,
+            (r->journal_length - drop) * sizeof(uint16_t));
+    r->journal_length -= drop;
+    r->journal_base = oldest;
+}
+
+//-----------------------------------------------------------------------------
+// Sending DVs
+
+// Returns room for count entries, reused by every call
+static struct dv_entry *dv_scratch(int count) {
+    static _Thread_local struct dv_entry *scratch = NULL;
+    static _Thread_local int scratch_capacity = 0;
+    if (scratch == NULL || count > scratch_capacity) {
+        scratch_capacity = count < 64 ? 64 : count;
+        scratch = router_alloc(scratch,
+                scratch_capacity * sizeof(struct dv_entry));
+    }
+    return scratch;
+}
+
+// Returns room for count runs, as dv_scratch does for entries
+static struct dv_run *run_scratch(int count) {
+    static _Thread_local struct dv_run *scratch = NULL;
+    static _Thread_local int scratch_capacity = 0;
+    if (scratch == NULL || count > scratch_capacity) {
+        scratch_capacity = count < 64 ? 64 : count;
+        scratch = router_alloc(scratch,
+                scratch_capacity * sizeof(struct dv_run));
+    }
+    return scratch;
+}
+
+// Returns room for count ports, as dv_scratch does for entries
+static uint16_t *port_scratch(int count) {
+    static _Thread_local uint16_t *scratch = NULL;
+    static _Thread_local int scratch_capacity = 0;
+    if (scratch == NULL || count > scratch_capacity) {
+        scratch_capacity = count < 64 ? 64 : count;
+        scratch = router_alloc(scratch, scratch_capacity * sizeof(uint16_t));
+    }
+    return scratch;
+}
+
+static int compare_dest_port(const void *a, const void *b) {
+    return (int) ((const struct dv_entry *) a)->dest_port -
+            (int) ((const struct dv_entry *) b)->dest_port;
+}
+
+// Merges each run of sorted entries for consecutive ports whose costs go
+//  up or down by the same step into its first entry, with runs[i] saying
+//  how many more ports entry i covers and by what step.
+// Returns the number of entries left.
+static int aggregate_entries(struct dv_entry *entries, int count,
+        struct dv_run *runs) {
+    int n = 0;
+    int i;
+    for (i=0; i<count; i++) {
+        struct dv_entry *e = &entries[i];
+        if (n > 0) {
+            struct dv_entry *last = &entries[n-1];
+            struct dv_run *run = &runs[n-1];
+            if (e->dest_port == last->dest_port + run->length + 1) {
+                int64_t step = (int64_t) e->cost
+                        - (last->cost + (int64_t) run->step * run->length);
+                if (run->length == 0 && step >= INT32_MIN
+                        && step <= INT32_MAX) {
+                    run->step = (int32_t) step;
+                }
+                if (step == run->step) {
+                    run->length++;
+                    continue;
+                }
+            }
+        }
+        entries[n] = *e;
+        runs[n].length = 0;
+        runs[n].step = 0;
+        n++;
+    }
+    return n;
+}
+
+// Sorts entries, drops repeated ones, and encodes them into space reserved
+//  from the transport, aggregated into ranges if ranges is set
+static void encode_dv_message(struct router *r, struct dv_message *m,
+        struct dv_entry *entries, int count, int ranges) {
+    qsort(entries, count, sizeof(struct dv_entry), compare_dest_port);
+    int n = 0;
+    int i;
+    for (i=0; i<count; i++) {
+        if (n == 0 || entries[i].dest_port != entries[n-1].dest_port) {
+            entries[n++] = entries[i];
+        }
+    }
+    count = n;
+    struct dv_run *runs = NULL;
+    size_t max_encoded = DV_ENTRY_MAX_ENCODED;
+    if (ranges) {
+        runs = run_scratch(count);
+        count = aggregate_entries(entries, count, runs);
+        max_encoded = DV_RANGE_MAX_ENCODED;
+    }
+    char *buffer = r->ops->reserve(r->ctx, (size_t) count * max_encoded);
+    if (buffer == NULL && count > 0) {
+        // Better to send nothing than a DV missing some of its routes
+        LOG(LOG_ERROR, "Error: No room to encode a DV message of %d entries",
+                count);
+        m->version = DV_WIRE_VERSION;
+        m->body = NULL;
+        m->fragment_count = 0;
+        return;
+    }
+    int encoded = dv_message_encode(m, buffer, entries, runs, count,
+            DV_FRAGMENT_BODY_MAX);
+    if (encoded < count) {
+        // Not necessarily the right thing to do
+        LOG(LOG_WARN, "Warning: DV message has %d entries, only %d fit",
+                count, encoded);
+    }
+}
+
+// Split horizon with poisoned reverse: a neighbor is never told about the
+//  routes that go through it, other than that they are unreachable, so it
+//  can't pick a route that leads straight back to it when its own fails.
+//  Messages are built for a given neighbor (or for DV_EMPTY_PORT, meaning
+//  nobody in particular), and a message built for nobody can be shared by
+//  every neighbor none of its routes go through.
+
+// Returns 1 if any DV entry has port as its first hop
+static int routes_via(struct router *r, uint16_t port) {
+    return port < r->routes_limit && r->routes[port].via != DV_EMPTY_PORT;
+}
+
+// Encodes the whole DV, as told to the neighbor on to_port. Routes through
+//  it are left out, which in a full DV is the same as poisoning them. The
+//  message stays valid until the transport flushes.
+void create_dv_message(struct router *r, struct dv_message *m,
+        uint16_t to_port, int ranges) {
+    struct dv_entry *entries = dv_scratch(r->dv.length
+            + (r->holds_length - r->holds_start));
+    int n = 0;
+    int i;
+    for (i=0; i<r->dv.capacity; i++) {
+        struct dv_entry *e = &(r->dv.slots[i]);
+        if (dv_slot_used(e) && e->first_hop_port != to_port) {
+            entries[n++] = *e;
+        }
+    }
+    // Destinations held as gone have left the DV, but are still told of
+    size_t k;
+    for (k=r->holds_start; k<r->holds_length; k++) {
+        uint16_t dest_port = r->holds[k].dest_port;
+        if (r->routes[dest_port].gone && dv_find(&r->dv, dest_port) == NULL) {
+            struct dv_entry gone = { dest_port, 0, DV_COST_GONE };
+            entries[n++] = gone;
+        }
+    }
+    encode_dv_message(r, m, entries, n, ranges);
+}
+
+// Returns 1 if the last delta built for nobody in particular has routes
+//  through port, so it can't be shared with the neighbor there
+static int delta_routes_via(struct router *r, uint16_t port) {
+    return port < r->routes_limit
+            && r->routes[port].delta_stamp == r->delta_stamp;
+}
+
+// Encodes the current entries for every destination that changed after
+//  version since_version, as told to the neighbor on to_port: routes
+//  through it are withdrawn. The message stays valid until the transport
+//  flushes.
+static void create_dv_delta_message(struct router *r, struct dv_message *m,
+        uint64_t since_version, uint16_t to_port, int ranges) {
+    if (to_port == DV_EMPTY_PORT) {
+        r->delta_stamp++;
+    }
+
+    // A destination that changed more than once is in the journal more than
+    //  once, and encode_dv_message drops the repeats
+    struct dv_entry *entries =
+            dv_scratch(r->journal_base + r->journal_length - since_version);
+    int n = 0;
+    size_t i;
+    for (i = since_version - r->journal_base; i < r->journal_length; i++) {
+        uint16_t dest_port = r->journal[i];
+        uint32_t withdrawn_cost = r->routes[dest_port].gone ? DV_COST_GONE
+                : MAX_POSSIBLE_COST;
+        struct dv_entry withdrawal = { dest_port, 0, withdrawn_cost };
+        struct dv_entry *e = dv_find(&r->dv, dest_port);
+        if (e == NULL || e->first_hop_port == to_port) {
+            entries[n++] = withdrawal;
+            continue;
+        }
+        entries[n++] = *e;
+        if (to_port == DV_EMPTY_PORT) {
+            r->routes[e->first_hop_port].delta_stamp = r->delta_stamp;
+        }
+    }
+    encode_dv_message(r, m, entries, n, ranges);
+}
+
+// Sends every fragment of a DV message to a neighbor (or, if node is NULL,
+//  to some other port). The message is shared between neighbors; only the
+//  headers differ.
+static void send_dv_message(struct router *r, struct neighbor_list_node *node,
+        uint16_t dest_port, enum packet_type type,
+        const struct dv_message *m) {
+    uint32_t seq = 0;
+    if (node != NULL) {
+        node->tx_seq = dv_next_seq(node->tx_seq);
+        seq = node->tx_seq;
+        node->dv_version_sent = dv_version(r);
+    }
+    int i;
+    for (i=0; i<m->fragment_count; i++) {
+        struct dv_header header;
+        dv_message_header(m, i, type, seq, &header);
+        size_t body_length;
+        const char *body = dv_message_fragment(m, i, &body_length);
+        router_send(r, (char *) &header, sizeof header, body, body_length,
+                dest_port);
+    }
+}
+
+// Tells the neighbor on dest_port which DV message versions this router
+//  decodes, and, if ask is set, asks it to say the same
+static void send_wire_version(struct router *r, uint16_t dest_port,
+        int ask) {
+    char message[DV_VERSION_PACKET_SIZE] = {
+        DV_VERSION_PACKET, DV_WIRE_VERSION_RANGES, ask ? 1 : 0
+    };
+    router_send(r, message, sizeof message, NULL, 0, dest_port);
+}
+
+static void handle_version_packet(struct router *r, uint16_t sender_port,
+        const char *buffer, size_t length) {
+    if (length != DV_VERSION_PACKET_SIZE) {
+        LOG(LOG_WARN, "Message not understood, malformed version packet");
+        return;
+    }
+    struct neighbor_list_node *sender =
+            neighbor_list_find(r->neighbors, sender_port);
+    if (sender == NULL) {
+        LOG(LOG_WARN, "Warning: Version packet from port %u, which isn't a"
+                " neighbor", sender_port);
+        return;
+    }
+    sender->wire_version = (uint8_t) buffer[1];
+    LOG(LOG_INFO, "Neighbor %u decodes DV messages up to version %u",
+            sender_port, sender->wire_version);
+    if (buffer[2]) {
+        send_wire_version(r, sender_port, 0);
+    }
+}
+
+// Returns 1 if messages to node (which may be NULL) should carry ranges
+static int takes_ranges(struct router *r, struct neighbor_list_node *node) {
+    return r->aggregate && node != NULL
+            && node->wire_version >= DV_WIRE_VERSION_RANGES;
+}
+
+static void send_my_dv(struct router *r, uint16_t dest_port) {
+    LOG(LOG_DEBUG, "Sending DV to port %u", dest_port);
+    struct neighbor_list_node *node =
+            neighbor_list_find(r->neighbors, dest_port);
+    struct dv_message message;
+    create_dv_message(r, &message, dest_port, takes_ranges(r, node));
+
+    send_dv_message(r, node, dest_port, DV_PACKET, &message);
+    dv_journal_trim(r);
+}
+
+static void broadcast_my_dv(struct router *r, enum packet_type type) {
+    LOG(LOG_DEBUG, "Sending DV broadcast");
+    r->stats.broadcasts++;
+    struct dv_message shared, own;
+    unsigned long flush_count = r->ops->flush_count(r->ctx);
+
+    // Neighbors that take ranges get theirs in a second pass
+    int ranges;
+    for (ranges=0; ranges<(r->aggregate ? 2 : 1); ranges++) {
+        int have_shared = 0;
+        struct neighbor_list_node *node = r->neighbors;
+        for (; node!=NULL; node = node->next) {
+            if (takes_ranges(r, node) != ranges) {
+                continue;
+            }
+            if (r->ops->flush_count(r->ctx) != flush_count) {
+                have_shared = 0;
+                flush_count = r->ops->flush_count(r->ctx);
+            }
+            if (routes_via(r, node->port)) {
+                create_dv_message(r, &own, node->port, ranges);
+                send_dv_message(r, node, node->port, type, &own);
+                continue;
+            }
+            if (!have_shared) {
+                create_dv_message(r, &shared, DV_EMPTY_PORT, ranges);
+                have_shared = 1;
+            }
+            send_dv_message(r, node, node->port, type, &shared);
+        }
+    }
+    dv_journal_trim(r);
+}
+
+// Tells every neighbor what changed in the DV since its last DV message.
+// Neighbors that are equally far behind share one delta, unless it has
+//  routes through them; a neighbor that missed more changes than a full DV
+//  holds gets the full DV instead.
+static void broadcast_dv_changes(struct router *r) {
+    LOG(LOG_DEBUG, "Sending DV delta broadcast");
+    r->stats.broadcasts++;
+    struct dv_message full, delta, own;
+    unsigned long flush_count = r->ops->flush_count(r->ctx);
+
+    // Neighbors that take ranges get theirs in a second pass, so that only
+    //  one shared delta is live at a time, as delta_routes_via needs
+    int ranges;
+    for (ranges=0; ranges<(r->aggregate ? 2 : 1); ranges++) {
+        int have_full = 0;
+        int have_delta = 0;
+        uint64_t delta_since = 0;
+        struct neighbor_list_node *node = r->neighbors;
+        for (; node!=NULL; node = node->next) {
+            if (takes_ranges(r, node) != ranges) {
+                continue;
+            }
+            if (r->ops->flush_count(r->ctx) != flush_count) {
+                // The transport's buffers were recycled, so neither message
+                //  can be reused
+                have_full = 0;
+                have_delta = 0;
+                flush_count = r->ops->flush_count(r->ctx);
+            }
+            uint64_t since = node->dv_version_sent;
+            uint64_t change_count = dv_version(r) - since;
+            if (change_count == 0) {
+                continue;
+            }
+            if (change_count >= (uint64_t) r->dv.length) {
+                if (routes_via(r, node->port)) {
+                    create_dv_message(r, &own, node->port, ranges);
+                    send_dv_message(r, node, node->port, DV_PACKET, &own);
+                    continue;
+                }
+                if (!have_full) {
+                    create_dv_message(r, &full, DV_EMPTY_PORT, ranges);
+                    have_full = 1;
+                }
+                send_dv_message(r, node, node->port, DV_PACKET, &full);
+                continue;
+            }
+            if (!have_delta || delta_since != since) {
+                create_dv_delta_message(r, &delta, since, DV_EMPTY_PORT,
+                        ranges);
+                have_delta = 1;
+                delta_since = since;
+            }
+            if (delta_routes_via(r, node->port)) {
+                // Building this one may recycle the transport's buffers,
+                //  which the check at the top of the loop catches
+                create_dv_delta_message(r, &own, since, node->port, ranges);
+                send_dv_message(r, node, node->port, DV_DELTA_PACKET, &own);
+                continue;
+            }
+            send_dv_message(r, node, node->port, DV_DELTA_PACKET, &delta);
+        }
+    }
+    dv_journal_trim(r);
+}
+
+//-----------------------------------------------------------------------------
+// Triggered updates
+
+// Called after handling a message that changed the DV. The transport hears
+//  about it once the current batch has been handled; neighbors are told
+//  when the hold-down expires, so a burst of changes goes out as one update.
+static void dv_updated(struct router *r) {
+    uint64_t now = r->ops->now_ms(r->ctx);
+    if (!r->dv_dirty) {
+        r->dv_dirty = 1;
+        r->dv_first_change_ms = now;
+    }
+    r->dv_last_change_ms = now;
+    r->routes_stale = 1;
+}
+
+// Milliseconds until the pending triggered update is due, 0 if it is due
+//  now, or -1 if there is none
+static int update_delay_ms(struct router *r) {
+    if (!r->dv_dirty) {
+        return -1;
+    }
+    uint64_t due = r->dv_last_change_ms + r->min_update_delay_ms;
+    if (due < r->last_update_ms + r->min_update_delay_ms) {
+        due = r->last_update_ms + r->min_update_delay_ms;
+    }
+    if (due > r->dv_first_change_ms + r->max_update_delay_ms) {
+        due = r->dv_first_change_ms + r->max_update_delay_ms;
+    }
+    uint64_t now = r->ops->now_ms(r->ctx);
+    return due <= now ? 0 : (int) (due - now);
+}
+
+void router_refresh(struct router *r) {
+    LOG(LOG_DEBUG, "Periodic DV refresh");
+    // In case the last ask for its versions was lost
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (r->aggregate && node->up && node->wire_version == 0) {
+            send_wire_version(r, node->port, 1);
+        }
+    }
+    broadcast_my_dv(r, DV_PACKET);
+}
+
+//-----------------------------------------------------------------------------
+// Feasibility
+
+static inline uint32_t feasible_cost(struct router *r, uint16_t dest_port) {
+    if (dest_port >= r->routes_limit) {
+        return UINT32_MAX;
+    }
+    if (r->routes[dest_port].gone) {
+        // Nobody else can get there
+        return 0;
+    }
+    return r->feasibility ? r->routes[dest_port].feasible_cost : UINT32_MAX;
+}
+
+// Keeps the feasible cost of dest_port until the hold runs out, after a
+//  better route to it was passed over or its route was retracted, or after
+//  it went away
+static void route_hold(struct router *r, uint16_t dest_port) {
+    route_index_reserve(r, dest_port);
+    struct route_index_slot *slot = &(r->routes[dest_port]);
+    if (slot->held || (!r->feasibility && !slot->gone)) {
+        return;
+    }
+    slot->held = 1;
+    if (r->holds_length == r->holds_capacity) {
+        if (r->holds_start > 0) {
+            memmove(r->holds, &(r->holds[r->holds_start]),
+                    (r->holds_length - r->holds_start)
+                    * sizeof(struct route_hold));
+            r->holds_length -= r->holds_start;
+            r->holds_start = 0;
+        } else {
+            r->holds_capacity = r->holds_capacity == 0 ?
+                    16 : 2*r->holds_capacity;
+            r->holds = router_alloc(r->holds,
+                    r->holds_capacity * sizeof(struct route_hold));
+        }
+    }
+    struct route_hold *h = &(r->holds[r->holds_length++]);
+    h->dest_port = dest_port;
+    h->until_ms = r->ops->now_ms(r->ctx) + r->route_hold_ms;
+    LOG(LOG_DEBUG, "Holding dest %u for %d ms", dest_port,
+            r->route_hold_ms);
+}
+
+//-----------------------------------------------------------------------------
+// Bellman-Ford
+
+// advertised_cost is what the sender advertised for dest_port, which must
+//  be below the feasible cost unless the sender is the destination.
+// Returns 1 if DV was changed.
+// Returns 0 if not.
+// Returns a negative number if an error occured.
+int bellman_ford_decrease(struct router *r, uint16_t dest_port,
+        uint16_t sender_port, uint32_t cost_thru_sender,
+        uint32_t advertised_cost) {
+    if (dest_port == r->port) {
+        return 0;
+    }
+    if (cost_thru_sender < MAX_POSSIBLE_COST && dest_port != sender_port
+            && advertised_cost >= feasible_cost(r, dest_port)) {
+        // The sender may be routing through us on news older than our own
+        route_hold(r, dest_port);
+        return 0;
+    }
+    struct dv_entry *e = dv_find(&r->dv, dest_port);
+    if (e == NULL) {
+        if (cost_thru_sender >= MAX_POSSIBLE_COST) {
+            return 0;
+        }
+        e = dv_insert(&r->dv, dest_port);
+        e->first_hop_port = sender_port;
+        e->cost = cost_thru_sender;
+        dv_changed(r, dest_port);
+        LOG(LOG_INFO, "DV update: New entry: Dest %u first hop %u cost %u",
+                e->dest_port, e->first_hop_port, e->cost);
+        return 1;
+    } else if (cost_thru_sender >= MAX_POSSIBLE_COST) {
+        // The target is now unreachable, so delete its entry from the DV
+        LOG(LOG_INFO, "DV update: Deletion: Dest %u no longer reachable",
+                dest_port);
+        dv_remove(&r->dv, dest_port);
+        dv_changed(r, dest_port);
+        return 1;
+    } else if (cost_thru_sender < e->cost) {
+        LOG(LOG_INFO, "DV update: Entry for dest %u changed"
+                "     from first hop %u cost %u     to first hop %u cost %u",
+                dest_port, e->first_hop_port, e->cost, sender_port,
+                cost_thru_sender);
+        e->first_hop_port = sender_port;
+        e->cost = cost_thru_sender;
+        dv_changed(r, dest_port);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+// Lowest cost to dest_port through any neighbor advertising less than
+//  limit, according to the DVs they last sent, or over the direct link if
+//  dest_port is a neighbor that is up. Sets *passed_over if a neighbor
+//  advertising limit or more offers a lower cost.
+// Returns UINT32_MAX if there is no route.
+static uint32_t best_route(struct router *r, uint16_t dest_port,
+        uint32_t limit, uint16_t *best_first_hop_port, int *passed_over) {
+    int column;
+    uint32_t min_cost = adv_matrix_best(&r->adv, dest_port, &column);
+    uint32_t any_cost = min_cost;
+    if (min_cost < ADV_INFINITY
+            && min_cost - r->adv.link_cost[column] >= limit) {
+        // Rarely the case, so the limit only costs a second search then
+        min_cost = adv_matrix_best_below(&r->adv, dest_port, limit, &column);
+    }
+    if (min_cost >= ADV_INFINITY) {
+        min_cost = UINT32_MAX;
+    } else {
+        *best_first_hop_port = r->neighbor_ports[column];
+    }
+    struct neighbor_list_node *node = neighbor_list_find(r->neighbors,
+            dest_port);
+    if (node != NULL && node->up && node->cost <= min_cost) {
+        *best_first_hop_port = dest_port;
+        min_cost = node->cost;
+    }
+    *passed_over = any_cost < min_cost;
+    return min_cost;
+}
+
+// Replaces the DV entry for dest_port with the best feasible route there
+//  is, or deletes it if there is none. Called when the route it has got
+//  worse.
+static void dv_recompute(struct router *r, uint16_t dest_port) {
+    r->stats.recomputations++;
+    uint16_t best_first_hop_port = 0;
+    int passed_over;
+    uint32_t min_cost = best_route(r, dest_port, feasible_cost(r, dest_port),
+            &best_first_hop_port, &passed_over);
+    if (passed_over) {
+        route_hold(r, dest_port);
+    }
+    if (min_cost < MAX_POSSIBLE_COST) {
+        struct dv_entry *e = dv_insert(&r->dv, dest_port);
+        e->first_hop_port = best_first_hop_port;
+        e->cost = min_cost;
+    } else {
+        LOG(LOG_INFO, "DV update: Deletion: Dest %u no longer reachable",
+                dest_port);
+        dv_remove(&r->dv, dest_port);
+        // Routes that come up in the meantime may be the news of the
+        //  retraction going round a loop
+        route_hold(r, dest_port);
+    }
+    dv_changed(r, dest_port);
+}
+
+// The router on dest_port went away, as its KILLED_PACKET or a neighbor's
+//  DV_COST_GONE says, so it is held as gone: its route is withdrawn (unless
+//  it is a neighbor that is still up), and the next update passes the news
+//  on.
+// Returns 1 if the DV changed, or 0 if it was known to be gone already.
+static int route_gone(struct router *r, uint16_t dest_port) {
+    if (dest_port == r->port) {
+        return 0;
+    }
+    route_index_reserve(r, dest_port);
+    if (r->routes[dest_port].gone) {
+        return 0;
+    }
+    LOG(LOG_INFO, "DV update: Dest %u went away", dest_port);
+    r->routes[dest_port].gone = 1;
+    route_hold(r, dest_port);
+    dv_recompute(r, dest_port);
+    return 1;
+}
+
+// Brings the DV entry for dest_port up to date after the sender's DV entry
+//  for it changed: if the route through the sender got worse, look for the
+//  best route through any neighbor, and if it got better, take it.
+// Returns 1 if the DV changed.
+static int dv_reevaluate(struct router *r, struct neighbor_list_node *sender,
+        uint16_t dest_port) {
+    if (dest_port == r->port) {
+        return 0;
+    }
+    struct dv_entry *e = dv_find(&r->dv, dest_port);
+    struct dv_entry *senders_entry = dv_find(&sender->dv, dest_port);
+    uint32_t cost_thru_sender = senders_entry == NULL ?
+            UINT32_MAX : sender->cost + senders_entry->cost;
+
+    if (e != NULL && e->first_hop_port == sender->port &&
+            dest_port != sender->port && cost_thru_sender > e->cost) {
+        dv_recompute(r, dest_port);
+        return 1;
+    }
+    if (senders_entry != NULL && (e == NULL || cost_thru_sender < e->cost)) {
+        return bellman_ford_decrease(r, dest_port, sender->port,
+                cost_thru_sender, senders_entry->cost) > 0;
+    }
+    return 0;
+}
+
+int router_next_hops(struct router *r, const struct dv_entry *e,
+        uint16_t *next_hops, int max_count) {
+    next_hops[0] = e->first_hop_port;
+    int count = 1;
+    if (max_count > ROUTER_MAX_NEXT_HOPS) {
+        max_count = ROUTER_MAX_NEXT_HOPS;
+    }
+    if (max_count <= 1) {
+        return count;
+    }
+    // The same feasibility condition as for the DV's own first hop keeps
+    //  every one of them loop-free
+    int columns[ROUTER_MAX_NEXT_HOPS];
+    int column_count = adv_matrix_columns_at(&r->adv, e->dest_port, e->cost,
+            feasible_cost(r, e->dest_port), columns, max_count);
+    int i;
+    for (i=0; i<column_count && count<max_count; i++) {
+        uint16_t port = r->neighbor_ports[columns[i]];
+        if (port != e->first_hop_port) {
+            next_hops[count++] = port;
+        }
+    }
+    if (count < max_count && e->dest_port != e->first_hop_port) {
+        struct neighbor_list_node *node = neighbor_list_find(r->neighbors,
+                e->dest_port);
+        if (node != NULL && node->up && node->cost == e->cost) {
+            next_hops[count++] = e->dest_port;
+        }
+    }
+    // In port order, so the same next hops split flows the same way
+    //  whichever of them the DV entry has
+    for (i=1; i<count; i++) {
+        uint16_t port = next_hops[i];
+        int k = i;
+        for (; k>0 && next_hops[k-1] > port; k--) {
+            next_hops[k] = next_hops[k-1];
+        }
+        next_hops[k] = port;
+    }
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+// End of batch
+
+// Lifts the holds that ran out. By then the retractions that started them
+//  have reached the neighbors, so whatever they advertise is safe to use.
+// Returns the number of changes made to the DV.
+static int expire_holds(struct router *r) {
+    uint64_t now = r->ops->now_ms(r->ctx);
+    int change_count = 0;
+    while (r->holds_start < r->holds_length
+            && r->holds[r->holds_start].until_ms <= now) {
+        uint16_t dest_port = r->holds[r->holds_start++].dest_port;
+        r->routes[dest_port].held = 0;
+        r->routes[dest_port].gone = 0;
+        r->routes[dest_port].feasible_cost = UINT32_MAX;
+        uint16_t first_hop_port;
+        int passed_over;
+        uint32_t cost = best_route(r, dest_port, UINT32_MAX, &first_hop_port,
+                &passed_over);
+        struct dv_entry *e = dv_find(&r->dv, dest_port);
+        if (cost < MAX_POSSIBLE_COST && (e == NULL || cost < e->cost)) {
+            dv_recompute(r, dest_port);
+            change_count++;
+        }
+    }
+    if (r->holds_start == r->holds_length) {
+        r->holds_start = 0;
+        r->holds_length = 0;
+    }
+    return change_count;
+}
+
+// Routes through the neighbor are kept for restart_grace_ms, though it
+//  isn't heard from
+static void start_grace(struct router *r, struct neighbor_list_node *node) {
+    if (node->grace_until_ms == 0) {
+        r->grace_count++;
+    }
+    node->grace_until_ms = r->ops->now_ms(r->ctx) + r->restart_grace_ms;
+}
+
+static void end_grace(struct router *r, struct neighbor_list_node *node) {
+    if (node->grace_until_ms != 0) {
+        node->grace_until_ms = 0;
+        r->grace_count--;
+    }
+}
+
+// Neighbors that weren't heard from in time are taken for gone
+static void expire_grace(struct router *r) {
+    if (r->grace_count == 0) {
+        return;
+    }
+    uint64_t now = r->ops->now_ms(r->ctx);
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (node->grace_until_ms != 0 && node->grace_until_ms <= now) {
+            LOG(LOG_INFO, "Neighbor %u didn't come back from its restart",
+                    node->port);
+            router_neighbor_down(r, node->port);
+        }
+    }
+}
+
+// Milliseconds until the next grace period runs out, or -1 if there is none
+static int grace_delay_ms(struct router *r) {
+    if (r->grace_count == 0) {
+        return -1;
+    }
+    uint64_t until = UINT64_MAX;
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (node->grace_until_ms != 0 && node->grace_until_ms < until) {
+            until = node->grace_until_ms;
+        }
+    }
+    uint64_t now = r->ops->now_ms(r->ctx);
+    return until <= now ? 0 : (int) (until - now);
+}
+
+// The sooner of two delays, either of which may be -1 for none
+static inline int sooner(int a, int b) {
+    return a < 0 || (b >= 0 && b < a) ? b : a;
+}
+
+// Milliseconds until the next hold runs out, or -1 if there is none
+static int hold_delay_ms(struct router *r) {
+    if (r->holds_start == r->holds_length) {
+        return -1;
+    }
+    uint64_t until = r->holds[r->holds_start].until_ms;
+    uint64_t now = r->ops->now_ms(r->ctx);
+    return until <= now ? 0 : (int) (until - now);
+}
+
+void router_end_batch(struct router *r) {
+    expire_grace(r);
+    if (expire_holds(r) > 0) {
+        router_print_dv(r);
+        dv_updated(r);
+    }
+    if (r->routes_stale) {
+        if (r->ops->routes_changed != NULL) {
+            r->ops->routes_changed(r->ctx);
+        }
+        r->routes_stale = 0;
+    }
+    int delay = update_delay_ms(r);
+    if (delay == 0) {
+        broadcast_dv_changes(r);
+        r->dv_dirty = 0;
+        r->last_update_ms = r->ops->now_ms(r->ctx);
+        delay = -1;
+    }
+    delay = sooner(delay, hold_delay_ms(r));
+    delay = sooner(delay, grace_delay_ms(r));
+    if (delay >= 0) {
+        r->ops->set_update_timer(r->ctx, delay);
+    }
+}
+
+void router_update_timer_expired(struct router *r) {
+    router_end_batch(r);
+}
+
+//-----------------------------------------------------------------------------
+// Receiving DVs
+
+// Records what the sender advertises for dest_port. A route as cheap as
+//  the DV's own through another neighbor is one more next hop, so making or
+//  breaking one changes the routes, though not the DV.
+static void set_advertised(struct router *r, struct neighbor_list_node *sender,
+        uint16_t dest_port, uint32_t cost) {
+    struct dv_entry *e = dv_find(&r->dv, dest_port);
+    if (e != NULL && e->first_hop_port != sender->port) {
+        uint32_t old_cost = adv_matrix_get(&r->adv, sender->column, dest_port);
+        if (old_cost + sender->cost == e->cost
+                || cost + sender->cost == e->cost) {
+            r->routes_stale = 1;
+        }
+    }
+    adv_matrix_set(&r->adv, sender->column, dest_port, cost);
+}
+
+// Replaces everything we know about the sender's DV with received, which
+//  is left holding the old DV. seq is the message's sequence number.
+//
+// Returns the number of changes made to the DV
+static int apply_full_dv(struct router *r, struct neighbor_list_node *sender,
+        uint32_t seq, struct dv_table *received) {
+    // Destinations whose advertised cost changed, then those it says are gone
+    uint16_t *changed = port_scratch(2*received->length + sender->dv.length);
+    int changed_count = 0;
+    uint16_t *gone = changed + received->length + sender->dv.length;
+    int gone_count = 0;
+    uint16_t sender_port = sender->port;
+    // Deltas that follow build on this message
+    sender->rx_seq = seq;
+    if (!sender->up) {
+        // The direct link may be another next hop
+        sender->up = 1;
+        r->routes_stale = 1;
+    }
+
+    // Gone destinations aren't advertised, as far as the diff goes
+    int i;
+    for (i=0; i<received->capacity; i++) {
+        struct dv_entry *e = &(received->slots[i]);
+        if (dv_slot_used(e) && e->cost == DV_COST_GONE) {
+            gone[gone_count++] = e->dest_port;
+        }
+    }
+    dv_purge(received, MAX_POSSIBLE_COST);
+
+    // Diff the new DV against the one stored for the sender: new or changed
+    //  entries first, then withdrawn ones
+    for (i=0; i<received->capacity; i++) {
+        struct dv_entry *e = &(received->slots[i]);
+        if (!dv_slot_used(e)) {
+            continue;
+        }
+        LOG(LOG_TRACE, "Entry: Dest port %u cost %u", e->dest_port, e->cost);
+        struct dv_entry *old = dv_find(&sender->dv, e->dest_port);
+        if (old == NULL || old->cost != e->cost) {
+            changed[changed_count++] = e->dest_port;
+        }
+    }
+    for (i=0; i<sender->dv.capacity; i++) {
+        struct dv_entry *old = &(sender->dv.slots[i]);
+        if (dv_slot_used(old) && dv_find(received, old->dest_port) == NULL) {
+            changed[changed_count++] = old->dest_port;
+        }
+    }
+
+    struct dv_table old_dv = sender->dv;
+    sender->dv = *received;
+    *received = old_dv;
+
+    // Only the destinations that changed need Bellman-Ford
+    int change_count = 0;
+    for (i=0; i<changed_count; i++) {
+        struct dv_entry *e = dv_find(&sender->dv, changed[i]);
+        set_advertised(r, sender, changed[i],
+                e != NULL ? e->cost : ADV_INFINITY);
+        change_count += dv_reevaluate(r, sender, changed[i]);
+    }
+    for (i=0; i<gone_count; i++) {
+        change_count += route_gone(r, gone[i]);
+    }
+    // Finally, if my DV doesn't have an entry for the sender itself (because
+    //  previously the sender was not alive), add an entry.
+    if (bellman_ford_decrease(r, sender_port, sender_port, sender->cost,
+            0) > 0) {
+        change_count++;
+    }
+
+    if (change_count > 0) {
+        router_print_dv(r);
+    } else {
+        LOG(LOG_DEBUG, "DV did not change (%d advertised costs changed)",
+                changed_count);
+    }
+    return change_count;
+}
+
+// Asks the neighbor for its full DV, unless it was asked too recently for
+//  the answer to have come back
+static void request_full_dv(struct router *r,
+        struct neighbor_list_node *node) {
+    uint64_t now = r->ops->now_ms(r->ctx);
+    if (now < node->resync_due_ms) {
+        LOG(LOG_DEBUG, "Still waiting for full DV from port %u", node->port);
+        return;
+    }
+    LOG(LOG_INFO, "Requesting full DV from port %u", node->port);
+    node->resync_due_ms = now + DV_RESYNC_INTERVAL_MS;
+    char request[sizeof(struct dv_header)] = { DV_RESYNC_PACKET };
+    router_send(r, request, sizeof request, NULL, 0, node->port);
+}
+
+// Applies only the entries in the delta, and only re-evaluates those
+//  destinations. A delta that doesn't directly follow the last message from
+//  the sender can't be applied, so we ask for the full DV instead, and keep
+//  asking as long as deltas come in its place.
+//
+// Returns the number of changes made to the DV
+static int apply_dv_delta(struct router *r, struct neighbor_list_node *sender,
+        uint32_t seq, struct dv_table *received) {
+    uint16_t sender_port = sender->port;
+    if (sender->rx_seq == 0) {
+        // Its full DV hasn't arrived yet, or it was lost
+        LOG(LOG_DEBUG, "Waiting for full DV from port %u, ignoring delta %u",
+                sender_port, seq);
+        request_full_dv(r, sender);
+        return 0;
+    }
+    if (seq != dv_next_seq(sender->rx_seq)) {
+        LOG(LOG_INFO, "Missed DV messages from port %u (got %u after %u)",
+                sender_port, seq, sender->rx_seq);
+        sender->rx_seq = 0;
+        request_full_dv(r, sender);
+        return 0;
+    }
+    sender->rx_seq = seq;
+
+    int change_count = 0;
+    int i;
+    for (i=0; i<received->capacity; i++) {
+        struct dv_entry *e = &(received->slots[i]);
+        if (!dv_slot_used(e)) {
+            continue;
+        }
+        LOG(LOG_TRACE, "Entry: Dest port %u cost %u", e->dest_port, e->cost);
+        if (e->cost >= MAX_POSSIBLE_COST) {
+            dv_remove(&sender->dv, e->dest_port);
+            set_advertised(r, sender, e->dest_port, ADV_INFINITY);
+        } else {
+            *dv_insert(&sender->dv, e->dest_port) = *e;
+            set_advertised(r, sender, e->dest_port, e->cost);
+        }
+        change_count += dv_reevaluate(r, sender, e->dest_port);
+        if (e->cost == DV_COST_GONE) {
+            change_count += route_gone(r, e->dest_port);
+        }
+    }
+    // As in apply_full_dv, the sender itself may be new to the DV
+    if (bellman_ford_decrease(r, sender_port, sender_port, sender->cost,
+            0) > 0) {
+        change_count++;
+    }
+
+    if (change_count > 0) {
+        router_print_dv(r);
+    } else {
+        LOG(LOG_DEBUG, "DV did not change");
+    }
+    return change_count;
+}
+
+// See comment on DV message format.
+// Collects the fragments of a DV message and applies it once complete. A
+//  newly started neighbor gets our full DV in reply to its initial one.
+//
+// Returns the number of changes made to the DV, or a negative number if error
+int handle_dv_packet(struct router *r, uint16_t sender_port,
+        char *buffer, size_t length) {
+    LOG(LOG_DEBUG, "DV packet (type %u) from port %u:", buffer[0],
+            sender_port);
+    struct neighbor_list_node *sender =
+            neighbor_list_find(r->neighbors, sender_port);
+    if (sender == NULL) {
+        // Not necessarily the right thing to do
+        LOG(LOG_WARN, "Warning: Sender is not a known neighbor; ignoring its message");
+        return -1;
+    }
+    // It's back, if it was restarting
+    end_grace(r, sender);
+    // Whoever sends ranges decodes them, even if its DV_VERSION_PACKET was
+    //  lost
+    if (length > 1 && buffer[1] == DV_WIRE_VERSION_RANGES
+            && sender->wire_version < DV_WIRE_VERSION_RANGES) {
+        sender->wire_version = DV_WIRE_VERSION_RANGES;
+    }
+    struct dv_reassembly *rx = &sender->rx;
+    int complete = dv_reassembly_add(rx, buffer, length);
+    if (complete < 0) {
+        LOG(LOG_WARN, "Message not understood, malformed DV packet");
+        return -1;
+    }
+    if (complete == 0) {
+        LOG(LOG_DEBUG, "Waiting for the rest of DV message %u", rx->seq);
+        return 0;
+    }
+    if (rx->type == DV_DELTA_PACKET) {
+        return apply_dv_delta(r, sender, rx->seq, &rx->entries);
+    }
+    int change_count = apply_full_dv(r, sender, rx->seq, &rx->entries);
+    if (rx->type == INITIAL_DV_PACKET) {
+        // The sender has just started, so it needs our full DV right away;
+        //  everyone else only needs to hear what changed
+        send_my_dv(r, sender_port);
+    }
+    return change_count;
+}
+
+void router_neighbor_down(struct router *r, uint16_t port) {
+    struct neighbor_list_node *sender = neighbor_list_find(r->neighbors, port);
+    if (sender == NULL) {
+        // Not necessarily the right thing to do
+        LOG(LOG_WARN, "Warning: Sender is not a known neighbor; ignoring its message");
+        return;
+    }
+    if (!sender->up) {
+        LOG(LOG_WARN, "Warning: Neighbor %u is already down", port);
+        return;
+    }
+    LOG(LOG_INFO, "DV update: Neighbor %u went down", port);
+
+    // Forget everything it advertised
+    // (a sequence number of 0 means we expect a full DV from it next)
+    sender->up = 0;
+    end_grace(r, sender);
+    dv_clear(&sender->dv);
+    adv_matrix_clear_column(&r->adv, sender->column);
+    sender->rx_seq = 0;
+
+    // Update DV table (anything with the neighbor as first hop, including
+    //  the neighbor itself, is affected, and the reverse index lists exactly
+    //  those). The neighbor may still be reachable another way.
+    uint16_t *affected = port_scratch(r->dv.length);
+    int affected_count = 0;
+    uint16_t dest_port = port < r->routes_limit ?
+            r->routes[port].via : DV_EMPTY_PORT;
+    for (; dest_port != DV_EMPTY_PORT; dest_port = r->routes[dest_port].next) {
+        affected[affected_count++] = dest_port;
+    }
+    int i;
+    for (i=0; i<affected_count; i++) {
+        dv_recompute(r, affected[i]);
+    }
+    router_print_dv(r);
+    dv_updated(r);
+}
+
+void router_set_link_cost(struct router *r, uint16_t port, uint32_t cost) {
+    struct neighbor_list_node *node = neighbor_list_find(r->neighbors, port);
+    if (node == NULL) {
+        LOG(LOG_WARN, "Warning: Port %u is not a known neighbor; its link"
+                " cost stays as it is", port);
+        return;
+    }
+    if (cost >= MAX_POSSIBLE_COST) {
+        cost = MAX_POSSIBLE_COST - 1;
+    }
+    if (cost == node->cost) {
+        return;
+    }
+    LOG(LOG_INFO, "DV update: Link cost to neighbor %u changed from %u to %u",
+            port, node->cost, cost);
+    uint32_t old_cost = node->cost;
+    node->cost = cost;
+    if (node->column < 0) {
+        // Not started yet; router_start takes the cost from here
+        return;
+    }
+    adv_matrix_set_link_cost(&r->adv, node->column, cost);
+    if (!node->up) {
+        return;
+    }
+    // Routes through it as cheap as the DV's own may come or go
+    r->routes_stale = 1;
+
+    int change_count = 0;
+    int i;
+    if (cost > old_cost) {
+        // Every route through it got worse, as when the neighbor goes down,
+        //  but the neighbor may still be the best first hop
+        uint16_t *affected = port_scratch(r->dv.length);
+        int affected_count = 0;
+        uint16_t dest_port = port < r->routes_limit ?
+                r->routes[port].via : DV_EMPTY_PORT;
+        for (; dest_port != DV_EMPTY_PORT;
+                dest_port = r->routes[dest_port].next) {
+            affected[affected_count++] = dest_port;
+        }
+        for (i=0; i<affected_count; i++) {
+            dv_recompute(r, affected[i]);
+        }
+        change_count = affected_count;
+    } else {
+        // Every route through it got better, so it may beat the DV's
+        for (i=0; i<node->dv.capacity; i++) {
+            struct dv_entry *e = &(node->dv.slots[i]);
+            if (dv_slot_used(e)) {
+                change_count += dv_reevaluate(r, node, e->dest_port);
+            }
+        }
+        if (bellman_ford_decrease(r, port, port, cost, 0) > 0) {
+            change_count++;
+        }
+    }
+    if (change_count > 0) {
+        router_print_dv(r);
+        dv_updated(r);
+    }
+}
+
+static void handle_probe_packet(struct router *r, uint16_t sender_port,
+        const char *buffer, size_t length) {
+    if (length != PROBE_PACKET_SIZE) {
+        LOG(LOG_WARN, "Message not understood, malformed probe");
+        return;
+    }
+    if (neighbor_list_find(r->neighbors, sender_port) == NULL) {
+        LOG(LOG_WARN, "Warning: Probe from port %u, which isn't a neighbor",
+                sender_port);
+        return;
+    }
+    char reply[PROBE_PACKET_SIZE];
+    memcpy(reply, buffer, sizeof reply);
+    reply[0] = PROBE_REPLY_PACKET;
+    router_send(r, reply, sizeof reply, NULL, 0, sender_port);
+}
+
+static void handle_restarting_packet(struct router *r,
+        uint16_t sender_port) {
+    struct neighbor_list_node *sender =
+            neighbor_list_find(r->neighbors, sender_port);
+    if (sender == NULL || !sender->up) {
+        LOG(LOG_WARN, "Warning: Restarting_packet from port %u, which isn't"
+                " a neighbor that is up", sender_port);
+        return;
+    }
+    LOG(LOG_INFO, "Neighbor %u is restarting, keeping its routes for %d ms",
+            sender_port, r->restart_grace_ms);
+    start_grace(r, sender);
+    // It may come back as a build that decodes other versions
+    sender->wire_version = 0;
+}
+
+static void handle_killed_packet(struct router *r, uint16_t sender_port) {
+    // Note: doesn't matter what rest of message is, just that neighbor was killed
+    LOG(LOG_INFO, "Killed_packet from port %u:", sender_port);
+    router_neighbor_down(r, sender_port);
+    // Whatever comes back on its port may decode other versions
+    struct neighbor_list_node *sender =
+            neighbor_list_find(r->neighbors, sender_port);
+    if (sender != NULL) {
+        sender->wire_version = 0;
+    }
+    // Not just the link: the router is gone, and everyone is told so
+    if (route_gone(r, sender_port) > 0) {
+        dv_updated(r);
+    }
+    LOG(LOG_INFO, "Finished dv_table update following Killed_packet from port %u:", sender_port);
+}
+
+void router_handle_packet(struct router *r, uint16_t sender_port,
+        char *buffer, size_t length) {
+    r->stats.messages_received++;
+    r->stats.bytes_received += length;
+    if (length == 0) {
+        LOG(LOG_WARN, "Message not understood, 0 bytes received");
+        return;
+    }
+
+    switch (buffer[0]) {
+        case DV_PACKET:
+        case DV_DELTA_PACKET:
+        case INITIAL_DV_PACKET:
+            if (handle_dv_packet(r, sender_port, buffer, length) > 0) {
+                dv_updated(r);
+            }
+        break;
+        case DV_RESYNC_PACKET:
+            LOG(LOG_INFO, "Full DV requested by port %u", sender_port);
+            send_my_dv(r, sender_port);
+        break;
+        case KILLED_PACKET:
+            handle_killed_packet(r, sender_port);
+        break;
+        case RESTARTING_PACKET:
+            handle_restarting_packet(r, sender_port);
+        break;
+        case PROBE_PACKET:
+            handle_probe_packet(r, sender_port, buffer, length);
+        break;
+        case PROBE_REPLY_PACKET:
+            // The transport takes the replies to its own probes
+            LOG(LOG_DEBUG, "Ignoring probe reply from port %u", sender_port);
+        break;
+        case DV_VERSION_PACKET:
+            handle_version_packet(r, sender_port, buffer, length);
+        break;
+        default:
+            LOG(LOG_WARN, "Message not understood, packet type not recognized");
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void router_init(struct router *r, const char *name, uint16_t port,
+        const struct router_ops *ops, void *ctx) {
+    memset(r, 0, sizeof *r);
+    r->name = name;
+    r->port = port;
+    dv_init(&r->dv);
+    r->min_update_delay_ms = DEFAULT_MIN_UPDATE_DELAY_MS;
+    r->max_update_delay_ms = DEFAULT_MAX_UPDATE_DELAY_MS;
+    r->route_hold_ms = DEFAULT_ROUTE_HOLD_MS;
+    r->restart_grace_ms = DEFAULT_RESTART_GRACE_MS;
+    r->ops = ops;
+    r->ctx = ctx;
+}
+
+void router_free(struct router *r) {
+    struct neighbor_list_node *node = r->neighbors;
+    while (node != NULL) {
+        struct neighbor_list_node *next = node->next;
+        dv_free(&node->dv);
+        dv_reassembly_free(&node->rx);
+        free(node);
+        node = next;
+    }
+    r->neighbors = NULL;
+    if (r->neighbor_ports != NULL) {
+        adv_matrix_free(&r->adv);
+    }
+    free(r->neighbor_ports);
+    free(r->journal);
+    free(r->routes);
+    free(r->holds);
+    dv_free(&r->dv);
+}
+
+void router_add_neighbor(struct router *r, uint16_t port, uint32_t cost) {
+    struct neighbor_list_node *n = malloc(sizeof(struct neighbor_list_node));
+    if (n==NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    n->port = port;
+    n->cost = cost;
+    dv_init(&n->dv);
+    n->column = -1;
+    n->tx_seq = 0;
+    n->rx_seq = 0;
+    n->resync_due_ms = 0;
+    n->dv_version_sent = 0;
+    n->wire_version = 0;
+    n->up = 0;
+    n->grace_until_ms = 0;
+    dv_reassembly_init(&n->rx);
+    // Later neighbors go first, as they always have
+    n->next = r->neighbors;
+    r->neighbors = n;
+}
+
+// Gives every neighbor a column in the adv matrix, in neighbor list order
+static void router_init_adv_matrix(struct router *r) {
+    int count = 0;
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        count++;
+    }
+    adv_matrix_init(&r->adv, count);
+    r->neighbor_ports = router_alloc(NULL,
+            (count > 0 ? count : 1) * sizeof(uint16_t));
+    int column = 0;
+    for (node = r->neighbors; node!=NULL; node = node->next) {
+        node->column = column;
+        r->neighbor_ports[column] = node->port;
+        adv_matrix_set_link_cost(&r->adv, column, node->cost);
+        column++;
+    }
+}
+
+int router_restore(struct router *r, uint16_t from_port,
+        const struct dv_entry *e) {
+    if (e != NULL && e->cost >= MAX_POSSIBLE_COST) {
+        return -1;
+    }
+    if (from_port == r->port) {
+        if (e == NULL) {
+            return -1;
+        }
+        struct neighbor_list_node *hop = neighbor_list_find(r->neighbors,
+                e->first_hop_port);
+        if (e->dest_port == r->port || hop == NULL || !hop->up) {
+            return -1;
+        }
+        *dv_insert(&r->dv, e->dest_port) = *e;
+        return 0;
+    }
+    struct neighbor_list_node *node = neighbor_list_find(r->neighbors,
+            from_port);
+    if (node == NULL) {
+        return -1;
+    }
+    if (e != NULL) {
+        *dv_insert(&node->dv, e->dest_port) = *e;
+    }
+    node->up = 1;
+    return 0;
+}
+
+void router_start(struct router *r) {
+    router_init_adv_matrix(r);
+
+    // After a warm restart, the restored neighbors count as up, though
+    //  only until the grace period runs out unless they answer
+    int i;
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (!node->up) {
+            continue;
+        }
+        for (i=0; i<node->dv.capacity; i++) {
+            struct dv_entry *e = &(node->dv.slots[i]);
+            if (dv_slot_used(e)) {
+                adv_matrix_set(&r->adv, node->column, e->dest_port, e->cost);
+            }
+        }
+        start_grace(r, node);
+    }
+    for (i=0; i<r->dv.capacity; i++) {
+        struct dv_entry *e = &(r->dv.slots[i]);
+        if (dv_slot_used(e)) {
+            dv_changed(r, e->dest_port);
+            r->routes_stale = 1;
+        }
+    }
+
+    // The initial DV asks every neighbor for its full DV. If ranges are to
+    //  be sent, their versions are asked for first, so that the answers can
+    //  use them.
+    uint64_t now = r->ops->now_ms(r->ctx);
+    for (node = r->neighbors; node!=NULL; node = node->next) {
+        node->resync_due_ms = now + DV_RESYNC_INTERVAL_MS;
+        if (r->aggregate) {
+            send_wire_version(r, node->port, 1);
+        }
+    }
+
+    router_print_dv(r);
+    broadcast_my_dv(r, INITIAL_DV_PACKET);
+    router_end_batch(r);
+}
+
+void router_restart(struct router *r) {
+    LOG(LOG_INFO, "Sending Restarting broadcast");
+    char message = RESTARTING_PACKET;
+
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        router_send(r, &message, 1, NULL, 0, node->port);
+    }
+}
+
+void router_shutdown(struct router *r) {
+    // send dying message to all neighbors
+    // message consists of KILLED_PACKET, padded to length of single dv_entry
+
+    LOG(LOG_INFO, "Sending Killed broadcast");
+    char message = KILLED_PACKET;
+
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        router_send(r, &message, 1, NULL, 0, node->port);
+    }
+}
@@ -0,0 +1,297 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dv_table.h"
+#include "dv_message.h"
+#include "adv_matrix.h"
+
+// The distance vector protocol of one router, independent of how packets
+//  actually move: myrouter drives it from UDP sockets and an event loop,
+//  the simulator drives thousands of them over a fake network in one
+//  process, and routerd serves many of them from a pool of threads.
+//  Everything the protocol needs from outside goes through struct
+//  router_ops. A router must only be driven by one thread at a time; the
+//  scratch space all routers share is per thread.
+
+#define MAX_POSSIBLE_COST 64
+
+// Triggered updates are held down for at least the minimum delay after the
+//  last change (and after the previous broadcast), but no longer than the
+//  maximum delay after the first change that hasn't been sent
+#define DEFAULT_MIN_UPDATE_DELAY_MS 10
+#define DEFAULT_MAX_UPDATE_DELAY_MS 100
+#define DEFAULT_ROUTE_HOLD_MS 150 // 1.5 times the longest hold-down
+
+// A neighbor that keeps sending deltas that can't be applied is asked for
+//  its full DV again, but no more often than this, in case the request or
+//  the reply got lost
+#define DV_RESYNC_INTERVAL_MS 100
+
+// How long routes through a neighbor are kept while it restarts, and after
+//  a warm restart, through neighbors that haven't been heard from yet
+#define DEFAULT_RESTART_GRACE_MS 10000
+
+// Most equal-cost first hops router_next_hops gives for a destination
+#define ROUTER_MAX_NEXT_HOPS 8
+
+enum packet_type {
+    DATA_PACKET = 1,
+    DV_PACKET = 2,
+    KILLED_PACKET = 3,
+    INITIAL_DV_PACKET = 4,
+    DV_DELTA_PACKET = 5,
+    DV_RESYNC_PACKET = 6, // Asks a neighbor for its full DV
+    RESTARTING_PACKET = 7, // Going down to restart warm; keep its routes
+    PROBE_PACKET = 8, // Measures the round trip to a neighbor
+    PROBE_REPLY_PACKET = 9,
+    DV_VERSION_PACKET = 10 // Says which DV message versions the sender reads
+};
+
+// A PROBE_PACKET is PROBE_PACKET_SIZE bytes, of which only the type is
+//  looked at: every router echoes it back to the sender as a
+//  PROBE_REPLY_PACKET, unchanged otherwise. What the rest holds is up to the
+//  prober (see link_probe.h).
+#define PROBE_PACKET_SIZE 16
+
+// A DV_VERSION_PACKET is DV_VERSION_PACKET_SIZE bytes:
+//      1 byte packet type
+//      1 byte highest DV message version the sender decodes
+//      1 byte 1 if the sender wants one back, else 0
+// Routers that aggregate send one, wanting an answer, to every neighbor when
+//  they start, and again on each refresh to neighbors that haven't answered;
+//  every router answers. Routers from before DV_VERSION_PACKET drop it as
+//  not understood, so they never answer, and they are never sent anything
+//  they can't decode.
+#define DV_VERSION_PACKET_SIZE 3
+
+#define DV_COST_GONE (MAX_POSSIBLE_COST + 1)
+
+// Transports send DV messages (and every other packet type but
+//  DATA_PACKET) to and from each router's port plus this, so that a flood of
+//  data packets can't hold them up. 0 shares the one port.
+#define DEFAULT_CONTROL_PORT_OFFSET 1000
+
+// DV messages (DV_PACKET, INITIAL_DV_PACKET or DV_DELTA_PACKET) use the
+//  format described in dv_message.h. Their sequence numbers are counted
+//  separately for each neighbor (0 means the sender doesn't number its
+//  messages).
+//
+// A DV_DELTA_PACKET carries only the entries that changed since the previous
+//  message to the same neighbor. An entry with a cost of MAX_POSSIBLE_COST
+//  withdraws that destination. An entry with a cost of DV_COST_GONE (in any
+//  DV message) says the destination router itself has gone away, as its
+//  neighbors learn from its KILLED_PACKET: every router that hears of it
+//  withdraws its route there, passes the news on, and takes no route there
+//  through any other router until its hold runs out. Routes through
+//  neighbors that haven't heard yet can't keep a loop going meanwhile, so
+//  the destination's cost doesn't count up to infinity. Routers that don't
+//  know DV_COST_GONE take it for a withdrawal.
+// A router that gets a delta it can't apply, because it missed a message or
+//  never got the full DV, asks for the full DV with a DV_RESYNC_PACKET, and
+//  asks again on later deltas (at most every DV_RESYNC_INTERVAL_MS) until a
+//  full DV arrives.
+//
+// A router that aggregates sends each run of consecutive destination ports
+//  whose costs go up or down by the same step from one port to the next
+//  (most often 0) as one range entry, which saves the most where ports are
+//  handed out in blocks by area. Only the wire format is aggregated: ranges
+//  are exact, and receivers expand them into one entry per destination, so
+//  Bellman-Ford and the FIB still work per destination. In sim that made
+//  DV traffic 25% smaller on a grid and 6% on a random network.
+// Ranges need version 3 messages, which a neighbor is only sent once it
+//  has said, with a DV_VERSION_PACKET or a version 3 message of its own,
+//  that it decodes them. Until then it gets version 2.
+
+// Singly linked list of information about neighboring nodes
+struct neighbor_list_node {
+    uint16_t port;
+    uint32_t cost;
+    struct dv_table dv; // The neighbor node's DV
+    int column; // Its column in the router's adv matrix
+    uint32_t tx_seq; // Sequence number of the last DV message sent to it
+    uint32_t rx_seq; // Last one received from it, 0 if we need a full DV
+    uint64_t resync_due_ms; // When it may be asked for its full DV again
+    uint64_t dv_version_sent; // dv_version() as of the last message to it
+    uint8_t wire_version; // Highest DV message version it decodes, 0 until
+                          //  it says
+    struct dv_reassembly rx; // DV message being received from it
+    int up; // It has sent its DV, and hasn't gone down since
+    uint64_t grace_until_ms; // If not 0, its routes are kept this long
+                             //  without hearing from it
+    struct neighbor_list_node *next;
+};
+
+struct neighbor_list_node *
+neighbor_list_find(struct neighbor_list_node *list_head, uint16_t port);
+
+struct router_ops {
+    // Returns space for a message body of up to size bytes that stays valid
+    //  until the transport flushes, which flush_count tells, or NULL if it
+    //  can't hold that much
+    char *(*reserve)(void *ctx, size_t size);
+    unsigned long (*flush_count)(void *ctx);
+    // Sends head followed by body as one datagram. The head is copied; the
+    //  body must stay valid until the transport flushes.
+    void (*send)(void *ctx, const char *head, size_t head_length,
+            const char *body, size_t body_length, uint16_t dest_port);
+    uint64_t (*now_ms)(void *ctx);
+    // Asks for router_update_timer_expired to be called delay_ms from now
+    void (*set_update_timer)(void *ctx, uint64_t delay_ms);
+    // The routes changed (optional). Called at most once per batch.
+    void (*routes_changed)(void *ctx);
+};
+
+struct router_stats {
+    uint64_t messages_sent;
+    uint64_t bytes_sent;
+    uint64_t messages_received;
+    uint64_t bytes_received;
+    uint64_t route_changes; // Changes to the router's DV
+    uint64_t recomputations; // Destinations whose best route was searched for
+    uint64_t broadcasts; // Triggered updates and refreshes to all neighbors
+};
+
+// Reverse index of the DV by first hop: the destinations routed through
+//  each neighbor form a doubly linked list, threaded through an array
+//  indexed by port. Port 0 (DV_EMPTY_PORT) ends a list.
+// The same array keeps each destination's feasible cost, the lowest cost
+//  the router has had to it since the last hold ran out. Only a neighbor
+//  advertising less than that can't be routing through this router, so only
+//  those are taken as first hops; when a better route is passed over for
+//  it, the destination is held for a while, and then the limit is lifted.
+// The condition is only applied if feasibility is set. It stops counting to
+//  infinity in general, but it also holds destinations on a worse route
+//  whenever theirs gets worse, which in sim makes reconverging after a link
+//  failure take several times as long. A router that went away is taken
+//  care of without it: its destination is held as gone (see DV_COST_GONE),
+//  which makes its feasible cost 0, so only the router itself is taken as a
+//  first hop there.
+struct route_index_slot {
+    uint16_t via; // First destination routed through this port
+    uint16_t hop; // First hop of this destination
+    uint16_t next;
+    uint16_t prev;
+    uint32_t feasible_cost; // UINT32_MAX if there is no limit
+    int held;
+    int gone; // The destination router went away; cleared with the hold
+    uint32_t delta_stamp; // As a first hop: the router's delta_stamp when
+                          //  the last shared delta had routes through it
+};
+
+struct route_hold {
+    uint16_t dest_port;
+    uint64_t until_ms;
+};
+
+struct router {
+    const char *name; // May be NULL
+    uint16_t port;
+    struct dv_table dv;
+    struct neighbor_list_node *neighbors;
+    struct adv_matrix adv; // Every neighbor's DV, for finding best routes
+    uint16_t *neighbor_ports; // Port of the neighbor in each adv column
+
+    // Destinations whose DV entries changed, oldest first, from which DV
+    //  deltas are built. Entry i was the change that made version
+    //  journal_base + i + 1.
+    uint16_t *journal;
+    size_t journal_length;
+    size_t journal_capacity;
+    uint64_t journal_base;
+
+    struct route_index_slot *routes;
+    int routes_limit; // Ports the routes array covers
+    uint32_t delta_stamp; // Counts the deltas built for nobody in particular
+
+    // Held destinations, in order of until_ms (they are all held for
+    //  route_hold_ms), from holds_start to holds_length
+    struct route_hold *holds;
+    size_t holds_start;
+    size_t holds_length;
+    size_t holds_capacity;
+    int route_hold_ms;
+    int feasibility; // Only feasible routes are taken (off by default)
+
+    int grace_count; // Neighbors with a grace_until_ms
+    int restart_grace_ms;
+
+    int aggregate; // DV messages carry ranges (version 3)
+
+    int min_update_delay_ms;
+    int max_update_delay_ms;
+    int routes_stale; // The DV changed since routes_changed was last called
+    int dv_dirty; // The DV changed since the last triggered update
+    uint64_t dv_first_change_ms; // Times of the first and the latest change
+    uint64_t dv_last_change_ms; //  since the last triggered update
+    uint64_t last_update_ms; // Time of the last triggered update
+
+    struct router_stats stats;
+    FILE *log_file; // The DV is printed here as well, if not NULL
+    const struct router_ops *ops;
+    void *ctx;
+};
+
+void router_init(struct router *r, const char *name, uint16_t port,
+        const struct router_ops *ops, void *ctx);
+void router_free(struct router *r);
+
+// Neighbors must all be added before router_start
+void router_add_neighbor(struct router *r, uint16_t port, uint32_t cost);
+
+// Sends the initial DV to every neighbor
+void router_start(struct router *r);
+
+// Handles a control packet (anything but DATA_PACKET) from sender_port
+void router_handle_packet(struct router *r, uint16_t sender_port,
+        char *buffer, size_t length);
+
+// Called after each batch of packets: lifts the holds that ran out, tells
+//  the transport if the routes changed and sends the triggered update if it
+//  is due, and sets the update timer for the next update or hold due
+void router_end_batch(struct router *r);
+void router_update_timer_expired(struct router *r);
+
+// Sends the full DV to every neighbor
+void router_refresh(struct router *r);
+
+// The neighbor on port is gone: routes through it are recomputed, and it
+//  is expected to send a full DV if it comes back
+void router_neighbor_down(struct router *r, uint16_t port);
+
+// The cost of the link to the neighbor on port changed (from what
+//  router_add_neighbor or the previous call said): routes are recomputed
+//  as for any DV change. Costs of MAX_POSSIBLE_COST or more are capped just
+//  below it; taking a link down is router_neighbor_down's business.
+void router_set_link_cost(struct router *r, uint16_t port, uint32_t cost);
+
+// Tells every neighbor this router is going away
+void router_shutdown(struct router *r);
+
+// Tells every neighbor this router is going away to restart warm, so they
+//  keep routing through it for restart_grace_ms
+void router_restart(struct router *r);
+
+// Warm restart: puts back a DV entry as the previous run left it, from this
+//  router's own DV (from_port is the router's port) or from the DV the
+//  neighbor on from_port last sent. That neighbor is restored as up; e may
+//  be NULL to restore only that. Called before router_start, which then
+//  advertises the restored DV, and keeps the restored neighbors' routes for
+//  restart_grace_ms until they answer. Entries of the router's own DV must
+//  come after their first hops are restored. Returns -1 if the entry
+//  doesn't fit the current neighbors.
+int router_restore(struct router *r, uint16_t from_port,
+        const struct dv_entry *e);
+
+void router_print_dv(struct router *r);
+
+// Fills next_hops with the first hops of every route to e's destination as
+//  cheap as e's, up to max_count (at most ROUTER_MAX_NEXT_HOPS) of them, in
+//  port order. Returns how many there are; e's own first hop is always one.
+int router_next_hops(struct router *r, const struct dv_entry *e,
+        uint16_t *next_hops, int max_count);
+
+#endif
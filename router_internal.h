@@ -0,0 +1,52 @@
+#ifndef ROUTER_INTERNAL_H
+#define ROUTER_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "router.h"
+#include "dv_message.h"
+#include "netio.h"
+
+// Parts of router.c that aren't its API, for the benchmarks of its hot
+//  paths (bench_router.c) to call directly. Nothing else should need them.
+
+// Longest DV message fragment body that fits in one datagram
+#define DV_FRAGMENT_BODY_MAX (MAX_DATAGRAM_SIZE - sizeof(struct dv_header))
+
+// Sequence numbers skip 0
+static inline uint32_t dv_next_seq(uint32_t seq) {
+    return seq+1 == 0 ? 1 : seq+1;
+}
+
+// Counts every change to the DV
+static inline uint64_t dv_version(struct router *r) {
+    return r->journal_base + r->journal_length;
+}
+
+// realloc, exiting if it fails
+void *router_alloc(void *p, size_t size);
+
+// Forget journal entries that every neighbor has been told about
+void dv_journal_trim(struct router *r);
+
+// advertised_cost is what the sender advertised for dest_port, which must
+//  be below the feasible cost unless the sender is the destination.
+// Returns 1 if DV was changed, 0 if not, or a negative number on error.
+int bellman_ford_decrease(struct router *r, uint16_t dest_port,
+        uint16_t sender_port, uint32_t cost_thru_sender,
+        uint32_t advertised_cost);
+
+// Encodes the whole DV, as told to the neighbor on to_port (DV_EMPTY_PORT
+//  for nobody in particular), with ranges if ranges is set. The message
+//  stays valid until the transport flushes.
+void create_dv_message(struct router *r, struct dv_message *m,
+        uint16_t to_port, int ranges);
+
+// Takes one fragment of a DV message (of any kind) from sender_port, and
+//  applies the message once all its fragments are in.
+// Returns the number of changes made to the DV, or a negative number if error
+int handle_dv_packet(struct router *r, uint16_t sender_port, char *buffer,
+        size_t length);
+
+#endif
@@ -0,0 +1,660 @@
+// Serves many routers of a topology from one process, to emulate large
+//  networks on real sockets without a myrouter process per node. Every
+//  router has its own sockets, so it looks like a myrouter of its own to
+//  other routers, myrouter processes and the load generator alike; only the
+//  data packets it delivers are logged to stdout rather than to a file of
+//  its own (unless -o is given).
+//
+// The routers are spread round robin over a small pool of threads, each
+//  running an event loop over the sockets and timers of its own routers.
+//  A router is only ever touched by its thread, so nothing is locked; its
+//  FIB has no other readers and is freed as soon as it is replaced.
+//
+// Each router costs three descriptors (data socket, control socket and
+//  update timer), so the descriptor limit is raised as far as it goes.
+//
+// Usage: routerd [-n threads] [-b batch_size] [-l level] [-d min_delay]
+//                [-D max_delay] [-r refresh] [-E paths] [-C offset] [-o]
+//                [-t topology_file] [-s stats_socket] [<name> ...]
+//   Hosts the named routers, or every router in the topology if none are
+//   named
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "netio.h"
+#include "qsbr.h"
+#include "logger.h"
+#include "event_loop.h"
+#include "router.h"
+#include "topology.h"
+#include "data_packet.h"
+#include "metrics.h"
+#include "forward.h"
+
+#define BUFFER_SIZE 65536
+#define MAX_THREADS 64
+#define MAX_UPDATE_DELAY_MS 60000
+#define LOG_FILE_NAME_LEN 256
+#define DEFAULT_MAX_PATHS 4
+#define DEFAULT_REFRESH_INTERVAL_S 30
+#define DEFAULT_STATS_PATH "routerd.sock"
+
+struct pool_thread;
+
+// One hosted router
+struct node {
+    struct router router;
+    struct forward_node forward;
+    struct pool_thread *thread; // The only thread that touches it
+    int socket_fd;
+    int control_fd; // Same as socket_fd without a control port
+    struct event_source socket_source;
+    struct event_source control_source;
+    struct event_timer update_timer;
+    struct tx_queue tx_queue; // Data packets
+    struct tx_queue control_tx_queue; // Everything the router sends
+};
+
+struct pool_thread {
+    pthread_t thread;
+    struct event_loop loop;
+    int index; // Serves nodes index, index + thread count, ...
+    struct rx_batch rx_batch; // Shared by its nodes, one batch at a time
+    struct qsbr qsbr; // Without readers; frees replaced FIBs at once
+    struct event_timer refresh_timer;
+    int stop_fd; // eventfd the main thread writes to stop it
+    struct event_source stop_source;
+    struct metrics *metrics;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+const char *my_topology_file_name = "sample_topology.txt";
+struct topology my_topology;
+struct node *my_nodes;
+int my_node_count = 0;
+struct pool_thread *my_threads;
+struct metrics *my_metrics; // One per thread
+int my_thread_count = 1;
+int my_batch_size = DEFAULT_BATCH_SIZE;
+int my_min_update_delay_ms = DEFAULT_MIN_UPDATE_DELAY_MS;
+int my_max_update_delay_ms = DEFAULT_MAX_UPDATE_DELAY_MS;
+int my_refresh_interval_s = DEFAULT_REFRESH_INTERVAL_S; // 0 means never
+int my_max_paths = DEFAULT_MAX_PATHS;
+int my_aggregate = 0; // DV messages carry ranges of destinations
+int my_feasibility = 0; // Only feasible routes are taken
+uint16_t my_control_port_offset = DEFAULT_CONTROL_PORT_OFFSET;
+int my_log_files = 0; // Each router logs to routing-output_<name>.txt
+const char *my_stats_path = DEFAULT_STATS_PATH;
+struct event_loop my_event_loop; // The main thread's: signals and stats
+struct event_signals my_shutdown_signals;
+struct event_source my_stats_source;
+uint64_t my_start_ms;
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// What each router needs from its sockets and its thread's event loop
+
+static char *node_reserve(void *ctx, size_t size) {
+    struct node *n = ctx;
+    return tx_queue_reserve(&n->control_tx_queue, size);
+}
+
+static unsigned long node_flush_count(void *ctx) {
+    struct node *n = ctx;
+    return n->control_tx_queue.flush_count;
+}
+
+static void node_send_parts(void *ctx, const char *head, size_t head_length,
+        const char *body, size_t body_length, uint16_t dest_port) {
+    struct node *n = ctx;
+    tx_queue_add_parts(&n->control_tx_queue, head, head_length, body,
+            body_length, dest_port + my_control_port_offset);
+}
+
+static uint64_t node_now_ms(void *ctx) {
+    (void) ctx;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void node_set_update_timer(void *ctx, uint64_t delay_ms) {
+    struct node *n = ctx;
+    event_timer_arm(&n->update_timer, delay_ms, 0);
+}
+
+static void node_routes_changed(void *ctx) {
+    struct node *n = ctx;
+    forward_update_fib(&n->forward, &n->router, my_max_paths,
+            &n->thread->qsbr);
+}
+
+const struct router_ops my_node_ops = {
+    node_reserve,
+    node_flush_count,
+    node_send_parts,
+    node_now_ms,
+    node_set_update_timer,
+    node_routes_changed
+};
+
+static void flush_node(struct node *n) {
+    tx_queue_flush(&n->tx_queue);
+    tx_queue_flush(&n->control_tx_queue);
+}
+
+//-----------------------------------------------------------------------------
+// Packets and timers, handled on the node's thread
+
+static void handle_packet(struct node *n, char *buffer, ssize_t length,
+        uint16_t sender_port) {
+    struct metrics *m = n->thread->metrics;
+    metrics_count_rx(m, buffer, length);
+    if (length > 0 && buffer[0] == DATA_PACKET) {
+        forward_data_packet(&n->forward, sender_port, buffer, length,
+                &n->tx_queue, m);
+        return;
+    }
+    router_handle_packet(&n->router, sender_port, buffer, length);
+}
+
+// Handles everything waiting on the node's control socket, as myrouter
+//  does: whenever it is readable, and before every batch of data packets.
+//  The caller ends the batch.
+static void drain_control(struct node *n) {
+    struct rx_batch *b = &n->thread->rx_batch;
+    int count;
+    do {
+        // The batch buffers are shared by the thread's nodes, and data
+        //  forwarded from them goes before they're reused
+        tx_queue_flush(&n->tx_queue);
+        count = rx_batch_receive(n->control_fd, b);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Error receiving control packets");
+            }
+            break;
+        }
+        uint64_t start = metrics_now_ns();
+        int i;
+        for (i=0; i<count; i++) {
+            // They come from the sender's control port
+            handle_packet(n, rx_batch_buffer(b, i), rx_batch_length(b, i),
+                    ntohs(rx_batch_addr(b, i)->sin_port)
+                    - my_control_port_offset);
+            metrics_packet_done(n->thread->metrics, &start);
+        }
+    } while (count == b->capacity);
+}
+
+static void handle_control_ready(struct event_source *source,
+        uint32_t events) {
+    (void) events;
+    struct node *n = source->arg;
+    drain_control(n);
+    router_end_batch(&n->router);
+    flush_node(n);
+}
+
+static void handle_socket_ready(struct event_source *source,
+        uint32_t events) {
+    (void) events;
+    struct node *n = source->arg;
+    if (n->control_fd != n->socket_fd) {
+        drain_control(n);
+        // Anything forwarded from the batch buffers goes before they're
+        //  reused
+        tx_queue_flush(&n->tx_queue);
+    }
+    struct rx_batch *b = &n->thread->rx_batch;
+    int count = rx_batch_receive(n->socket_fd, b);
+    if (count < 0) {
+        perror("Error receiving data");
+        return;
+    }
+    uint64_t start = metrics_now_ns();
+    int i;
+    for (i=0; i<count; i++) {
+        handle_packet(n, rx_batch_buffer(b, i), rx_batch_length(b, i),
+                ntohs(rx_batch_addr(b, i)->sin_port));
+        metrics_packet_done(n->thread->metrics, &start);
+    }
+    router_end_batch(&n->router);
+    flush_node(n);
+}
+
+static void handle_update_timer(void *arg) {
+    struct node *n = arg;
+    router_update_timer_expired(&n->router);
+    flush_node(n);
+}
+
+static void handle_refresh_timer(void *arg) {
+    struct pool_thread *t = arg;
+    int i;
+    for (i=t->index; i<my_node_count; i+=my_thread_count) {
+        router_refresh(&my_nodes[i].router);
+        flush_node(&my_nodes[i]);
+    }
+}
+
+// The main thread asks every thread to stop: its routers tell their
+//  neighbors they are going away
+static void handle_stop(struct event_source *source, uint32_t events) {
+    (void) events;
+    struct pool_thread *t = source->arg;
+    int i;
+    for (i=t->index; i<my_node_count; i+=my_thread_count) {
+        router_shutdown(&my_nodes[i].router);
+        flush_node(&my_nodes[i]);
+    }
+    event_loop_stop(&t->loop);
+}
+
+static void *thread_main(void *arg) {
+    struct pool_thread *t = arg;
+    int i;
+    for (i=t->index; i<my_node_count; i+=my_thread_count) {
+        router_start(&my_nodes[i].router);
+        flush_node(&my_nodes[i]);
+    }
+    event_loop_run(&t->loop);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Setting up
+
+// Descriptors run out long before memory does
+void raise_descriptor_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+            && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Binds the node's sockets, which are all bound before any router starts
+//  sending, and registers them with its thread
+void init_node(struct node *n, int topology_node, struct pool_thread *t) {
+    const struct topology_node *tn = &my_topology.nodes[topology_node];
+    char *name = strndup(tn->name, tn->name_length);
+    if (name == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    n->thread = t;
+    router_init(&n->router, name, tn->port, &my_node_ops, n);
+    n->router.min_update_delay_ms = my_min_update_delay_ms;
+    n->router.max_update_delay_ms = my_max_update_delay_ms;
+    n->router.aggregate = my_aggregate;
+    n->router.feasibility = my_feasibility;
+    int i;
+    for (i=0; i<tn->link_count; i++) {
+        const struct topology_link *l = &my_topology.links[tn->first_link + i];
+        router_add_neighbor(&n->router, l->port, l->cost);
+    }
+
+    n->forward.port = tn->port;
+    n->forward.log_file = NULL;
+    atomic_init(&n->forward.fib, NULL);
+    n->forward.fib_generation = 0;
+    if (my_log_files) {
+        char log_file_name[LOG_FILE_NAME_LEN];
+        snprintf(log_file_name, sizeof log_file_name,
+                "routing-output_%s.txt", name);
+        n->forward.log_file = log_open_file(log_file_name);
+        if (n->forward.log_file == NULL) {
+            fprintf(stderr, "Error: Failed to open log file %s\n",
+                    log_file_name);
+            exit(1);
+        }
+        n->router.log_file = n->forward.log_file;
+        fprintf(n->router.log_file, "This is router %s on port %u\n", name,
+                tn->port);
+    }
+    forward_update_fib(&n->forward, &n->router, my_max_paths, &t->qsbr);
+
+    n->socket_fd = netio_bind_socket(tn->port, 0, 0);
+    tx_queue_init(&n->tx_queue, n->socket_fd, my_batch_size);
+    event_loop_add(&t->loop, &n->socket_source, n->socket_fd, EPOLLIN,
+            handle_socket_ready, n);
+    if (my_control_port_offset > 0) {
+        n->control_fd = netio_bind_socket(tn->port + my_control_port_offset,
+                0, SOCK_NONBLOCK);
+        event_loop_add(&t->loop, &n->control_source, n->control_fd, EPOLLIN,
+                handle_control_ready, n);
+    } else {
+        n->control_fd = n->socket_fd;
+    }
+    tx_queue_init(&n->control_tx_queue, n->control_fd, my_batch_size);
+    event_timer_init(&t->loop, &n->update_timer, handle_update_timer, n);
+}
+
+void init_thread(struct pool_thread *t, int index) {
+    t->index = index;
+    event_loop_init(&t->loop);
+    rx_batch_init(&t->rx_batch, my_batch_size, BUFFER_SIZE);
+    qsbr_init(&t->qsbr, 0);
+    t->metrics = &my_metrics[index];
+    metrics_init(t->metrics);
+    t->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (t->stop_fd < 0) {
+        perror("Error creating eventfd");
+        exit(1);
+    }
+    event_loop_add(&t->loop, &t->stop_source, t->stop_fd, EPOLLIN,
+            handle_stop, t);
+    event_timer_init(&t->loop, &t->refresh_timer, handle_refresh_timer, t);
+    if (my_refresh_interval_s > 0) {
+        uint64_t interval_ms = (uint64_t) my_refresh_interval_s * 1000;
+        event_timer_arm(&t->refresh_timer, interval_ms, interval_ms);
+    }
+}
+
+// Topology nodes of the named routers, or of every router with a port
+int *select_nodes(char **names, int name_count, int *count) {
+    int *selected = malloc((name_count > 0 ? name_count :
+            my_topology.node_count) * sizeof(int));
+    if (selected == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    *count = 0;
+    int i;
+    if (name_count == 0) {
+        for (i=0; i<my_topology.node_count; i++) {
+            if (my_topology.nodes[i].port != 0) {
+                selected[(*count)++] = i;
+            }
+        }
+        return selected;
+    }
+    for (i=0; i<name_count; i++) {
+        int node = topology_find_name(&my_topology, names[i],
+                strlen(names[i]));
+        if (node < 0 || my_topology.nodes[node].port == 0) {
+            fprintf(stderr, "Error: Router %s has no port in network topology"
+                    " file\n", names[i]);
+            exit(1);
+        }
+        selected[(*count)++] = node;
+    }
+    return selected;
+}
+
+//-----------------------------------------------------------------------------
+// Signals and stats, on the main thread
+
+void handle_shutdown_signal(void *arg, int sig) {
+    (void) arg;
+    LOG(LOG_INFO, "Caught signal %d, shutting down", sig);
+    uint64_t one = 1;
+    int i;
+    for (i=0; i<my_thread_count; i++) {
+        if (write(my_threads[i].stop_fd, &one, sizeof one) < 0) {
+            perror("Error stopping thread");
+        }
+    }
+    event_loop_stop(&my_event_loop);
+}
+
+// Read without locking, like the metrics, so the totals can be slightly
+//  out of step with each other
+void print_stats(FILE *file) {
+    struct metrics total;
+    metrics_sum(&total, my_metrics, my_thread_count);
+    int i;
+    struct router_stats sum;
+    memset(&sum, 0, sizeof sum);
+    long dv_entries = 0;
+    for (i=0; i<my_node_count; i++) {
+        const struct router_stats *stats = &my_nodes[i].router.stats;
+        sum.messages_sent += stats->messages_sent;
+        sum.bytes_sent += stats->bytes_sent;
+        sum.messages_received += stats->messages_received;
+        sum.bytes_received += stats->bytes_received;
+        sum.route_changes += stats->route_changes;
+        sum.recomputations += stats->recomputations;
+        sum.broadcasts += stats->broadcasts;
+        dv_entries += my_nodes[i].router.dv.length;
+    }
+    fprintf(file, "routers %d\n", my_node_count);
+    fprintf(file, "threads %d\n", my_thread_count);
+    fprintf(file, "uptime_ms %llu\n", (unsigned long long)
+            (node_now_ms(NULL) - my_start_ms));
+    fprintf(file, "dv_entries %ld\n", dv_entries);
+    fprintf(file, "dv_messages_sent_total %llu\n",
+            (unsigned long long) sum.messages_sent);
+    fprintf(file, "dv_bytes_sent_total %llu\n",
+            (unsigned long long) sum.bytes_sent);
+    fprintf(file, "dv_messages_received_total %llu\n",
+            (unsigned long long) sum.messages_received);
+    fprintf(file, "dv_bytes_received_total %llu\n",
+            (unsigned long long) sum.bytes_received);
+    fprintf(file, "dv_route_changes_total %llu\n",
+            (unsigned long long) sum.route_changes);
+    fprintf(file, "dv_recomputations_total %llu\n",
+            (unsigned long long) sum.recomputations);
+    fprintf(file, "dv_broadcasts_total %llu\n",
+            (unsigned long long) sum.broadcasts);
+    metrics_print(file, &total);
+}
+
+void handle_stats_ready(struct event_source *source, uint32_t events) {
+    (void) events;
+    int fd;
+    while ((fd = accept4(source->fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        FILE *file = fdopen(fd, "w");
+        if (file == NULL) {
+            close(fd);
+            continue;
+        }
+        print_stats(file);
+        fclose(file);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+int parse_int(const char *str, long min, long max, int *result) {
+    char *end;
+    errno = 0;
+    long value = strtol(str, &end, 10);
+    if (errno == ERANGE || end == str || *end != '\0' || value < min
+            || value > max) {
+        return -1;
+    }
+    *result = (int) value;
+    return 0;
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-n threads] [-b batch_size] [-l level]"
+            " [-d min_delay] [-D max_delay]\n"
+            "       [-r refresh] [-E paths] [-A] [-F] [-C offset] [-o]\n"
+            "       [-t topology_file] [-s stats_socket] [<name> ...]\n",
+            program_name);
+    fprintf(stderr, "Hosts the named routers, or every router in the"
+            " topology if none are named.\n");
+    fprintf(stderr, "  -n  event loop threads, 1 to %d (default 1)\n",
+            MAX_THREADS);
+    fprintf(stderr, "  -b  datagrams received/sent per syscall, 1 to %d"
+            " (default %d)\n", MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -l  verbosity: error, warn, info, debug or trace"
+            " (default warn)\n");
+    fprintf(stderr, "  -d, -D, -r, -E, -A, -F, -C  as for myrouter\n");
+    fprintf(stderr, "  -o  log each router to routing-output_<name>.txt,"
+            " as myrouter does\n      (a descriptor more per router)\n");
+    fprintf(stderr, "  -t  network topology file"
+            " (default sample_topology.txt)\n");
+    fprintf(stderr, "  -s  UNIX socket to serve stats on, for routerstat"
+            " (default %s)\n", DEFAULT_STATS_PATH);
+}
+
+int main(int argc, char **argv) {
+    log_level = LOG_WARN;
+    int value;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:l:d:D:r:E:AFC:ot:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                if (parse_int(optarg, 1, MAX_THREADS, &my_thread_count) < 0) {
+                    fprintf(stderr, "Error: Invalid thread count %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'b':
+                if (parse_int(optarg, 1, MAX_BATCH_SIZE, &my_batch_size) < 0) {
+                    fprintf(stderr, "Error: Invalid batch size %s\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'l':
+                log_level = log_parse_level(optarg);
+                if (log_level < 0) {
+                    fprintf(stderr, "Error: Invalid log level %s\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'd':
+            case 'D':
+                if (parse_int(optarg, 0, MAX_UPDATE_DELAY_MS, opt == 'd' ?
+                        &my_min_update_delay_ms : &my_max_update_delay_ms)
+                        < 0) {
+                    fprintf(stderr, "Error: Invalid update delay %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'r':
+                if (parse_int(optarg, 0, UINT16_MAX, &my_refresh_interval_s)
+                        < 0) {
+                    fprintf(stderr, "Error: Invalid refresh interval %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'E':
+                if (parse_int(optarg, 1, FIB_MAX_PATHS, &my_max_paths) < 0) {
+                    fprintf(stderr, "Error: Invalid next hop count %s\n",
+                            optarg);
+                    exit(1);
+                }
+            break;
+            case 'A':
+                my_aggregate = 1;
+            break;
+            case 'F':
+                my_feasibility = 1;
+            break;
+            case 'C':
+                if (parse_int(optarg, 0, UINT16_MAX, &value) < 0) {
+                    fprintf(stderr, "Error: Invalid control port offset %s\n",
+                            optarg);
+                    exit(1);
+                }
+                my_control_port_offset = value;
+            break;
+            case 'o':
+                my_log_files = 1;
+            break;
+            case 't':
+                my_topology_file_name = optarg;
+            break;
+            case 's':
+                my_stats_path = optarg;
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (my_min_update_delay_ms > my_max_update_delay_ms) {
+        fprintf(stderr, "Error: Minimum update delay exceeds maximum\n");
+        exit(1);
+    }
+
+    if (topology_load(&my_topology, my_topology_file_name) < 0) {
+        fprintf(stderr, "Error: cannot read network topology file %s\n",
+                my_topology_file_name);
+        exit(1);
+    }
+    if (my_control_port_offset > 0) {
+        uint16_t port = topology_offset_conflict(&my_topology,
+                my_control_port_offset);
+        if (port != 0) {
+            fprintf(stderr, "Error: Control port of %u (offset %u) is out of"
+                    " range or taken by a router; pick another with -C\n",
+                    port, my_control_port_offset);
+            exit(1);
+        }
+    }
+    int *selected = select_nodes(argv + optind, argc - optind,
+            &my_node_count);
+    if (my_node_count < my_thread_count) {
+        my_thread_count = my_node_count > 0 ? my_node_count : 1;
+    }
+    raise_descriptor_limit();
+
+    // Signals must be blocked before the log writer and the pool start
+    event_loop_init(&my_event_loop);
+    const int shutdown_signals[] = { SIGINT, SIGTERM, SIGQUIT };
+    event_signals_init(&my_event_loop, &my_shutdown_signals, shutdown_signals,
+            3, handle_shutdown_signal, NULL);
+    log_init();
+
+    my_threads = calloc(my_thread_count, sizeof(struct pool_thread));
+    my_nodes = calloc(my_node_count, sizeof(struct node));
+    my_metrics = aligned_alloc(_Alignof(struct metrics),
+            my_thread_count * sizeof(struct metrics));
+    if (my_threads == NULL || my_nodes == NULL || my_metrics == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int i;
+    for (i=0; i<my_thread_count; i++) {
+        init_thread(&my_threads[i], i);
+    }
+    for (i=0; i<my_node_count; i++) {
+        init_node(&my_nodes[i], selected[i],
+                &my_threads[i % my_thread_count]);
+    }
+    free(selected);
+    // Nothing else needs the topology
+    topology_free(&my_topology);
+
+    my_start_ms = node_now_ms(NULL);
+    event_loop_add(&my_event_loop, &my_stats_source,
+            metrics_listen(my_stats_path), EPOLLIN, handle_stats_ready, NULL);
+    LOG(LOG_INFO, "Hosting %d routers on %d threads", my_node_count,
+            my_thread_count);
+
+    for (i=0; i<my_thread_count; i++) {
+        int err = pthread_create(&my_threads[i].thread, NULL, thread_main,
+                &my_threads[i]);
+        if (err != 0) {
+            fprintf(stderr, "Error creating thread: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+    event_loop_run(&my_event_loop);
+    for (i=0; i<my_thread_count; i++) {
+        pthread_join(my_threads[i].thread, NULL);
+    }
+    unlink(my_stats_path);
+    return 0; // The log is written out by log_shutdown at exit
+}
@@ -0,0 +1,171 @@
+// Reads the stats a running myrouter serves on its UNIX socket (see
+//  metrics.h) and prints them. With -i it keeps reading them every interval
+//  and also prints how fast each counter went up since the read before.
+//
+// Usage: routerstat [-i seconds] <port | socket path>
+//   A port stands for the socket myrouter uses by default, myrouter_<port>.sock
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_STATS 128
+#define MAX_NAME_LEN 64
+#define SOCKET_PATH_LEN 108 // sizeof sun_path
+
+struct stat_line {
+    char name[MAX_NAME_LEN];
+    unsigned long long value;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+char my_path[SOCKET_PATH_LEN];
+//-----------------------------------------------------------------------------
+
+// Reads one snapshot. Returns the number of stats, or -1 if the router
+//  can't be reached.
+int read_stats(struct stat_line *stats) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, my_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        exit(1);
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        fprintf(stderr, "Error connecting to %s: %s\n", my_path,
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+    FILE *file = fdopen(fd, "r");
+    if (file == NULL) {
+        perror("Error reading stats");
+        exit(1);
+    }
+    int count = 0;
+    char line[256];
+    while (count < MAX_STATS && fgets(line, sizeof line, file) != NULL) {
+        if (sscanf(line, "%63s %llu", stats[count].name,
+                &stats[count].value) == 2) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+// Counters only ever go up, so their rate means something
+int is_counter(const char *name) {
+    size_t length = strlen(name);
+    const char *suffixes[] = { "_total", "_count", "_sum" };
+    int i;
+    for (i=0; i<3; i++) {
+        size_t suffix_length = strlen(suffixes[i]);
+        if (length > suffix_length && strcmp(name + length - suffix_length,
+                suffixes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// previous is NULL for the first read
+void print_stats(const struct stat_line *stats, int count,
+        const struct stat_line *previous, int previous_count,
+        double interval_s) {
+    int i;
+    for (i=0; i<count; i++) {
+        const struct stat_line *s = &stats[i];
+        if (previous == NULL || !is_counter(s->name)) {
+            printf("%-32s %20llu\n", s->name, s->value);
+            continue;
+        }
+        // Stats come in the same order every time, unless the router was
+        //  restarted with another version
+        const struct stat_line *p = i < previous_count
+                && strcmp(previous[i].name, s->name) == 0 ?
+                &previous[i] : NULL;
+        if (p == NULL || p->value > s->value) {
+            printf("%-32s %20llu\n", s->name, s->value);
+        } else {
+            printf("%-32s %20llu %14.1f/s\n", s->name, s->value,
+                    (s->value - p->value) / interval_s);
+        }
+    }
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-i seconds] <port | socket path>\n",
+            program_name);
+    fprintf(stderr, "  -i  read again every this many seconds, showing"
+            " counter rates\n");
+}
+
+int main(int argc, char **argv) {
+    double interval_s = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+            case 'i': {
+                char *end;
+                interval_s = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(interval_s > 0)) {
+                    fprintf(stderr, "Error: Invalid interval %s\n", optarg);
+                    exit(1);
+                }
+            }
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    const char *target = argv[optind];
+    if (strspn(target, "0123456789") == strlen(target)) {
+        snprintf(my_path, sizeof my_path, "myrouter_%s.sock", target);
+    } else if (strlen(target) < sizeof my_path) {
+        strcpy(my_path, target);
+    } else {
+        fprintf(stderr, "Error: Socket path %s is too long\n", target);
+        exit(1);
+    }
+
+    struct stat_line stats[2][MAX_STATS];
+    int counts[2];
+    int current = 0;
+    counts[current] = read_stats(stats[current]);
+    if (counts[current] < 0) {
+        exit(1);
+    }
+    print_stats(stats[current], counts[current], NULL, 0, 0);
+    while (interval_s > 0) {
+        struct timespec delay = {
+            .tv_sec = (time_t) interval_s,
+            .tv_nsec = (long) ((interval_s - (time_t) interval_s) * 1e9),
+        };
+        nanosleep(&delay, NULL);
+        current = !current;
+        counts[current] = read_stats(stats[current]);
+        if (counts[current] < 0) {
+            exit(1);
+        }
+        printf("\n");
+        print_stats(stats[current], counts[current], stats[!current],
+                counts[!current], interval_s);
+        fflush(stdout);
+    }
+    return 0;
+}
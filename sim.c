@@ -0,0 +1,874 @@
+// Runs many routers in one process over a simulated network, to see how the
+//  DV protocol converges at scale. Every router is the real protocol
+//  (router.c); only the transport is fake. Links have a fixed delay and may
+//  drop messages, both drawn from a seeded generator, so a run is exactly
+//  reproducible. Time is virtual: nothing waits, and the hold-down timers
+//  fire as soon as nothing happens before them.
+//
+// The network is random (a ring plus random chords), or read from a topology
+//  file such as gentopo writes.
+//
+// The scenario has three phases, each run until no message or timer is
+//  left (or, with periodic refreshes, for a fixed time):
+//   join     every router starts within the first few ms
+//   failure  some links go down (both ends notice at once, as if by carrier
+//            loss)
+//   kill     some routers shut down, telling their neighbors
+// After each phase every router's DV is checked against Dijkstra.
+//
+// Usage: sim [-n routers] [-d degree] [-c max_cost] [-s seed] [-L loss%]
+//            [-r refresh] [-f failures] [-k kills] [-m min_delay]
+//            [-M max_delay] [-l level] [-t topology_file] [-A] [-F]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "router.h"
+#include "logger.h"
+#include "topology.h"
+
+#define MAX_ROUTERS UINT16_MAX // Ports 1 to MAX_ROUTERS
+#define JOIN_SPREAD_US 5000 // Routers start within this long of each other
+#define MIN_LINK_DELAY_US 100
+#define MAX_LINK_DELAY_US 2000
+
+struct sim_link {
+    int a, b; // Router indexes
+    uint32_t cost;
+    uint64_t delay_us;
+    int up;
+};
+
+struct sim_router {
+    struct router r;
+    int alive;
+    int *links; // Indexes into my_links
+    int link_count;
+    int link_capacity;
+    uint64_t timer_generation; // Timer events from older armings are stale
+    uint64_t cpu_ns; // Spent inside the protocol during the current phase
+};
+
+enum sim_event_type {
+    SIM_START,
+    SIM_DELIVER,
+    SIM_TIMER,
+    SIM_REFRESH
+};
+
+struct sim_event {
+    uint64_t time_us;
+    uint64_t order; // Breaks ties, so each link delivers in order
+    enum sim_event_type type;
+    int router;
+    uint64_t timer_generation;
+    uint16_t sender_port;
+    size_t length;
+    char data[];
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+int my_router_count = 1000;
+int my_degree = 4;
+uint32_t my_max_cost = 5;
+uint64_t my_seed = 1;
+int my_loss_percent = 0;
+int my_refresh_interval_ms = 0; // 0 means never
+int my_failure_count = 1;
+int my_kill_count = 1;
+const char *my_topology_file_name = NULL; // NULL for a random topology
+struct sim_router *my_routers;
+struct sim_link *my_links;
+int my_link_count = 0;
+int my_link_capacity = 0;
+uint64_t my_rng_state;
+uint64_t my_now_us = 0;
+uint64_t my_last_route_change_us = 0;
+uint64_t my_event_order = 0;
+struct sim_event **my_events; // Binary heap ordered by time, then order
+int my_event_count = 0;
+int my_event_capacity = 0;
+char *my_arena; // Message bodies reserved by the routers
+size_t my_arena_used = 0;
+size_t my_arena_capacity = 0;
+unsigned long my_flush_count = 0;
+uint64_t my_dropped = 0; // Lost, or sent over a dead link or to a dead router
+//-----------------------------------------------------------------------------
+
+static void *sim_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+// xorshift64*
+static uint64_t sim_random() {
+    my_rng_state ^= my_rng_state >> 12;
+    my_rng_state ^= my_rng_state << 25;
+    my_rng_state ^= my_rng_state >> 27;
+    return my_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [low, high]
+static uint64_t sim_random_range(uint64_t low, uint64_t high) {
+    return low + sim_random() % (high - low + 1);
+}
+
+static inline uint16_t port_of(int router) {
+    return (uint16_t) (router + 1);
+}
+
+static inline int router_of(uint16_t port) {
+    return (int) port - 1;
+}
+
+static double cpu_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static uint64_t cpu_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// Event queue
+
+static int event_before(const struct sim_event *a, const struct sim_event *b) {
+    return a->time_us < b->time_us ||
+            (a->time_us == b->time_us && a->order < b->order);
+}
+
+static struct sim_event *event_new(enum sim_event_type type, int router,
+        uint64_t time_us, size_t length) {
+    struct sim_event *e = sim_alloc(NULL, sizeof(struct sim_event) + length);
+    e->time_us = time_us;
+    e->order = my_event_order++;
+    e->type = type;
+    e->router = router;
+    e->timer_generation = 0;
+    e->sender_port = 0;
+    e->length = length;
+    return e;
+}
+
+static void event_push(struct sim_event *e) {
+    if (my_event_count == my_event_capacity) {
+        my_event_capacity = my_event_capacity == 0 ?
+                1024 : 2*my_event_capacity;
+        my_events = sim_alloc(my_events,
+                my_event_capacity * sizeof(struct sim_event *));
+    }
+    int i = my_event_count++;
+    while (i > 0 && event_before(e, my_events[(i-1) / 2])) {
+        my_events[i] = my_events[(i-1) / 2];
+        i = (i-1) / 2;
+    }
+    my_events[i] = e;
+}
+
+static struct sim_event *event_pop() {
+    struct sim_event *top = my_events[0];
+    struct sim_event *last = my_events[--my_event_count];
+    int i = 0;
+    while (1) {
+        int child = 2*i + 1;
+        if (child >= my_event_count) {
+            break;
+        }
+        if (child+1 < my_event_count &&
+                event_before(my_events[child+1], my_events[child])) {
+            child++;
+        }
+        if (!event_before(my_events[child], last)) {
+            break;
+        }
+        my_events[i] = my_events[child];
+        i = child;
+    }
+    my_events[i] = last;
+    return top;
+}
+
+//-----------------------------------------------------------------------------
+// The fake transport. The context of each router is its sim_router.
+
+static struct sim_link *link_between(struct sim_router *s, uint16_t port) {
+    int i;
+    for (i=0; i<s->link_count; i++) {
+        struct sim_link *l = &my_links[s->links[i]];
+        if (port_of(l->a) == port || port_of(l->b) == port) {
+            return l;
+        }
+    }
+    return NULL;
+}
+
+// Messages are copied when sent, so bodies only need to last until the next
+//  router has its turn
+static void sim_flush() {
+    my_arena_used = 0;
+    my_flush_count++;
+}
+
+static char *sim_reserve(void *ctx, size_t size) {
+    (void) ctx;
+    if (my_arena_used + size > my_arena_capacity) {
+        sim_flush();
+        if (size > my_arena_capacity) {
+            free(my_arena);
+            my_arena_capacity = size > 65536 ? size : 65536;
+            my_arena = sim_alloc(NULL, my_arena_capacity);
+        }
+    }
+    char *p = my_arena + my_arena_used;
+    my_arena_used += size;
+    return p;
+}
+
+static unsigned long sim_flush_count(void *ctx) {
+    (void) ctx;
+    return my_flush_count;
+}
+
+static void sim_send(void *ctx, const char *head, size_t head_length,
+        const char *body, size_t body_length, uint16_t dest_port) {
+    struct sim_router *s = ctx;
+    struct sim_link *l = link_between(s, dest_port);
+    if (l == NULL || !l->up || (my_loss_percent > 0 &&
+            (int) (sim_random() % 100) < my_loss_percent)) {
+        my_dropped++;
+        return;
+    }
+    struct sim_event *e = event_new(SIM_DELIVER, router_of(dest_port),
+            my_now_us + l->delay_us, head_length + body_length);
+    e->sender_port = s->r.port;
+    memcpy(e->data, head, head_length);
+    if (body_length > 0) {
+        memcpy(e->data + head_length, body, body_length);
+    }
+    event_push(e);
+}
+
+static uint64_t sim_now_ms(void *ctx) {
+    (void) ctx;
+    return my_now_us / 1000;
+}
+
+static void sim_set_update_timer(void *ctx, uint64_t delay_ms) {
+    struct sim_router *s = ctx;
+    // Like event_timer_arm, this replaces any earlier arming
+    s->timer_generation++;
+    struct sim_event *e = event_new(SIM_TIMER, (int) (s - my_routers),
+            my_now_us + delay_ms * 1000, 0);
+    e->timer_generation = s->timer_generation;
+    event_push(e);
+}
+
+static void sim_routes_changed(void *ctx) {
+    (void) ctx;
+    my_last_route_change_us = my_now_us;
+}
+
+const struct router_ops my_sim_ops = {
+    sim_reserve,
+    sim_flush_count,
+    sim_send,
+    sim_now_ms,
+    sim_set_update_timer,
+    sim_routes_changed
+};
+
+//-----------------------------------------------------------------------------
+// Topology
+
+static int linked(int a, int b) {
+    return link_between(&my_routers[a], port_of(b)) != NULL;
+}
+
+static void add_link(int a, int b, uint32_t cost) {
+    if (my_link_count == my_link_capacity) {
+        my_link_capacity = my_link_capacity == 0 ? 1024 : 2*my_link_capacity;
+        my_links = sim_alloc(my_links,
+                my_link_capacity * sizeof(struct sim_link));
+    }
+    int index = my_link_count++;
+    struct sim_link *l = &my_links[index];
+    l->a = a;
+    l->b = b;
+    l->cost = cost;
+    l->delay_us = sim_random_range(MIN_LINK_DELAY_US, MAX_LINK_DELAY_US);
+    l->up = 1;
+
+    int ends[2] = { a, b };
+    int i;
+    for (i=0; i<2; i++) {
+        struct sim_router *s = &my_routers[ends[i]];
+        if (s->link_count == s->link_capacity) {
+            s->link_capacity = s->link_capacity == 0 ? 4 : 2*s->link_capacity;
+            s->links = sim_alloc(s->links, s->link_capacity * sizeof(int));
+        }
+        s->links[s->link_count++] = index;
+    }
+}
+
+// A ring, so the network is connected, plus random chords until the average
+//  degree is reached
+static void build_random_topology() {
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        int next = (i+1) % my_router_count;
+        if (my_router_count > 2 || i == 0) {
+            add_link(i, next, sim_random_range(1, my_max_cost));
+        }
+    }
+    long target = (long) my_router_count * my_degree / 2;
+    long attempts = 0;
+    while (my_link_count < target && attempts < 100 * target) {
+        attempts++;
+        int a = sim_random() % my_router_count;
+        int b = sim_random() % my_router_count;
+        if (a != b && !linked(a, b)) {
+            add_link(a, b, sim_random_range(1, my_max_cost));
+        }
+    }
+}
+
+// Links as in a topology file. Links are symmetric here, so each takes the
+//  cost of whichever direction comes first in the file. Routers are
+//  numbered in the order they appear, whatever their ports in the file.
+static void build_file_topology(const struct topology *t) {
+    int i;
+    for (i=0; i<t->link_count; i++) {
+        const struct topology_link *l = &t->links[i];
+        if (!linked(l->src, l->dest)) {
+            add_link(l->src, l->dest, l->cost);
+        }
+    }
+}
+
+static void init_routers() {
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        struct sim_router *s = &my_routers[i];
+        router_init(&s->r, NULL, port_of(i), &my_sim_ops, s);
+        int k;
+        for (k=0; k<s->link_count; k++) {
+            struct sim_link *l = &my_links[s->links[k]];
+            router_add_neighbor(&s->r, port_of(l->a == i ? l->b : l->a),
+                    l->cost);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Checking the DVs
+
+// Shortest path costs from source over live links between live routers
+static void dijkstra(int source, uint32_t *dist, int *heap, int *position) {
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        dist[i] = UINT32_MAX;
+        position[i] = -1;
+    }
+    int count = 0;
+    dist[source] = 0;
+    heap[count] = source;
+    position[source] = count++;
+    while (count > 0) {
+        int u = heap[0];
+        position[u] = -2; // Done
+        int last = heap[--count];
+        if (count > 0) {
+            // Sift last down from the root
+            int k = 0;
+            while (1) {
+                int child = 2*k + 1;
+                if (child >= count) {
+                    break;
+                }
+                if (child+1 < count && dist[heap[child+1]] < dist[heap[child]]) {
+                    child++;
+                }
+                if (dist[heap[child]] >= dist[last]) {
+                    break;
+                }
+                heap[k] = heap[child];
+                position[heap[k]] = k;
+                k = child;
+            }
+            heap[k] = last;
+            position[last] = k;
+        }
+
+        struct sim_router *s = &my_routers[u];
+        int j;
+        for (j=0; j<s->link_count; j++) {
+            struct sim_link *l = &my_links[s->links[j]];
+            int v = l->a == u ? l->b : l->a;
+            if (!l->up || !my_routers[v].alive || position[v] == -2 ||
+                    dist[u] + l->cost >= dist[v]) {
+                continue;
+            }
+            dist[v] = dist[u] + l->cost;
+            int k = position[v];
+            if (k < 0) {
+                k = count++;
+            }
+            // Sift v up
+            while (k > 0 && dist[heap[(k-1) / 2]] > dist[v]) {
+                heap[k] = heap[(k-1) / 2];
+                position[heap[k]] = k;
+                k = (k-1) / 2;
+            }
+            heap[k] = v;
+            position[v] = k;
+        }
+    }
+}
+
+// Counts DV entries (and missing entries) that disagree with the shortest
+//  paths. A route is right if it has the shortest cost and its first hop is
+//  on a shortest path.
+static long check_routes(long *route_count) {
+    uint32_t *dist = sim_alloc(NULL, my_router_count * sizeof(uint32_t));
+    int *heap = sim_alloc(NULL, my_router_count * sizeof(int));
+    int *position = sim_alloc(NULL, my_router_count * sizeof(int));
+    // Distances from each router are needed for checking first hops too, so
+    //  they are computed once per router up front
+    uint32_t **all = sim_alloc(NULL, my_router_count * sizeof(uint32_t *));
+    int i, d;
+    for (i=0; i<my_router_count; i++) {
+        all[i] = NULL;
+        if (my_routers[i].alive) {
+            dijkstra(i, dist, heap, position);
+            all[i] = sim_alloc(NULL, my_router_count * sizeof(uint32_t));
+            memcpy(all[i], dist, my_router_count * sizeof(uint32_t));
+        }
+    }
+
+    long wrong = 0;
+    *route_count = 0;
+    for (i=0; i<my_router_count; i++) {
+        struct sim_router *s = &my_routers[i];
+        if (!s->alive) {
+            continue;
+        }
+        for (d=0; d<my_router_count; d++) {
+            if (d == i) {
+                continue;
+            }
+            struct dv_entry *e = dv_find(&s->r.dv, port_of(d));
+            uint32_t expected = all[i][d];
+            if (expected >= MAX_POSSIBLE_COST) {
+                wrong += e != NULL;
+                continue;
+            }
+            (*route_count)++;
+            if (e == NULL || e->cost != expected) {
+                wrong++;
+                continue;
+            }
+            int hop = router_of(e->first_hop_port);
+            struct sim_link *l = link_between(s, e->first_hop_port);
+            if (l == NULL || !l->up || !my_routers[hop].alive ||
+                    l->cost + all[hop][d] != expected) {
+                wrong++;
+            }
+        }
+    }
+
+    for (i=0; i<my_router_count; i++) {
+        free(all[i]);
+    }
+    free(all);
+    free(dist);
+    free(heap);
+    free(position);
+    return wrong;
+}
+
+//-----------------------------------------------------------------------------
+// Running the scenario
+
+static void sim_handle_event(struct sim_event *e) {
+    struct sim_router *s = &my_routers[e->router];
+    if (e->type == SIM_START) {
+        s->alive = 1;
+    }
+    if (!s->alive) {
+        if (e->type == SIM_DELIVER) {
+            my_dropped++;
+        }
+        return;
+    }
+    uint64_t start = cpu_ns();
+    switch (e->type) {
+        case SIM_START:
+            router_start(&s->r);
+            if (my_refresh_interval_ms > 0) {
+                event_push(event_new(SIM_REFRESH, e->router,
+                        my_now_us + my_refresh_interval_ms * 1000ULL, 0));
+            }
+        break;
+        case SIM_DELIVER:
+            router_handle_packet(&s->r, e->sender_port, e->data, e->length);
+            router_end_batch(&s->r);
+        break;
+        case SIM_TIMER:
+            if (e->timer_generation == s->timer_generation) {
+                router_update_timer_expired(&s->r);
+            }
+        break;
+        case SIM_REFRESH:
+            router_refresh(&s->r);
+            event_push(event_new(SIM_REFRESH, e->router,
+                    my_now_us + my_refresh_interval_ms * 1000ULL, 0));
+        break;
+    }
+    sim_flush();
+    s->cpu_ns += cpu_ns() - start;
+}
+
+// Runs until no event is left before end_us
+static void sim_run(uint64_t end_us) {
+    while (my_event_count > 0 && my_events[0]->time_us <= end_us) {
+        struct sim_event *e = event_pop();
+        my_now_us = e->time_us;
+        sim_handle_event(e);
+        free(e);
+    }
+}
+
+static void sim_totals(uint64_t *messages, uint64_t *bytes) {
+    *messages = 0;
+    *bytes = 0;
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        *messages += my_routers[i].r.stats.messages_sent;
+        *bytes += my_routers[i].r.stats.bytes_sent;
+    }
+}
+
+static void print_header() {
+    printf("%-8s %10s %10s %12s %9s %12s %12s %8s %8s\n", "phase",
+            "converge", "messages", "bytes", "dropped", "cpu/router",
+            "max cpu", "routes", "wrong");
+    printf("%-8s %10s %10s %12s %9s %12s %12s %8s %8s\n", "",
+            "ms", "", "", "", "us", "us", "", "");
+}
+
+// Runs one phase to the end and reports on it. Everything counted is since
+//  the phase started. Refreshes never stop, so with them on a phase lasts
+//  three refresh intervals, enough for a lost message to be made up for.
+static int run_phase(const char *name, uint64_t start_us) {
+    uint64_t messages_before, bytes_before;
+    sim_totals(&messages_before, &bytes_before);
+    uint64_t dropped_before = my_dropped;
+    my_last_route_change_us = start_us;
+    if (my_refresh_interval_ms > 0) {
+        sim_run(start_us + 3000ULL * my_refresh_interval_ms);
+        my_now_us = start_us + 3000ULL * my_refresh_interval_ms;
+    } else {
+        sim_run(UINT64_MAX);
+    }
+
+    uint64_t messages, bytes;
+    sim_totals(&messages, &bytes);
+    uint64_t cpu_total = 0, cpu_max = 0;
+    int alive = 0;
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        struct sim_router *s = &my_routers[i];
+        if (s->alive) {
+            alive++;
+            cpu_total += s->cpu_ns;
+            if (s->cpu_ns > cpu_max) {
+                cpu_max = s->cpu_ns;
+            }
+        }
+        s->cpu_ns = 0;
+    }
+    long route_count;
+    long wrong = check_routes(&route_count);
+    printf("%-8s %10.1f %10" PRIu64 " %12" PRIu64 " %9" PRIu64
+            " %12.1f %12.1f %8ld %8ld\n", name,
+            (my_last_route_change_us - start_us) / 1000.0,
+            messages - messages_before, bytes - bytes_before,
+            my_dropped - dropped_before,
+            alive > 0 ? cpu_total / 1000.0 / alive : 0.0, cpu_max / 1000.0,
+            route_count, wrong);
+    fflush(stdout);
+    return wrong == 0;
+}
+
+static void phase_join() {
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        // Until it starts, a router drops whatever it is sent
+        event_push(event_new(SIM_START, i,
+                sim_random_range(0, JOIN_SPREAD_US), 0));
+    }
+}
+
+// Both ends of each failed link notice right away
+static void phase_link_failures() {
+    int up_count = 0;
+    int i;
+    for (i=0; i<my_link_count; i++) {
+        up_count += my_links[i].up;
+    }
+    int failures = my_failure_count < up_count ? my_failure_count : up_count;
+    for (i=0; i<failures; i++) {
+        struct sim_link *l;
+        do {
+            l = &my_links[sim_random() % my_link_count];
+        } while (!l->up);
+        l->up = 0;
+        int ends[2] = { l->a, l->b };
+        int k;
+        for (k=0; k<2; k++) {
+            struct sim_router *s = &my_routers[ends[k]];
+            if (!s->alive) {
+                continue;
+            }
+            uint64_t start = cpu_ns();
+            router_neighbor_down(&s->r, port_of(ends[1-k]));
+            router_end_batch(&s->r);
+            sim_flush();
+            s->cpu_ns += cpu_ns() - start;
+        }
+    }
+}
+
+// The killed routers tell their neighbors, then stop handling anything
+static void phase_kills() {
+    int alive_count = 0;
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        alive_count += my_routers[i].alive;
+    }
+    int kills = my_kill_count < alive_count - 1 ?
+            my_kill_count : alive_count - 1;
+    for (i=0; i<kills; i++) {
+        struct sim_router *s;
+        do {
+            s = &my_routers[sim_random() % my_router_count];
+        } while (!s->alive);
+        router_shutdown(&s->r);
+        sim_flush();
+        s->alive = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+static int parse_int(const char *str, long low, long high, long *result) {
+    char *end;
+    errno = 0;
+    long value = strtol(str, &end, 10);
+    if (errno == ERANGE || value < low || value > high
+            || end == str || *end != '\0') {
+        return -1;
+    }
+    *result = value;
+    return 0;
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-n routers] [-d degree] [-c max_cost]"
+            " [-s seed] [-L loss]\n"
+            "       [-r refresh] [-f failures] [-k kills] [-m min_delay]\n"
+            "       [-M max_delay] [-l level] [-t topology_file] [-A]"
+            " [-F]\n",
+            program_name);
+    fprintf(stderr, "  -t  topology file, in the format of sample_topology.txt"
+            " (default: random)\n");
+    fprintf(stderr, "  -n  routers, 2 to %d (default 1000)\n", MAX_ROUTERS);
+    fprintf(stderr, "  -d  average links per router (default 4)\n");
+    fprintf(stderr, "  -c  link costs are 1 to this (default 5)\n");
+    fprintf(stderr, "  -s  random seed (default 1)\n");
+    fprintf(stderr, "  -L  percentage of messages lost (default 0)\n");
+    fprintf(stderr, "  -r  ms between full DV refreshes"
+            " (default 0: never)\n");
+    fprintf(stderr, "  -f  links that fail after joining (default 1)\n");
+    fprintf(stderr, "  -k  routers killed after that (default 1)\n");
+    fprintf(stderr, "  -m  ms to hold down DV updates after the last change"
+            " (default %d)\n", DEFAULT_MIN_UPDATE_DELAY_MS);
+    fprintf(stderr, "  -M  ms a DV update may be held down at most"
+            " (default %d)\n", DEFAULT_MAX_UPDATE_DELAY_MS);
+    fprintf(stderr, "  -l  verbosity: error, warn, info, debug or trace"
+            " (default warn)\n");
+    fprintf(stderr, "  -A  advertise runs of destinations as ranges\n");
+    fprintf(stderr, "  -F  only take routes that pass the feasibility"
+            " condition: no counting\n      to infinity when a link failure"
+            " cuts a destination off, but slower\n      to reconverge after a"
+            " link failure\n");
+}
+
+int main(int argc, char **argv) {
+    long min_delay = DEFAULT_MIN_UPDATE_DELAY_MS;
+    long max_delay = DEFAULT_MAX_UPDATE_DELAY_MS;
+    int aggregate = 0;
+    int feasibility = 0;
+    long value;
+    int opt;
+    log_level = LOG_WARN;
+    while ((opt = getopt(argc, argv, "n:d:c:s:L:r:f:k:m:M:l:t:AF")) != -1) {
+        int ok = 1;
+        switch (opt) {
+            case 'n':
+                ok = parse_int(optarg, 2, MAX_ROUTERS, &value) == 0;
+                my_router_count = value;
+            break;
+            case 'd':
+                ok = parse_int(optarg, 2, 1000, &value) == 0;
+                my_degree = value;
+            break;
+            case 'c':
+                ok = parse_int(optarg, 1, MAX_POSSIBLE_COST - 1, &value) == 0;
+                my_max_cost = value;
+            break;
+            case 's':
+                ok = parse_int(optarg, 0, INT32_MAX, &value) == 0;
+                my_seed = value;
+            break;
+            case 'L':
+                ok = parse_int(optarg, 0, 99, &value) == 0;
+                my_loss_percent = value;
+            break;
+            case 'r':
+                ok = parse_int(optarg, 0, 3600000, &value) == 0;
+                my_refresh_interval_ms = value;
+            break;
+            case 'f':
+                ok = parse_int(optarg, 0, INT32_MAX, &value) == 0;
+                my_failure_count = value;
+            break;
+            case 'k':
+                ok = parse_int(optarg, 0, INT32_MAX, &value) == 0;
+                my_kill_count = value;
+            break;
+            case 'm':
+                ok = parse_int(optarg, 0, 60000, &min_delay) == 0;
+            break;
+            case 'M':
+                ok = parse_int(optarg, 0, 60000, &max_delay) == 0;
+            break;
+            case 'l':
+                log_level = log_parse_level(optarg);
+                ok = log_level >= 0;
+            break;
+            case 't':
+                my_topology_file_name = optarg;
+            break;
+            case 'A':
+                aggregate = 1;
+            break;
+            case 'F':
+                feasibility = 1;
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid value %s for -%c\n", optarg, opt);
+            exit(1);
+        }
+    }
+    if (min_delay > max_delay) {
+        fprintf(stderr, "Error: Minimum update delay exceeds maximum\n");
+        exit(1);
+    }
+    if (optind < argc) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    // xorshift must not start at 0
+    my_rng_state = my_seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    struct topology topology;
+    if (my_topology_file_name != NULL) {
+        if (topology_load(&topology, my_topology_file_name) < 0) {
+            exit(1);
+        }
+        my_router_count = topology.node_count;
+        if (my_router_count < 2 || my_router_count > MAX_ROUTERS) {
+            fprintf(stderr, "Error: %d routers in %s, need 2 to %d\n",
+                    my_router_count, my_topology_file_name, MAX_ROUTERS);
+            exit(1);
+        }
+    }
+
+    log_init();
+    my_routers = calloc(my_router_count, sizeof(struct sim_router));
+    if (my_routers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    if (my_topology_file_name != NULL) {
+        build_file_topology(&topology);
+        topology_free(&topology);
+    } else {
+        build_random_topology();
+    }
+    init_routers();
+    int i;
+    for (i=0; i<my_router_count; i++) {
+        my_routers[i].r.min_update_delay_ms = min_delay;
+        my_routers[i].r.max_update_delay_ms = max_delay;
+        my_routers[i].r.aggregate = aggregate;
+        my_routers[i].r.feasibility = feasibility;
+    }
+    printf("%d routers, %d links, seed %" PRIu64 ", loss %d%%,"
+            " hold-down %ld-%ld ms, refresh %d ms\n", my_router_count,
+            my_link_count, my_seed, my_loss_percent, min_delay, max_delay,
+            my_refresh_interval_ms);
+    print_header();
+
+    double start = cpu_seconds();
+    int ok = 1;
+    phase_join();
+    ok &= run_phase("join", 0);
+    if (my_failure_count > 0) {
+        uint64_t phase_start = my_now_us;
+        phase_link_failures();
+        ok &= run_phase("failure", phase_start);
+    }
+    if (my_kill_count > 0) {
+        uint64_t phase_start = my_now_us;
+        phase_kills();
+        ok &= run_phase("kill", phase_start);
+    }
+    printf("simulated %.1f ms in %.2f s of CPU\n", my_now_us / 1000.0,
+            cpu_seconds() - start);
+
+    for (i=0; i<my_router_count; i++) {
+        router_free(&my_routers[i].r);
+        free(my_routers[i].links);
+    }
+    free(my_routers);
+    free(my_links);
+    // Refreshes are still scheduled
+    while (my_event_count > 0) {
+        free(event_pop());
+    }
+    free(my_events);
+    free(my_arena);
+    // Without refreshes nothing makes up for lost messages, so wrong routes
+    //  are expected then
+    return ok || (my_loss_percent > 0 && my_refresh_interval_ms == 0) ? 0 : 1;
+}
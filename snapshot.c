@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "logger.h"
+
+#define SNAPSHOT_MAGIC "DVSNAP1"
+#define SNAPSHOT_PATH_LEN 4096
+
+struct snapshot_header {
+    char magic[8];
+    uint16_t port;
+    uint16_t unused;
+    uint32_t record_count;
+    uint32_t checksum;
+};
+
+struct snapshot_record {
+    uint16_t from_port;
+    uint16_t dest_port; // DV_EMPTY_PORT marks a neighbor that is up
+    uint16_t first_hop_port;
+    uint16_t unused;
+    uint32_t cost;
+};
+
+// FNV-1a
+static uint32_t snapshot_checksum(const struct snapshot_record *records,
+        uint32_t count) {
+    const unsigned char *p = (const unsigned char *) records;
+    size_t length = count * sizeof(struct snapshot_record);
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for (i=0; i<length; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static struct snapshot_record *add_dv(struct snapshot_record *record,
+        uint16_t from_port, const struct dv_table *dv) {
+    int i;
+    for (i=0; i<dv->capacity; i++) {
+        const struct dv_entry *e = &(dv->slots[i]);
+        if (dv_slot_used(e)) {
+            memset(record, 0, sizeof *record);
+            record->from_port = from_port;
+            record->dest_port = e->dest_port;
+            record->first_hop_port = e->first_hop_port;
+            record->cost = e->cost;
+            record++;
+        }
+    }
+    return record;
+}
+
+int snapshot_save(struct router *r, const char *path) {
+    uint32_t count = r->dv.length;
+    struct neighbor_list_node *node = r->neighbors;
+    for (; node!=NULL; node = node->next) {
+        if (node->up) {
+            count += 1 + node->dv.length;
+        }
+    }
+    size_t size = sizeof(struct snapshot_header)
+            + count * sizeof(struct snapshot_record);
+
+    char temp_path[SNAPSHOT_PATH_LEN];
+    if (snprintf(temp_path, sizeof temp_path, "%s.tmp", path)
+            >= (int) sizeof temp_path) {
+        LOG(LOG_WARN, "Warning: Snapshot path %s is too long", LOG_STR(path));
+        return -1;
+    }
+    int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        LOG(LOG_WARN, "Warning: Can't write snapshot %s (errno %d)",
+                LOG_STR(path), errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG(LOG_WARN, "Warning: Can't map snapshot %s (errno %d)",
+                LOG_STR(path), errno);
+        return -1;
+    }
+
+    struct snapshot_header *header = (struct snapshot_header *) map;
+    struct snapshot_record *records =
+            (struct snapshot_record *) (map + sizeof *header);
+    struct snapshot_record *record = records;
+    for (node = r->neighbors; node!=NULL; node = node->next) {
+        if (node->up) {
+            memset(record, 0, sizeof *record);
+            record->from_port = node->port;
+            record++;
+            record = add_dv(record, node->port, &node->dv);
+        }
+    }
+    add_dv(record, r->port, &r->dv);
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof header->magic);
+    header->port = r->port;
+    header->record_count = count;
+    header->checksum = snapshot_checksum(records, count);
+    munmap(map, size);
+
+    if (rename(temp_path, path) < 0) {
+        LOG(LOG_WARN, "Warning: Can't replace snapshot %s (errno %d)",
+                LOG_STR(path), errno);
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_load(struct router *r, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            LOG(LOG_WARN, "Warning: Can't open snapshot %s (errno %d)",
+                    LOG_STR(path), errno);
+        }
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0
+            || st.st_size < (off_t) sizeof(struct snapshot_header)) {
+        LOG(LOG_WARN, "Warning: Snapshot %s is too short", LOG_STR(path));
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG(LOG_WARN, "Warning: Can't map snapshot %s (errno %d)",
+                LOG_STR(path), errno);
+        return -1;
+    }
+
+    const struct snapshot_header *header =
+            (const struct snapshot_header *) map;
+    const struct snapshot_record *records =
+            (const struct snapshot_record *) (map + sizeof *header);
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof header->magic) != 0
+            || header->port != r->port
+            || size != sizeof *header
+                    + header->record_count * sizeof(struct snapshot_record)
+            || header->checksum != snapshot_checksum(records,
+                    header->record_count)) {
+        LOG(LOG_WARN, "Warning: Snapshot %s is not a valid snapshot of this"
+                " router; starting cold", LOG_STR(path));
+        munmap(map, size);
+        return -1;
+    }
+
+    int restored = 0;
+    int rejected = 0;
+    uint32_t i;
+    for (i=0; i<header->record_count; i++) {
+        const struct snapshot_record *record = &records[i];
+        struct dv_entry e = {
+            .dest_port = record->dest_port,
+            .first_hop_port = record->first_hop_port,
+            .cost = record->cost,
+        };
+        if (router_restore(r, record->from_port,
+                record->dest_port == DV_EMPTY_PORT ? NULL : &e) < 0) {
+            rejected++;
+        } else {
+            restored++;
+        }
+    }
+    munmap(map, size);
+    if (rejected > 0) {
+        LOG(LOG_WARN, "Warning: %d entries of snapshot %s don't fit the"
+                " topology", rejected, LOG_STR(path));
+    }
+    return restored;
+}
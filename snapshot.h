@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "router.h"
+
+// Checkpoints of a router's routing state for warm restarts: its DV and
+//  the DVs its neighbors last sent. A restarted router that loads one
+//  advertises the routes it had instead of none, so its neighbors keep
+//  their routes through it and the network doesn't reconverge.
+//
+// The file is a header and fixed-size records in host byte order, as it is
+//  only read back on the same host:
+//      header                  magic, the router's port, record count and
+//                               a checksum of the records
+//      per neighbor that is up:
+//          record              from_port = the neighbor, dest_port = 0
+//          record per entry    of the neighbor's DV
+//      record per entry        of the router's own DV, from_port = its port
+// It is written through a mapping of a temporary file that is then renamed
+//  over the old one, so a reader never sees half a snapshot.
+
+// Returns 0, or -1 (after saying why) if the snapshot couldn't be written
+int snapshot_save(struct router *r, const char *path);
+
+// Restores the router from the snapshot at path (see router_restore), if
+//  there is one and it belongs to this router. Returns the number of
+//  entries restored, or -1 if there was nothing usable.
+int snapshot_load(struct router *r, const char *path);
+
+#endif
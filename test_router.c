@@ -0,0 +1,381 @@
+// Tests of the DV protocol (router.c) in situations that a run of sim only
+//  reaches by chance, over a fake transport that loses exactly the messages
+//  a test tells it to. Messages are delivered in the order they were sent,
+//  and time only moves when the test moves it.
+//
+// Usage: test_router
+//   Prints one line per test, and exits with 1 at the first that fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "router.h"
+#include "logger.h"
+
+#define TEST_ROUTERS 4
+#define TEST_MAX_MESSAGES 1024
+
+struct test_router {
+    struct router r;
+    int started;
+    int timer_armed;
+    uint64_t timer_due_ms;
+};
+
+struct test_message {
+    uint16_t from_port;
+    uint16_t to_port;
+    size_t length;
+    char *data;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+struct test_router my_routers[TEST_ROUTERS];
+struct test_message my_messages[TEST_MAX_MESSAGES]; // Sent, not delivered
+int my_message_count = 0;
+uint64_t my_now_ms = 0;
+char *my_arena; // Message bodies reserved by the routers
+size_t my_arena_used = 0;
+size_t my_arena_capacity = 0;
+unsigned long my_flush_count = 0;
+unsigned long my_sent_count = 0; // Sent by any router, lost or not
+int my_ranges_sent[TEST_ROUTERS]; // DV datagrams with ranges, by receiver
+
+// Messages of this type from this port to that one are lost, as many as
+//  drop_count says
+struct test_drop {
+    uint8_t type;
+    uint16_t from_port;
+    uint16_t to_port;
+    int drop_count;
+};
+struct test_drop my_drops[4];
+int my_drop_rule_count = 0;
+//-----------------------------------------------------------------------------
+
+static void *test_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static inline uint16_t port_of(int router) {
+    return (uint16_t) (router + 1);
+}
+
+static void fail(const char *test, const char *what) {
+    fprintf(stderr, "Error: %s: %s\n", test, what);
+    exit(1);
+}
+
+//-----------------------------------------------------------------------------
+// The fake transport. The context of each router is its test_router.
+
+// Messages are copied when sent, so bodies only need to last until the next
+//  router has its turn
+static void test_flush() {
+    my_arena_used = 0;
+    my_flush_count++;
+}
+
+static char *test_reserve(void *ctx, size_t size) {
+    (void) ctx;
+    if (my_arena_used + size > my_arena_capacity) {
+        test_flush();
+        if (size > my_arena_capacity) {
+            free(my_arena);
+            my_arena_capacity = size > 65536 ? size : 65536;
+            my_arena = test_alloc(NULL, my_arena_capacity);
+        }
+    }
+    char *p = my_arena + my_arena_used;
+    my_arena_used += size;
+    return p;
+}
+
+static unsigned long test_flush_count(void *ctx) {
+    (void) ctx;
+    return my_flush_count;
+}
+
+// Returns 1 if the message is one of those to lose
+static int test_drop(uint8_t type, uint16_t from_port, uint16_t to_port) {
+    int i;
+    for (i=0; i<my_drop_rule_count; i++) {
+        struct test_drop *d = &my_drops[i];
+        if (d->drop_count > 0 && d->type == type &&
+                d->from_port == from_port && d->to_port == to_port) {
+            d->drop_count--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void test_send(void *ctx, const char *head, size_t head_length,
+        const char *body, size_t body_length, uint16_t dest_port) {
+    struct test_router *t = ctx;
+    my_sent_count++;
+    uint8_t type = (uint8_t) head[0];
+    if ((type == DV_PACKET || type == INITIAL_DV_PACKET
+            || type == DV_DELTA_PACKET) && head_length > 1
+            && head[1] == DV_WIRE_VERSION_RANGES) {
+        my_ranges_sent[dest_port - 1]++;
+    }
+    if (test_drop((uint8_t) head[0], t->r.port, dest_port)) {
+        return;
+    }
+    if (my_message_count == TEST_MAX_MESSAGES) {
+        fprintf(stderr, "Error: More than %d messages in flight\n",
+                TEST_MAX_MESSAGES);
+        exit(1);
+    }
+    struct test_message *m = &my_messages[my_message_count++];
+    m->from_port = t->r.port;
+    m->to_port = dest_port;
+    m->length = head_length + body_length;
+    m->data = test_alloc(NULL, m->length);
+    memcpy(m->data, head, head_length);
+    if (body_length > 0) {
+        memcpy(m->data + head_length, body, body_length);
+    }
+}
+
+static uint64_t test_now_ms(void *ctx) {
+    (void) ctx;
+    return my_now_ms;
+}
+
+static void test_set_update_timer(void *ctx, uint64_t delay_ms) {
+    struct test_router *t = ctx;
+    t->timer_armed = 1;
+    t->timer_due_ms = my_now_ms + delay_ms;
+}
+
+const struct router_ops my_test_ops = {
+    test_reserve,
+    test_flush_count,
+    test_send,
+    test_now_ms,
+    test_set_update_timer,
+    NULL
+};
+
+//-----------------------------------------------------------------------------
+// Running the network
+
+static void test_init() {
+    int i;
+    for (i=0; i<TEST_ROUTERS; i++) {
+        struct test_router *t = &my_routers[i];
+        router_init(&t->r, NULL, port_of(i), &my_test_ops, t);
+        t->started = 0;
+        t->timer_armed = 0;
+        my_ranges_sent[i] = 0;
+    }
+    my_now_ms = 0;
+    my_drop_rule_count = 0;
+}
+
+static void test_free() {
+    int i;
+    for (i=0; i<TEST_ROUTERS; i++) {
+        router_free(&my_routers[i].r);
+    }
+    for (i=0; i<my_message_count; i++) {
+        free(my_messages[i].data);
+    }
+    my_message_count = 0;
+}
+
+static void test_link(int a, int b, uint32_t cost) {
+    router_add_neighbor(&my_routers[a].r, port_of(b), cost);
+    router_add_neighbor(&my_routers[b].r, port_of(a), cost);
+}
+
+static void test_start(int i) {
+    my_routers[i].started = 1;
+    router_start(&my_routers[i].r);
+}
+
+static void test_lose(uint8_t type, int from, int to, int count) {
+    struct test_drop *d = &my_drops[my_drop_rule_count++];
+    d->type = type;
+    d->from_port = port_of(from);
+    d->to_port = port_of(to);
+    d->drop_count = count;
+}
+
+// Delivers every message in flight, and those they lead to, each as a
+//  batch of its own. Messages to routers that haven't started are lost.
+static void test_deliver() {
+    int next = 0;
+    while (next < my_message_count) {
+        struct test_message m = my_messages[next++];
+        struct test_router *t = &my_routers[m.to_port - 1];
+        if (t->started) {
+            router_handle_packet(&t->r, m.from_port, m.data, m.length);
+            router_end_batch(&t->r);
+        }
+        free(m.data);
+    }
+    my_message_count = 0;
+}
+
+// Moves time on by ms, a millisecond at a time, firing the update timers
+//  that come due and delivering everything sent meanwhile
+static void test_run(uint64_t ms) {
+    uint64_t until = my_now_ms + ms;
+    for (; my_now_ms<=until; my_now_ms++) {
+        int i;
+        for (i=0; i<TEST_ROUTERS; i++) {
+            struct test_router *t = &my_routers[i];
+            if (t->started && t->timer_armed && t->timer_due_ms <= my_now_ms) {
+                t->timer_armed = 0;
+                router_update_timer_expired(&t->r);
+            }
+        }
+        test_deliver();
+    }
+    my_now_ms = until;
+}
+
+// Cost of router from's route to router to, or UINT32_MAX if it has none
+static uint32_t test_cost(int from, int to) {
+    struct dv_entry *e = dv_find(&my_routers[from].r.dv, port_of(to));
+    return e == NULL ? UINT32_MAX : e->cost;
+}
+
+//-----------------------------------------------------------------------------
+// Tests
+
+// B (1) starts after A (0), so the only full DV A ever sends it is the reply
+//  to its initial one, which is lost. A then only sends deltas, as its link
+//  to C (2) changes cost, and B has to keep asking for the full DV until it
+//  gets it, though its first request is lost too.
+static void test_resync_after_lost_full_dv() {
+    const char *name = "resync after a lost full DV and a lost resync";
+    test_init();
+    test_link(0, 1, 1);
+    test_link(0, 2, 1);
+
+    test_start(0);
+    test_start(2);
+    test_run(200);
+    test_lose(DV_PACKET, 0, 1, 1);
+    test_lose(DV_RESYNC_PACKET, 1, 0, 1);
+    test_start(1);
+    test_run(200);
+    if (test_cost(1, 2) != UINT32_MAX) {
+        fail(name, "B has a route to C without A's full DV");
+    }
+
+    uint32_t cost;
+    for (cost=2; cost<=5; cost++) {
+        router_set_link_cost(&my_routers[0].r, port_of(2), cost);
+        router_set_link_cost(&my_routers[2].r, port_of(0), cost);
+        router_end_batch(&my_routers[0].r);
+        router_end_batch(&my_routers[2].r);
+        test_run(200);
+    }
+    if (my_drops[0].drop_count != 0 || my_drops[1].drop_count != 0) {
+        fail(name, "the full DV and the resync weren't both sent");
+    }
+    if (neighbor_list_find(my_routers[1].r.neighbors, port_of(0))->rx_seq
+            == 0) {
+        fail(name, "B is still waiting for A's full DV");
+    }
+    if (test_cost(1, 2) != 1 + 5) {
+        fail(name, "B's route to C doesn't go through A at the right cost");
+    }
+    test_free();
+    printf("ok    %s\n", name);
+}
+
+// D (3) hangs off A (0), which is in a triangle with B (1) and C (2), and
+//  shuts down. Without its KILLED_PACKET telling them D is gone, B and C
+//  would each take the other's stale route to D when A withdraws its own,
+//  and the three would count up to MAX_POSSIBLE_COST.
+static void test_no_counting_to_infinity_after_kill() {
+    const char *name = "no counting to infinity after a router is killed";
+    test_init();
+    test_link(0, 1, 1);
+    test_link(0, 2, 1);
+    test_link(1, 2, 1);
+    test_link(0, 3, 1);
+
+    int i;
+    for (i=0; i<TEST_ROUTERS; i++) {
+        test_start(i);
+    }
+    test_run(200);
+    if (test_cost(1, 3) != 2 || test_cost(2, 3) != 2) {
+        fail(name, "B and C don't route to D through A");
+    }
+
+    unsigned long sent = my_sent_count;
+    router_shutdown(&my_routers[3].r);
+    my_routers[3].started = 0;
+    test_run(1000);
+    for (i=0; i<3; i++) {
+        if (test_cost(i, 3) != UINT32_MAX) {
+            fail(name, "a route to D is left");
+        }
+    }
+    if (my_sent_count - sent > 10) {
+        fail(name, "A, B and C kept telling each other about D");
+    }
+    test_free();
+    printf("ok    %s\n", name);
+}
+
+// A (0) aggregates. B (1) never says which versions it decodes, as a router
+//  from before DV_VERSION_PACKET wouldn't, and C (2) does, so only C is
+//  sent ranges.
+static void test_ranges_only_to_neighbors_that_decode_them() {
+    const char *name = "ranges only to neighbors that decode them";
+    test_init();
+    my_routers[0].r.aggregate = 1;
+    test_link(0, 1, 1);
+    test_link(0, 2, 1);
+    test_lose(DV_VERSION_PACKET, 1, 0, 1000);
+
+    int i;
+    for (i=0; i<TEST_ROUTERS; i++) {
+        test_start(i);
+    }
+    test_run(200);
+    router_set_link_cost(&my_routers[0].r, port_of(2), 2);
+    router_set_link_cost(&my_routers[2].r, port_of(0), 2);
+    router_end_batch(&my_routers[0].r);
+    router_end_batch(&my_routers[2].r);
+    test_run(200);
+    router_refresh(&my_routers[0].r);
+    test_run(200);
+
+    if (my_ranges_sent[1] != 0) {
+        fail(name, "B was sent ranges");
+    }
+    if (my_ranges_sent[2] == 0) {
+        fail(name, "C wasn't sent ranges");
+    }
+    if (test_cost(1, 2) != 1 + 2) {
+        fail(name, "B's route to C doesn't go through A at the right cost");
+    }
+    test_free();
+    printf("ok    %s\n", name);
+}
+
+int main() {
+    log_level = LOG_ERROR;
+    log_init();
+    test_resync_after_lost_full_dv();
+    test_no_counting_to_infinity_after_kill();
+    test_ranges_only_to_neighbors_that_decode_them();
+    return 0;
+}
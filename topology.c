@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "topology.h"
+
+#define TOPOLOGY_INITIAL_NAMES 64
+
+static void *topology_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+// FNV-1a
+static uint32_t name_hash(const char *name, size_t name_length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for (i=0; i<name_length; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int *name_slot(const struct topology *t, const char *name,
+        size_t name_length) {
+    uint32_t mask = t->name_capacity - 1;
+    uint32_t i = name_hash(name, name_length) & mask;
+    while (1) {
+        int node = t->node_of_name[i];
+        if (node < 0 || ((size_t) t->nodes[node].name_length == name_length
+                && memcmp(t->nodes[node].name, name, name_length) == 0)) {
+            return &(t->node_of_name[i]);
+        }
+        i = (i+1) & mask;
+    }
+}
+
+static void grow_names(struct topology *t) {
+    free(t->node_of_name);
+    t->name_capacity = t->name_capacity == 0 ?
+            TOPOLOGY_INITIAL_NAMES : 2*t->name_capacity;
+    t->node_of_name = topology_alloc(NULL, t->name_capacity * sizeof(int));
+    memset(t->node_of_name, -1, t->name_capacity * sizeof(int));
+    int node;
+    for (node=0; node<t->node_count; node++) {
+        *name_slot(t, t->nodes[node].name, t->nodes[node].name_length) = node;
+    }
+}
+
+// Returns the index of the node with this name, adding it if it's new
+static int intern(struct topology *t, const char *name, size_t name_length,
+        int *node_capacity) {
+    int *slot = name_slot(t, name, name_length);
+    if (*slot >= 0) {
+        return *slot;
+    }
+    if (t->node_count == *node_capacity) {
+        *node_capacity = *node_capacity == 0 ? 64 : 2 * *node_capacity;
+        t->nodes = topology_alloc(t->nodes,
+                *node_capacity * sizeof(struct topology_node));
+    }
+    int node = t->node_count++;
+    struct topology_node *n = &(t->nodes[node]);
+    n->name = name;
+    n->name_length = name_length;
+    n->port = 0;
+    n->first_link = 0;
+    n->link_count = 0;
+    *slot = node;
+    // Keep the table at most half full
+    if (2 * t->node_count > t->name_capacity) {
+        grow_names(t);
+    }
+    return node;
+}
+
+// Parses a decimal number from 0 to UINT16_MAX that makes up the whole field
+static int parse_uint16(const char *field, size_t length, uint16_t *result) {
+    if (length == 0 || length > 5) {
+        return -1;
+    }
+    uint32_t value = 0;
+    size_t i;
+    for (i=0; i<length; i++) {
+        if (field[i] < '0' || field[i] > '9') {
+            return -1;
+        }
+        value = value*10 + (field[i] - '0');
+    }
+    if (value > UINT16_MAX) {
+        return -1;
+    }
+    *result = (uint16_t) value;
+    return 0;
+}
+
+// Groups the links by source, keeping file order within each source
+static void index_links(struct topology *t) {
+    struct topology_link *sorted = topology_alloc(NULL,
+            (t->link_count > 0 ? t->link_count : 1)
+            * sizeof(struct topology_link));
+    int i;
+    for (i=0; i<t->link_count; i++) {
+        t->nodes[t->links[i].src].link_count++;
+    }
+    int next = 0;
+    for (i=0; i<t->node_count; i++) {
+        t->nodes[i].first_link = next;
+        next += t->nodes[i].link_count;
+        t->nodes[i].link_count = 0;
+    }
+    for (i=0; i<t->link_count; i++) {
+        struct topology_node *n = &(t->nodes[t->links[i].src]);
+        sorted[n->first_link + n->link_count++] = t->links[i];
+    }
+    free(t->links);
+    t->links = sorted;
+}
+
+static int map_file(struct topology *t, const char *file_name) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening network topology file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Error reading network topology file");
+        close(fd);
+        return -1;
+    }
+    t->map_length = st.st_size;
+    if (t->map_length == 0) {
+        close(fd);
+        return 0;
+    }
+    t->map = mmap(NULL, t->map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t->map == MAP_FAILED) {
+        t->map = NULL;
+        perror("Error mapping network topology file");
+        return -1;
+    }
+    madvise(t->map, t->map_length, MADV_SEQUENTIAL);
+    return 0;
+}
+
+static int parse_error(struct topology *t, const char *file_name, int line,
+        const char *what) {
+    fprintf(stderr, "Error: %s line %d: %s\n", file_name, line, what);
+    topology_free(t);
+    return -1;
+}
+
+int topology_load(struct topology *t, const char *file_name) {
+    memset(t, 0, sizeof *t);
+    if (map_file(t, file_name) < 0) {
+        return -1;
+    }
+    t->node_of_port = topology_alloc(NULL,
+            (UINT16_MAX + 1) * sizeof(int32_t));
+    memset(t->node_of_port, -1, (UINT16_MAX + 1) * sizeof(int32_t));
+    grow_names(t);
+    int node_capacity = 0;
+    int link_capacity = 0;
+
+    const char *p = t->map;
+    const char *end = t->map + t->map_length;
+    int line = 0;
+    while (p < end) {
+        line++;
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            eol = end;
+        }
+        const char *line_end = eol;
+        if (line_end > p && line_end[-1] == '\r') {
+            line_end--;
+        }
+        if (line_end == p || *p == '#') {
+            p = eol + 1;
+            continue;
+        }
+
+        // <source router>,<destination router>,<port>,<cost>
+        const char *field[4];
+        size_t field_length[4];
+        const char *f = p;
+        int i;
+        for (i=0; i<4; i++) {
+            const char *comma = i < 3 ? memchr(f, ',', line_end - f) : NULL;
+            const char *field_end = comma != NULL ? comma : line_end;
+            if (i < 3 && comma == NULL) {
+                return parse_error(t, file_name, line,
+                        "expected 4 comma separated fields");
+            }
+            field[i] = f;
+            field_length[i] = field_end - f;
+            f = field_end + 1;
+        }
+        if (memchr(field[3], ',', field_length[3]) != NULL) {
+            return parse_error(t, file_name, line,
+                    "expected 4 comma separated fields");
+        }
+        if (field_length[0] == 0 || field_length[1] == 0) {
+            return parse_error(t, file_name, line, "empty router name");
+        }
+        uint16_t port, cost;
+        if (parse_uint16(field[2], field_length[2], &port) < 0 || port == 0) {
+            return parse_error(t, file_name, line, "invalid port");
+        }
+        if (parse_uint16(field[3], field_length[3], &cost) < 0) {
+            return parse_error(t, file_name, line, "invalid cost");
+        }
+
+        int src = intern(t, field[0], field_length[0], &node_capacity);
+        int dest = intern(t, field[1], field_length[1], &node_capacity);
+        if (src == dest) {
+            return parse_error(t, file_name, line, "router linked to itself");
+        }
+        struct topology_node *d = &(t->nodes[dest]);
+        if (d->port != 0 && d->port != port) {
+            return parse_error(t, file_name, line,
+                    "router already has a different port");
+        }
+        if (t->node_of_port[port] >= 0 && t->node_of_port[port] != dest) {
+            return parse_error(t, file_name, line,
+                    "port already belongs to another router");
+        }
+        d->port = port;
+        t->node_of_port[port] = dest;
+
+        if (t->link_count == link_capacity) {
+            link_capacity = link_capacity == 0 ? 256 : 2*link_capacity;
+            t->links = topology_alloc(t->links,
+                    link_capacity * sizeof(struct topology_link));
+        }
+        struct topology_link *l = &(t->links[t->link_count++]);
+        l->src = src;
+        l->dest = dest;
+        l->port = port;
+        l->cost = cost;
+
+        p = eol + 1;
+    }
+    index_links(t);
+    return 0;
+}
+
+void topology_free(struct topology *t) {
+    if (t->map != NULL) {
+        munmap(t->map, t->map_length);
+    }
+    free(t->nodes);
+    free(t->links);
+    free(t->node_of_name);
+    free(t->node_of_port);
+    memset(t, 0, sizeof *t);
+}
+
+int topology_find_name(const struct topology *t, const char *name,
+        size_t name_length) {
+    if (t->name_capacity == 0) {
+        return -1;
+    }
+    return *name_slot(t, name, name_length);
+}
+
+int topology_find_port(const struct topology *t, uint16_t port) {
+    return t->node_of_port[port];
+}
+
+uint16_t topology_offset_conflict(const struct topology *t, uint16_t offset) {
+    int i;
+    for (i=0; i<t->node_count; i++) {
+        uint16_t port = t->nodes[i].port;
+        if (port == 0) {
+            continue; // Nothing is ever sent to it
+        }
+        if (port + offset > UINT16_MAX
+                || topology_find_port(t, port + offset) >= 0) {
+            return port;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A network topology file, as in sample_topology.txt: one line per direction
+//  of each link,
+//      <source router>,<destination router>,<destination port>,<link cost>
+// Router names are any non-empty run of characters other than ',' and line
+//  breaks. Blank lines and lines starting with '#' are skipped.
+//
+// The file is mapped and parsed in one pass into a table of routers, each
+//  name stored once, and the links grouped by source router (in file order
+//  within each router). Names point into the mapping, which stays until
+//  topology_free.
+
+struct topology_node {
+    const char *name; // Not NUL-terminated
+    int name_length;
+    uint16_t port; // 0 if no link leads to it
+    int first_link; // Its links are links[first_link .. +link_count-1]
+    int link_count;
+};
+
+struct topology_link {
+    int src; // Node indexes
+    int dest;
+    uint16_t port; // Of dest
+    uint16_t cost;
+};
+
+struct topology {
+    char *map;
+    size_t map_length;
+    struct topology_node *nodes;
+    int node_count;
+    struct topology_link *links; // Grouped by src
+    int link_count;
+    int *node_of_name; // Open addressing hash table of node indexes, or -1
+    int name_capacity; // Always a power of two
+    int32_t *node_of_port; // UINT16_MAX + 1 entries, -1 if none
+};
+
+// Returns 0, or -1 after printing what is wrong with the file
+int topology_load(struct topology *t, const char *file_name);
+void topology_free(struct topology *t);
+
+// Both return a node index, or -1 if there is no such router
+int topology_find_name(const struct topology *t, const char *name,
+        size_t name_length);
+int topology_find_port(const struct topology *t, uint16_t port);
+
+// Port of the first router whose port plus offset is past UINT16_MAX or is
+//  another router's port, or 0 if there is none
+uint16_t topology_offset_conflict(const struct topology *t, uint16_t offset);
+
+#endif